@@ -1,5 +1,9 @@
 #pragma once
 
+#include <evaluator.hpp>
+#include <printer.hpp>
+#include <parser.hpp>
+
 #include <memory>
 #include <string>
 #include <vector>
@@ -9,9 +13,21 @@ class Statement;
 class REPL
 {
 public:
+  REPL(DefinitionTable trees, EvaluationStrategy strat, Engine engine, std::uint_fast64_t budget,
+       PrintOptions print_opts = {});
+
   void loop();
 
 private:
   std::vector<std::shared_ptr<Statement>> parse_input();
+private:
+  DefinitionTable trees;
+  EvaluationStrategy strat;
+  // the strategy of the command being evaluated
+  EvaluationStrategy command_strat;
+  Engine engine;
+  std::uint_fast64_t budget;
+
+  Printer printer;
 };
 
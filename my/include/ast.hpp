@@ -4,7 +4,11 @@
 #include <tokenizer.hpp>
 #include <symbol.hpp>
 #include <variant>
+#include <optional>
 #include <memory>
+#include <atomic>
+#include <array>
+#include <vector>
 
 #include <tsl/hopscotch_map.h>
 #include <tsl/hopscotch_set.h>
@@ -13,15 +17,44 @@ enum class EvaluationStrategy
 {
   CallByValue,
   CallByName,
-  Normal
+  Normal,
+  // normal form, arguments are normalized before a function is applied to them; the function
+  // is only reduced as far as call-by-value does, so recursion guarded by ifz still stops
+  Applicative,
+  // reduces the head under binders, arguments are left as they are
+  HeadNormal,
+  // an alias of CallByName, which already stops once the head is a λ, constructor or stuck
+  WeakHeadNormal
+};
+
+// the strategy the reducers follow, WeakHeadNormal is reduced as CallByName
+constexpr EvaluationStrategy reduction_order(EvaluationStrategy strat)
+{ return strat == EvaluationStrategy::WeakHeadNormal ? EvaluationStrategy::CallByName : strat; }
+
+enum class ExpressionKind
+{
+  Error,
+  Identifier,
+  FunctionCall,
+  Lambda,
+  Integer,
+  Primitive,
+  Church,
+  Substitution,
+  LetRec,
+  Recursive,
+  Let,
+  Shared,
+  Constructor,
+  Case
 };
 
 struct GIDTag
 {
   std::uint_fast64_t gid() const;
 private:
-  static std::uint_fast64_t gid_counter;
-  std::uint_fast64_t gid_val { gid_counter++ };
+  static std::atomic<std::uint_fast64_t> gid_counter;
+  std::uint_fast64_t gid_val { gid_counter.fetch_add(1, std::memory_order_relaxed) };
 };
 struct GIDTagHasher
 {
@@ -34,6 +67,9 @@ struct GIDTagComparer
   { if(lhs && rhs) return lhs->gid() == rhs->gid(); return false; }
 };
 
+// number of contractions performed so far by the calling thread
+std::uint_fast64_t contraction_count();
+
 template<class T, 
          unsigned int NeighborhoodSize = 62,
          bool StoreHash = false,
@@ -58,6 +94,9 @@ public:
     case EvaluationStrategy::CallByValue: return reduce_step_callbyvalue();
     case EvaluationStrategy::CallByName: return reduce_step_callbyname();
     case EvaluationStrategy::Normal: return reduce_step_normal();
+    case EvaluationStrategy::Applicative: return reduce_step_applicative();
+    case EvaluationStrategy::HeadNormal: return reduce_step_headnormal();
+    case EvaluationStrategy::WeakHeadNormal: return reduce_step_weakheadnormal();
     }
   }
 
@@ -69,34 +108,69 @@ protected:
   virtual Statement::Ptr reduce_step_normal() = 0;
   virtual Statement::Ptr reduce_step_callbyname() = 0;
   virtual Statement::Ptr reduce_step_callbyvalue() = 0;
+  virtual Statement::Ptr reduce_step_applicative() = 0;
+  virtual Statement::Ptr reduce_step_headnormal() = 0;
+  virtual Statement::Ptr reduce_step_weakheadnormal() = 0;
 private:
   SourceRange loc;
 };
 
 class Identifier;
-
+class Lambda;
+class Primitive;
+class ChurchEncoding;
+struct Origin;
+struct Thunk;
+struct TreeOps;
+class Focus;
+
+// Summarizes the free variables of a term in one bit per symbol. The first 63 symbols interned
+// have a bit of their own, all later ones share the last bit. The bits may claim more variables
+// than are actually free, never less, so a term without bits is closed.
+using FreeBits = std::uint64_t;
+
+FreeBits free_bit(Symbol sym);
+// the bits left outside of a binder for the variable with the given bit
+FreeBits bind(FreeBits bits, FreeBits bit);
+
+// All traversals of expression trees use explicit work lists instead of the native stack,
+// so terms of any depth can be reduced, copied, printed and destroyed.
 class Expression : public GIDTag, public std::enable_shared_from_this<Expression>
 {
   friend class FunctionCall;
   friend class Definition;
   friend class Lambda;
+  friend struct TreeOps;
 public:
   using Ptr = std::shared_ptr<Expression>;
 
   Expression(SourceRange loc);
 
+  virtual ExpressionKind kind() const = 0;
   virtual Expression::Ptr clone() = 0;
-  virtual void print(std::ostream& os) = 0;
+  void print(std::ostream& os);
 
-  SourceRange source_range();
+  // tags this subtree with the definition it was written in or inlined into
+  void attribute_to(const Origin* caller);
+  void free_variables(SymbolSet& out) const;
+
+  SourceRange source_range() const;
+  const Origin* origin() const;
+
+  FreeBits free_bits() const
+  { return free_summary; }
+  bool is_closed() const
+  { return free_summary == 0; }
 protected:
-  virtual void fv(SymbolSet& cur) = 0;
-  virtual void replace(std::shared_ptr<Identifier> what, Expression::Ptr with) {  }
-  virtual Expression::Ptr reduce_step_normal() = 0;
-  virtual Expression::Ptr reduce_step_callbyname() = 0;
-  virtual Expression::Ptr reduce_step_callbyvalue() = 0;
+  template<typename T>
+  std::shared_ptr<T> keep_origin(std::shared_ptr<T> copy) const
+  { copy->provenance = provenance; return copy; }
+
+  // set by the constructors, reductions only ever remove free variables so it stays valid
+  FreeBits free_summary = 0;
 private:
   SourceRange loc;
+  const Origin* provenance;
 };
 
 class ErrorStatement : public Statement
@@ -112,10 +186,16 @@ private:
   Statement::Ptr reduce_step_normal() override;
   Statement::Ptr reduce_step_callbyname() override;
   Statement::Ptr reduce_step_callbyvalue() override;
+  Statement::Ptr reduce_step_applicative() override;
+  Statement::Ptr reduce_step_headnormal() override;
+  Statement::Ptr reduce_step_weakheadnormal() override;
 };
 
 class Definition : public Statement
 {
+  friend class ChurchEncoding;
+  friend class Focus;
+  friend class Substitution;
 public:
   using Ptr = std::shared_ptr<Definition>;
 
@@ -125,10 +205,14 @@ public:
   void print(std::ostream& os) override;
 
   std::shared_ptr<Identifier> identifier() const;
+  const Expression::Ptr& expression() const;
 private:
   Statement::Ptr reduce_step_normal() override;
   Statement::Ptr reduce_step_callbyname() override;
   Statement::Ptr reduce_step_callbyvalue() override;
+  Statement::Ptr reduce_step_applicative() override;
+  Statement::Ptr reduce_step_headnormal() override;
+  Statement::Ptr reduce_step_weakheadnormal() override;
 private:
   Expression::Ptr id;
   Expression::Ptr body;
@@ -141,13 +225,8 @@ public:
 
   ErrorExpression(SourceRange loc);
 
+  ExpressionKind kind() const override;
   Expression::Ptr clone() override;
-  void print(std::ostream& os) override;
-private:
-  void fv(SymbolSet& cur) override {}
-  Expression::Ptr reduce_step_normal() override;
-  Expression::Ptr reduce_step_callbyname() override;
-  Expression::Ptr reduce_step_callbyvalue() override;
 };
 
 class Identifier : public Expression
@@ -156,37 +235,105 @@ public:
   using Ptr = std::shared_ptr<Identifier>;
 
   Identifier(SourceRange loc, Symbol symbol);
+  // the bit is free_bit(symbol), known already when copying
+  Identifier(SourceRange loc, Symbol symbol, FreeBits bit);
 
+  ExpressionKind kind() const override;
   Expression::Ptr clone() override;
-  void print(std::ostream& os) override;
 
   Symbol id() const;
-private:
-  void fv(SymbolSet& cur) override;
-  Expression::Ptr reduce_step_normal() override;
-  Expression::Ptr reduce_step_callbyname() override;
-  Expression::Ptr reduce_step_callbyvalue() override;
 private:
   Symbol symbol;
 };
 
+class Integer : public Expression
+{
+public:
+  using Ptr = std::shared_ptr<Integer>;
+
+  Integer(SourceRange loc, std::int64_t value);
+
+  ExpressionKind kind() const override;
+  Expression::Ptr clone() override;
+
+  std::int64_t value() const;
+private:
+  std::int64_t val;
+};
+
+enum class PrimitiveOp
+{
+  Add,
+  Sub,
+  Mul,
+  Div,
+  Less,
+  IfZero
+};
+
+// built-in operator, applied by a single δ-step once all its strict operands are integer literals
+class Primitive : public Expression
+{
+public:
+  using Ptr = std::shared_ptr<Primitive>;
+  static constexpr std::size_t max_arity = 3;
+
+  Primitive(SourceRange loc, PrimitiveOp op);
+
+  ExpressionKind kind() const override;
+  Expression::Ptr clone() override;
+
+  PrimitiveOp op() const;
+  const char* name() const;
+  std::size_t arity() const;
+  // leading operands that have to be literals, the rest is passed through unevaluated
+  std::size_t strict_arity() const;
+
+  static const char* name(PrimitiveOp op);
+  static std::size_t arity(PrimitiveOp op);
+  static std::size_t strict_arity(PrimitiveOp op);
+  // the arithmetic of the binary operators, false if undefined for these operands
+  static bool compute(PrimitiveOp op, std::int64_t lhs, std::int64_t rhs, std::int64_t& result);
+
+  // nullptr if the operation is undefined for these operands, e.g. division by zero
+  Expression::Ptr apply(SourceRange loc, const std::array<Expression::Ptr*, max_arity>& args) const;
+private:
+  PrimitiveOp operation;
+};
+
 class FunctionCall : public Expression
 {
+  friend class ChurchEncoding;
+  friend struct TreeOps;
+  friend class Focus;
 public:
   using Ptr = std::shared_ptr<FunctionCall>;
 
   FunctionCall(SourceRange range, Expression::Ptr fn, Expression::Ptr arg);
+  ~FunctionCall();
 
+  ExpressionKind kind() const override;
   Expression::Ptr clone() override;
-  void print(std::ostream& os) override;
 
+  const Expression::Ptr& fn_expr() const;
+  const Expression::Ptr& arg_expr() const;
   bool is_simple() const;
 private:
-  void fv(SymbolSet& cur) override;
-  void replace(Identifier::Ptr what, Expression::Ptr with) override;
-  Expression::Ptr reduce_step_normal() override;
-  Expression::Ptr reduce_step_callbyname() override;
-  Expression::Ptr reduce_step_callbyvalue() override;
+  Expression::Ptr contract(const std::shared_ptr<Lambda>& fn);
+
+  // walks at most `depth` applications down the function position, returns the slot of the head
+  // with the arguments in order, count is the number of arguments
+  Expression::Ptr* spine(std::size_t depth, std::array<Expression::Ptr*, Primitive::max_arity>& args, std::size_t& count);
+  // the primitive heading this application with its operands in order, count is the number of operands
+  Primitive* applied_primitive(std::array<Expression::Ptr*, Primitive::max_arity>& args, std::size_t& count);
+  // the argument is an operand the head primitive does not evaluate
+  bool is_lazy_operand();
+  // the δ-step of a saturated primitive application, or the operand to reduce before it applies
+  Expression::Ptr delta(Expression::Ptr*& operand);
+  // contracts a Church combinator applied to numerals, or names the operand to reduce first;
+  // if neither is possible the combinator is expanded in place
+  Expression::Ptr accelerate(EvaluationStrategy strat, Expression::Ptr*& operand);
+  void expand_church();
 private:
   Expression::Ptr fn;
   Expression::Ptr arg;
@@ -194,24 +341,332 @@ private:
 
 class Lambda : public Expression
 {
+  friend class ChurchEncoding;
+  friend struct TreeOps;
+  friend class Focus;
 public:
   using Ptr = std::shared_ptr<Lambda>;
 
   Lambda(SourceRange loc, Identifier::Ptr binding, Expression::Ptr body);
-  void print(std::ostream& os) override;
+  ~Lambda();
 
+  ExpressionKind kind() const override;
   Expression::Ptr clone() override;
   Expression::Ptr fn_body() const;
+  const Identifier::Ptr& fn_binding() const;
 
+  // substitutes `what` for the bound variable in the body, renaming binders that would capture;
+  // the body only becomes a pending Substitution, nothing is copied yet
   void replace(Expression::Ptr what);
+
+  // Applied to at least `arity` arguments, this λ and the ones directly nested in it certainly
+  // evaluate the parameters whose bits are set, the lowest bit standing for its own.
+  void mark_strict(std::uint32_t arity, std::uint64_t params);
+  std::uint32_t strict_arity() const;
+  std::uint64_t strict_params() const;
+private:
+  Identifier::Ptr binding;
+  Expression::Ptr body;
+  std::uint32_t strict_count = 0;
+  std::uint64_t strict_mask = 0;
+};
+
+// A constructor of algebraic data, `pack tag arity`. Applied to all of its fields it becomes a
+// single node holding them, which a case looks at without any further steps.
+class Constructor : public Expression
+{
+  friend struct TreeOps;
+  friend class Focus;
+  friend class Case;
+public:
+  using Ptr = std::shared_ptr<Constructor>;
+  // tags index the dispatch tables of case expressions, so they are kept small
+  static constexpr std::uint32_t max_tag = 0xffff;
+  static constexpr std::uint32_t max_arity = 0xffff;
+
+  Constructor(SourceRange loc, std::uint32_t tag, std::uint32_t arity, std::vector<Expression::Ptr> fields = {});
+  ~Constructor();
+
+  ExpressionKind kind() const override;
+  Expression::Ptr clone() override;
+
+  std::uint32_t tag() const;
+  std::uint32_t arity() const;
+  const std::vector<Expression::Ptr>& fields() const;
+  bool is_saturated() const;
+private:
+  std::uint32_t con_tag;
+  std::uint32_t con_arity;
+  std::vector<Expression::Ptr> con_fields;
+};
+
+struct Alternative
+{
+  std::uint32_t tag;
+  std::vector<Identifier::Ptr> binders;
+  Expression::Ptr body;
+};
+
+// case scrutinee of tag x y. body | ..., the binders of an alternative name the fields of a
+// constructor with its tag
+class Case : public Expression
+{
+  friend struct TreeOps;
+  friend class Focus;
+public:
+  using Ptr = std::shared_ptr<Case>;
+
+  Case(SourceRange loc, Expression::Ptr scrutinee, std::vector<Alternative> alts);
+  // copies of a case share its dispatch table
+  Case(SourceRange loc, Expression::Ptr scrutinee, std::vector<Alternative> alts,
+       std::shared_ptr<const std::vector<std::uint32_t>> dispatch);
+  ~Case();
+
+  ExpressionKind kind() const override;
+  Expression::Ptr clone() override;
+
+  const Expression::Ptr& case_scrutinee() const;
+  const std::vector<Alternative>& alternatives() const;
+  // the alternative for constructors with this tag, nullptr if there is none
+  const Alternative* select(std::uint32_t tag) const;
+private:
+  // the body of the alternative for the saturated constructor in the scrutinee with its fields
+  // substituted for the binders, nullptr if no alternative matches
+  Expression::Ptr contract();
+  void update_free_summary();
 private:
-  void fv(SymbolSet& cur) override;
-  void replace(Identifier::Ptr what, Expression::Ptr with) override;
-  Expression::Ptr reduce_step_normal() override;
-  Expression::Ptr reduce_step_callbyname() override;
-  Expression::Ptr reduce_step_callbyvalue() override;
+  Expression::Ptr scrutinee;
+  std::vector<Alternative> alts;
+  // one entry per tag up to the largest one handled, the index of its alternative plus one
+  std::shared_ptr<const std::vector<std::uint32_t>> dispatch;
+};
+
+// let name = bound in body, the name is only visible in body
+class Let : public Expression
+{
+  friend struct TreeOps;
+  friend class Focus;
+public:
+  using Ptr = std::shared_ptr<Let>;
+
+  Let(SourceRange loc, Identifier::Ptr binding, Expression::Ptr bound, Expression::Ptr body);
+  ~Let();
+
+  ExpressionKind kind() const override;
+  Expression::Ptr clone() override;
+  const Identifier::Ptr& let_binding() const;
+  const Expression::Ptr& let_bound() const;
+  const Expression::Ptr& let_body() const;
+private:
+  // the body with the name referring to a single Thunk of bound, evaluated tells that bound
+  // already is a value
+  Expression::Ptr contract(bool evaluated);
+  // renames the binding in body, pending like Lambda::replace
+  void rename(Identifier::Ptr binding);
 private:
   Identifier::Ptr binding;
+  Expression::Ptr bound;
+  Expression::Ptr body;
+};
+
+// letrec name = bound in body, where the name is visible in bound as well as in body
+class LetRec : public Expression
+{
+  friend struct TreeOps;
+  friend class Focus;
+public:
+  using Ptr = std::shared_ptr<LetRec>;
+
+  LetRec(SourceRange loc, Identifier::Ptr binding, Expression::Ptr bound, Expression::Ptr body);
+  ~LetRec();
+
+  ExpressionKind kind() const override;
+  Expression::Ptr clone() override;
+  const Identifier::Ptr& rec_binding() const;
+  const Expression::Ptr& rec_bound() const;
+  const Expression::Ptr& rec_body() const;
+private:
+  // the body with the name referring to a single Fixpoint of bound
+  Expression::Ptr contract();
+  // renames the binding in bound and body, pending like Lambda::replace
+  void rename(Identifier::Ptr binding);
+private:
+  Identifier::Ptr binding;
+  Expression::Ptr bound;
+  Expression::Ptr body;
+};
+
+// the term a Substitution puts in place of its variable, shared by all of its pending copies
+struct Replacement
+{
+  Symbol variable;
+  FreeBits variable_bit;
+  Expression::Ptr term;
+  // free variables of the term, computed on the first capture check the bits can't decide
+  std::optional<SymbolSet> free;
+  // the thunks made by pushing this substitution into references, one per original thunk
+  std::vector<std::pair<std::weak_ptr<Thunk>, std::weak_ptr<Thunk>>> thunks = {};
+};
+
+// An explicit substitution body[variable := value]. Reducers push it one level further down only
+// when they need to see what the body is, so branches that are dropped are never substituted into.
+// The value is never changed, it is copied where it replaces an occurrence.
+class Substitution : public Expression
+{
+  friend struct TreeOps;
+public:
+  using Ptr = std::shared_ptr<Substitution>;
+
+  Substitution(SourceRange loc, Expression::Ptr body, std::shared_ptr<Replacement> with);
+  ~Substitution();
+
+  ExpressionKind kind() const override;
+  Expression::Ptr clone() override;
+
+  const Expression::Ptr& sub_body() const;
+  Symbol variable() const;
+  const Expression::Ptr& value() const;
+
+  // performs all substitutions still pending in the tree
+  static void settle(Expression::Ptr& root);
+  static void settle(Statement& stmt);
+private:
   Expression::Ptr body;
+  std::shared_ptr<Replacement> with;
 };
 
+// The term bound by a letrec, in which its name is still a free variable. The term is shared by all
+// of its unfoldings and never changed, substitutions pushed into it copy the nodes they pass.
+struct Fixpoint
+{
+  Fixpoint(Symbol name, Expression::Ptr term);
+  ~Fixpoint();
+
+  Symbol name;
+  FreeBits name_bit;
+  Expression::Ptr term;
+  // free variables of the term except the name, computed on the first capture check
+  std::optional<SymbolSet> free;
+};
+
+// A reference to a Fixpoint, what the name of a contracted letrec is replaced with. Unfolding puts
+// the term in its place with the name pending to be replaced by the reference again, so a recursive
+// call costs the same whatever the size of the term.
+class Recursive : public Expression
+{
+  friend struct TreeOps;
+public:
+  using Ptr = std::shared_ptr<Recursive>;
+
+  Recursive(SourceRange loc, std::shared_ptr<Fixpoint> fix);
+
+  ExpressionKind kind() const override;
+  Expression::Ptr clone() override;
+
+  Symbol name() const;
+  const Expression::Ptr& term() const;
+  // the term is a λ, reducers leave the reference folded unless it is applied
+  bool is_function() const;
+  Expression::Ptr unfold() const;
+private:
+  std::shared_ptr<Fixpoint> fix;
+};
+
+// The term bound by a let, reduced in place by the first use that needs its value. Until then it
+// is only reachable through its references; once forced it is never changed again and every use
+// gets a copy of it, made node by node as substitutions are pushed into it.
+struct Thunk
+{
+  Thunk(Symbol name, Expression::Ptr term, bool forced);
+  ~Thunk();
+
+  Symbol name;
+  Expression::Ptr term;
+  // the term is in weak head normal form
+  bool forced;
+  // free variables of the term, computed on the first capture check
+  std::optional<SymbolSet> free;
+};
+
+// a use of a let-bound name, all uses of one binding refer to the same Thunk
+class Shared : public Expression
+{
+  friend struct TreeOps;
+  friend class Focus;
+public:
+  using Ptr = std::shared_ptr<Shared>;
+
+  Shared(SourceRange loc, std::shared_ptr<Thunk> thunk);
+
+  ExpressionKind kind() const override;
+  Expression::Ptr clone() override;
+
+  Symbol name() const;
+  const Expression::Ptr& term() const;
+  bool is_forced() const;
+  // the same for all references to one binding
+  const Thunk* binding() const;
+  // a copy of the forced term for this use
+  Expression::Ptr value() const;
+private:
+  std::shared_ptr<Thunk> thunk;
+};
+
+// Finds and performs redexes in the order of a strategy. The search state is kept across steps:
+// after a contraction it resumes a few levels above the contracted node instead of at the root,
+// since nothing further up can tell that the subterm changed.
+class Focus
+{
+public:
+  Focus(Expression::Ptr& root, EvaluationStrategy strat);
+  Focus(Statement& stmt, EvaluationStrategy strat);
+
+  // performs one contraction, false once no redex is left
+  bool step();
+private:
+  enum class Phase : std::uint_fast8_t
+  {
+    Enter,
+    // call-by-value: the argument is in normal form
+    Head,
+    // the operand of a Church combinator is stuck
+    ChurchOperand,
+    // the operand of a primitive is stuck
+    DeltaOperand,
+    // the term of a let-bound name is in weak head normal form
+    Force,
+    // lazy strategies: the arguments the function certainly evaluates are in weak head normal form
+    Strict
+  };
+
+  // an alternative still to try, depth is the number of its ancestors on the path; weak ones lie
+  // in a thunk being forced and are reduced to weak head normal form only
+  struct Item
+  {
+    Expression::Ptr* slot;
+    Phase phase;
+    std::size_t depth;
+    bool weak;
+  };
+  struct Frame
+  {
+    Expression::Ptr* slot;
+    // alternatives pending when the node was entered, they all lie outside of it
+    std::size_t pending;
+    bool weak;
+  };
+
+  void refocus();
+  // arguments are reduced before the function is applied to them
+  bool eager() const;
+  // λ bodies are reduced, weak items only ever reach weak head normal form
+  bool under_binders(bool weak) const;
+  // the arguments of stuck applications, fields and alternatives are reduced
+  bool into_arguments(bool weak) const;
+  // schedules the arguments of the spine its head λ is strict in, false if there are none to reduce
+  bool reduce_strict_arguments(FunctionCall& call, const Item& item, std::size_t below);
+private:
+  EvaluationStrategy strat;
+  std::vector<Item> work;
+  std::vector<Frame> path;
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <ast.hpp>
+
+#include <cstdint>
+#include <string>
+
+enum class ChurchForm
+{
+  Numeral,
+  True,
+  Succ,
+  Plus,
+  Mult,
+  Exp
+};
+
+// A Church-encoded value or combinator kept in native form while reducing.
+// Applied to numerals it is contracted in one step, otherwise it is expanded
+// back into the λ-term it stands for.
+class Church : public Expression
+{
+public:
+  using Ptr = std::shared_ptr<Church>;
+  static constexpr std::size_t max_arity = 2;
+
+  Church(SourceRange loc, ChurchForm form, std::uint64_t value = 0);
+
+  ExpressionKind kind() const override;
+  Expression::Ptr clone() override;
+
+  ChurchForm form() const;
+  std::uint64_t value() const;
+  std::string name() const;
+  // numerals consumed by the native operation, a numeral n applied to m yields m^n
+  std::size_t arity() const;
+
+  // nullptr unless all operands are numerals and the result fits into 64 bits
+  Expression::Ptr apply(SourceRange loc, const std::array<Expression::Ptr*, Primitive::max_arity>& args) const;
+  Expression::Ptr expand();
+private:
+  ChurchForm church_form;
+  std::uint64_t val;
+};
+
+// Recognizes Church numerals (λf. λx. f (f … x)), true (λt. λf. t) and the standard
+// succ, plus, mult and exp combinators up to renaming. False coincides with #0.
+class ChurchEncoding
+{
+public:
+  static void enable();
+  static bool enabled();
+
+  static void encode(Statement& stmt);
+  static void encode(Expression::Ptr& root);
+private:
+  static Church::Ptr match(const Expression::Ptr& expr);
+private:
+  static bool is_enabled;
+};
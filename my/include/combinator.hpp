@@ -0,0 +1,98 @@
+#pragma once
+
+#include <heap.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// A λ-abstraction lifted out of a term, together with the λs directly inside it. Its free
+// variables become leading parameters, so the body refers to nothing but its parameters, free
+// names and other combinators.
+struct Supercombinator
+{
+  // names of the parameters, the captured variables first; only needed for reading back
+  std::vector<Symbol> params;
+  std::size_t captured;
+  // The body in postorder. Var a: parameter, App: applies the two values before it, Comb a: another
+  // combinator, Free, Int and Prim as on the heap.
+  std::vector<Cell> body;
+};
+
+// the combinators of one term and the code building the term itself, in the same form as a body
+struct CombinatorProgram
+{
+  std::vector<Supercombinator> combinators;
+  std::vector<Cell> main;
+};
+
+// lifts every λ of the term into a combinator, false if it contains nodes without a cell kind
+bool lift(Heap& heap, const Expression& root, CombinatorProgram& out);
+
+// Reduces a lifted program by template instantiation: a saturated application of a combinator is
+// overwritten with a fresh copy of its body, so an argument used several times is reduced at most
+// once, and shows its value wherever it is shared, as on the heap. Bodies of λs are only reached
+// while reading back, where normal order applies the partial application to fresh variables and
+// reduces further.
+//
+// On the graph, Var a is such a fresh variable with a the number of binders around it.
+class GraphReducer
+{
+public:
+  // a budget of 0 means unbounded
+  GraphReducer(Heap& heap, const CombinatorProgram& program, EvaluationStrategy strat,
+               std::uint_fast64_t budget);
+  ~GraphReducer();
+
+  // reduces the program and builds the result on `out`, in the form `load` produces
+  CellRef run(Heap& out);
+
+  std::uint_fast64_t steps() const;
+  // the budget ran out before the result was reached
+  bool exhausted() const;
+private:
+  struct Frame
+  {
+    // position of the root of this evaluation on the stack
+    std::size_t base;
+    // leading arguments of the redex at the top that are evaluated already
+    std::size_t done;
+  };
+  struct Item
+  {
+    CellRef parent;
+    bool second;
+    std::uint32_t depth;
+    bool evaluate;
+  };
+
+  CellRef whnf(CellRef root);
+  bool apply_combinator(CellRef head);
+  bool apply_primitive(CellRef head);
+  // pushes a frame for the first argument up to `count` that may still be reducible
+  bool force_arguments(std::size_t count);
+  CellRef argument(std::size_t i) const;
+  bool may_step();
+  void update(CellRef redex, std::size_t arity, const std::vector<Cell>& body);
+  CellRef instantiate(const std::vector<Cell>& body);
+  CellRef resolve(CellRef ref) const;
+
+  void read_back_lambda(Heap& out, const Supercombinator& sc, std::size_t given, const Item& item);
+private:
+  Heap& heap;
+  const CombinatorProgram& program;
+  EvaluationStrategy strat;
+  std::uint_fast64_t budget;
+  std::uint_fast64_t count;
+  bool stopped;
+
+  // the spine of the term under evaluation, the cells of the current frame are above its base
+  std::vector<CellRef> stack;
+  std::vector<Frame> frames;
+  // cells still to be read back, one per item
+  std::vector<CellRef> pending;
+  std::vector<Item> items;
+
+  // scratch space of instantiate, never held across a collection
+  std::vector<CellRef> operands;
+  std::vector<CellRef> values;
+};
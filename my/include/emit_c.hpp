@@ -0,0 +1,12 @@
+#pragma once
+
+#include <ast.hpp>
+
+#include <ostream>
+#include <vector>
+
+// Writes a self-contained C program that reduces the given definitions in normal order and prints
+// them like --eval does. The λs are lifted into supercombinators, each compiled to a function
+// building its body on a garbage collected graph. Returns the first statement that can't be
+// compiled, nullptr if all of them were written.
+Statement::Ptr emit_c(const std::vector<Statement::Ptr>& stmts, std::ostream& os);
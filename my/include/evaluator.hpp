@@ -0,0 +1,50 @@
+#pragma once
+
+#include <ast.hpp>
+#include <heap.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+struct PrintOptions;
+
+enum class Engine
+{
+  // reduces the expression tree in place
+  Tree,
+  // copies the term onto a garbage collected Heap, falls back to Tree for terms it can't hold
+  Heap,
+  // lifts the λs of the term into supercombinators and reduces by instantiating them on a Heap,
+  // falls back to Tree like Heap does
+  Combinator
+};
+
+struct EvaluationStats
+{
+  std::uint_fast64_t steps = 0;
+  // the step budget ran out before a normal form was reached
+  bool exhausted = false;
+
+  HeapStats heap;
+};
+
+bool parse_strategy(const std::string& name, EvaluationStrategy& strat);
+std::string to_string(EvaluationStrategy strat);
+bool parse_engine(const std::string& name, Engine& engine);
+
+// reduces until no contraction applies under the given strategy, a budget of 0 means unbounded
+Statement::Ptr normalize(Statement::Ptr root, EvaluationStrategy strat, Engine engine, std::uint_fast64_t budget,
+                         EvaluationStats& stats);
+
+struct BatchResult
+{
+  std::string text;
+  EvaluationStats stats;
+};
+
+// normalizes and prints every statement on the pool, results are in the order of the input
+std::vector<BatchResult> evaluate_all(const std::vector<Statement::Ptr>& stmts, EvaluationStrategy strat,
+                                      Engine engine, std::uint_fast64_t budget, const PrintOptions& print_opts,
+                                      ThreadPool& pool);
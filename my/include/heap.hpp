@@ -0,0 +1,221 @@
+#pragma once
+
+#include <ast.hpp>
+
+#include <tsl/hopscotch_set.h>
+
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+// position of a cell on the heap, stays valid until the next collection
+using CellRef = std::uint32_t;
+
+enum class CellKind : std::uint8_t
+{
+  Var,
+  Free,
+  App,
+  Lam,
+  Int,
+  Prim,
+  // only used by the GraphReducer
+  Comb,
+  Ind,
+  // left behind by the collector
+  Moved
+};
+
+// Terms on the heap are nameless, bound variables are de Bruijn indices. The fields are
+//   Var  a: index                  Free a: name
+//   App  a: function, b: argument  Lam  a: body, b: name of the binder (only for printing)
+//   Int  a, b: low and high half   Prim a: PrimitiveOp
+//   Comb a: supercombinator        Ind  a: the cell an updated redex evaluated to
+//   Moved a: the new position
+// The heap stores each field in an array of its own, a Cell is just a copy of one row.
+struct Cell
+{
+  CellKind kind;
+  std::uint32_t a;
+  std::uint32_t b;
+  // index into the location table of the heap
+  std::uint32_t loc;
+};
+
+Cell int_cell(std::int64_t value, std::uint32_t loc);
+
+struct SourceRangeHasher
+{
+  std::size_t operator()(const SourceRange& loc) const;
+};
+struct SourceRangeComparer
+{
+  bool operator()(const SourceRange& lhs, const SourceRange& rhs) const;
+};
+
+struct HeapStats
+{
+  std::uint_fast64_t allocated = 0;
+  std::uint_fast64_t collections = 0;
+  // cells the collector found alive and copied
+  std::uint_fast64_t copied = 0;
+  // largest number of cells in use at once
+  std::size_t peak = 0;
+
+  HeapStats& operator+=(const HeapStats& other);
+};
+
+// thrown by Heap::alloc once every CellRef is taken, the cells allocated before stay valid
+struct HeapExhausted : std::length_error
+{
+  HeapExhausted()
+    : std::length_error("heap exhausted")
+  {  }
+};
+
+// Cells are bump allocated and reclaimed by a copying collector, there is no reference counting.
+// Collections only happen when `collect` is called, so cell references held in between stay valid.
+class Heap
+{
+public:
+  // kind, both fields and the location index
+  static constexpr std::size_t bytes_per_cell = sizeof(CellKind) + 3 * sizeof(std::uint32_t);
+
+  Heap();
+
+  CellRef alloc(const Cell& cell);
+  Cell get(CellRef ref) const;
+  void set(CellRef ref, const Cell& cell);
+
+  CellKind kind(CellRef ref) const
+  { return kinds[ref]; }
+  std::uint32_t first(CellRef ref) const
+  { return firsts[ref]; }
+  std::uint32_t second(CellRef ref) const
+  { return seconds[ref]; }
+  void set_first(CellRef ref, std::uint32_t value)
+  { firsts[ref] = value; }
+  void set_second(CellRef ref, std::uint32_t value)
+  { seconds[ref] = value; }
+  // the number held by an Int cell
+  std::int64_t value(CellRef ref) const;
+
+  std::uint32_t intern(Symbol name);
+  Symbol name(std::uint32_t index) const;
+
+  // source locations are kept in a side table, cells only refer to them
+  std::uint32_t add_location(const SourceRange& loc);
+  const SourceRange& location(std::uint32_t index) const;
+
+  // the collector keeps the cell alive and updates the reference when it moves
+  void add_root(CellRef* root);
+  void remove_root(CellRef* root);
+  // the same for every cell in the vector, which may change size in between collections
+  void add_roots(std::vector<CellRef>* roots);
+  void remove_roots(std::vector<CellRef>* roots);
+
+  // enough garbage may have accumulated to make a collection worthwhile
+  bool should_collect() const;
+  void collect();
+
+  HeapStats stats() const;
+private:
+  CellRef evacuate(CellRef ref);
+private:
+  std::vector<CellKind> kinds;
+  std::vector<std::uint32_t> firsts;
+  std::vector<std::uint32_t> seconds;
+  std::vector<std::uint32_t> locs;
+
+  // the to-space, kept around between collections
+  std::vector<CellKind> spare_kinds;
+  std::vector<std::uint32_t> spare_firsts;
+  std::vector<std::uint32_t> spare_seconds;
+  std::vector<std::uint32_t> spare_locs;
+
+  std::vector<CellRef*> roots;
+  std::vector<std::vector<CellRef>*> root_vectors;
+  std::size_t threshold;
+
+  std::vector<Symbol> names;
+  SymbolMap<std::uint32_t> name_index;
+  std::vector<SourceRange> locations;
+  tsl::hopscotch_map<SourceRange, std::uint32_t, SourceRangeHasher, SourceRangeComparer> location_index;
+  HeapStats heap_stats;
+};
+
+// The tree a heap term unfolds to, in prefix order. Binders are named after the source, primed
+// where they would capture a variable.
+struct NamedTerm
+{
+  struct Node
+  {
+    CellRef cell;
+    // index into binders for a λ and the variables it binds
+    std::size_t binder;
+  };
+
+  std::vector<Node> nodes;
+  std::vector<Symbol> binders;
+};
+
+// copies a tree onto the heap, false if it contains nodes without a cell kind (errors, Church forms)
+bool load(Heap& heap, const Expression& root, CellRef& out);
+NamedTerm name_binders(const Heap& heap, CellRef root);
+// the same, but the closed terms in `leaves` are not walked into, they are printed by the caller
+NamedTerm name_binders(const Heap& heap, CellRef root, const tsl::hopscotch_set<CellRef>& leaves);
+Expression::Ptr read_back(const Heap& heap, CellRef root);
+
+// the body of a λ with its variable replaced by the argument, the outer indices move down by one
+CellRef substitute(Heap& heap, CellRef body, CellRef arg);
+// the term moved under `by` more binders
+CellRef shift(Heap& heap, CellRef term, std::uint32_t by);
+bool is_closed(const Heap& heap, CellRef term);
+
+// Finds and contracts redexes on the heap in the same order as Focus does on trees. Redexes are
+// overwritten in place, so a subterm shared by several parents is reduced only once. Under
+// call-by-name this is call-by-need: an argument reduced where it is the head shows its value
+// everywhere else it occurs, where Focus leaves those copies unreduced. Both results are convertible.
+class HeapReducer
+{
+public:
+  HeapReducer(Heap& heap, const CellRef& root, EvaluationStrategy strat);
+
+  // performs one contraction, false once no redex is left
+  bool step();
+  // forgets the search state, needed after a collection moved the cells
+  void reset();
+private:
+  enum class Phase : std::uint_fast8_t
+  {
+    Enter,
+    // call-by-value: the argument is in normal form
+    Head,
+    // the operand of a primitive is stuck
+    DeltaOperand
+  };
+  struct Item
+  {
+    CellRef cell;
+    Phase phase;
+    std::size_t depth;
+  };
+  struct Frame
+  {
+    CellRef cell;
+    std::size_t pending;
+  };
+
+  CellRef spine(CellRef call, std::array<CellRef, Primitive::max_arity>& args, std::size_t& count) const;
+  bool is_lazy_operand(CellRef call) const;
+  bool delta(CellRef call, CellRef& operand);
+  void contract(CellRef call);
+  void refocus();
+private:
+  Heap& heap;
+  const CellRef& root;
+  EvaluationStrategy strat;
+  std::vector<Item> work;
+  std::vector<Frame> path;
+};
@@ -4,24 +4,79 @@
 #include <string>
 #include <vector>
 
-class Logger;
+enum class Severity
+{
+  Error,
+  Warning,
+  Info
+};
+
+enum class DiagnosticsFormat
+{
+  Text,
+  Json
+};
+
+struct Diagnostic
+{
+  std::string module;
+  std::uint_fast32_t column;
+  std::uint_fast32_t row;
+  Severity severity;
+  std::string message;
+
+  // order of emission, breaks ties between diagnostics at the same position
+  std::uint_fast64_t sequence;
+  Diagnostic* next;
+};
+
+struct DiagnosticsOptions
+{
+  DiagnosticsFormat format = DiagnosticsFormat::Text;
+  // errors reported per module before the rest is suppressed, 0 means unbounded
+  std::uint_fast32_t max_errors_per_module = 0;
+};
 
 class MessageCollector
 {
 public:
-  friend class Logger;
   friend const MessageCollector& operator<<(const MessageCollector& lg, const char* message);
   friend const MessageCollector& operator<<(const MessageCollector& lg, const std::string& message);
+  friend MessageCollector emit(Severity severity, const std::string& module, std::uint_fast32_t column, std::uint_fast32_t row);
+
+  MessageCollector(const MessageCollector&) = delete;
+  MessageCollector& operator=(const MessageCollector&) = delete;
   ~MessageCollector();
 private:
-  MessageCollector(Logger& log);
+  MessageCollector(Diagnostic* entry);
 
-  Logger& log;
-  mutable std::string message;
+  Diagnostic* entry;
 };
 
+MessageCollector emit(Severity severity, const std::string& module, std::uint_fast32_t column, std::uint_fast32_t row);
 MessageCollector emit_error(const std::string& module, std::uint_fast32_t column, std::uint_fast32_t row);
 MessageCollector emit_info(const std::string& module, std::uint_fast32_t column, std::uint_fast32_t row);
 MessageCollector emit_warn(const std::string& module, std::uint_fast32_t column, std::uint_fast32_t row);
 
+// while alive, diagnostics emitted by the constructing thread are kept here instead of reaching the sink
+class DiagnosticsCapture
+{
+public:
+  DiagnosticsCapture();
+  ~DiagnosticsCapture();
+
+  DiagnosticsCapture(const DiagnosticsCapture&) = delete;
+  DiagnosticsCapture& operator=(const DiagnosticsCapture&) = delete;
+
+  const std::vector<Diagnostic>& diagnostics() const;
+private:
+  friend class MessageCollector;
+
+  std::vector<Diagnostic> captured;
+  DiagnosticsCapture* outer;
+};
 
+bool parse_diagnostics_format(const std::string& name, DiagnosticsFormat& format);
+void configure_diagnostics(DiagnosticsOptions opts);
+// drains all pending diagnostics, sorted by module and position, in one write to stdout
+void flush_diagnostics();
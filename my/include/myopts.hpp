@@ -18,6 +18,7 @@ struct CmdOptions
 
     virtual Ptr clone() = 0;
     virtual void parse(int& i, int argc, const char** argv) = 0;
+    virtual void apply_default() = 0;
 
     template<typename T>
     T& get();
@@ -36,6 +37,7 @@ struct CmdOptions
     { return std::make_shared<TaggedValue<T>>(*this); }
 
     void parse(int& i, int argc, const char** argv) override;
+    void apply_default() override;
 
     T val;    
   };
@@ -126,8 +128,26 @@ void CmdOptions::TaggedValue<T>::parse(int& i, int argc, const char** argv)
   }
   else
   {
-    std::stringstream ss(argv[i++]);
-    ss >> val;
+    // skip the option itself, the value follows
+    if(++i < argc)
+    {
+      std::stringstream ss(argv[i++]);
+      ss >> val;
+    }
+  }
+}
+
+template<typename T>
+void CmdOptions::TaggedValue<T>::apply_default()
+{
+  // flags and lists interpret their default while parsing
+  if constexpr(!std::is_same<T, bool>::value && !std::is_same<T, std::vector<std::string>>::value)
+  {
+    if(!default_value.empty())
+    {
+      std::stringstream ss(default_value);
+      ss >> val;
+    }
   }
 }
 
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <ast.hpp>
+
+#include <cstdint>
+
+struct OptimizationReport
+{
+  // number of nodes of the term
+  std::size_t before = 0;
+  std::size_t after = 0;
+
+  std::uint_fast64_t beta = 0;
+  std::uint_fast64_t eta = 0;
+  std::uint_fast64_t delta = 0;
+};
+
+// Partially evaluates a term ahead of reduction, under binders as well:
+//   - (λx. b) a is contracted if a is a variable, name or literal, if x occurs at most once and not
+//     under another λ in b, or if a is a λ whose copies together stay within the inline budget
+//   - λx. f x becomes f if x is not free in f and f is a variable, name or partial application
+//     of one to such atoms
+//   - primitives applied to literals are computed
+// These are β-, η- and δ-steps, so normal forms are kept. Strategies stopping at λs may print
+// further reduced results. Terms the heap can't hold are returned unchanged.
+Expression::Ptr optimize(const Expression::Ptr& term, std::size_t inline_budget, OptimizationReport& report);
@@ -5,5 +5,18 @@
 
 class Tokenizer;
 
+// bodies of named top-level definitions, inlined wherever the name is used
+using DefinitionTable = SymbolMap<Expression::Ptr>;
+// names of the definitions each named definition refers to
+using DependencyTable = SymbolMap<SymbolSet>;
+
 std::vector<Statement::Ptr> parse(Tokenizer& tokenizer);
+// definitions of previously parsed modules stay visible and new ones are added to trees
+std::vector<Statement::Ptr> parse(Tokenizer& tokenizer, DefinitionTable& trees);
+// resident definitions are only read, so several threads may parse against the same table
+std::vector<Statement::Ptr> parse(Tokenizer& tokenizer, DefinitionTable& trees, const DefinitionTable& resident);
+// also records which definitions each new definition refers to
+std::vector<Statement::Ptr> parse(Tokenizer& tokenizer, DefinitionTable& trees, DependencyTable& deps);
 
+// the entry and every definition it refers to, directly or through others
+SymbolSet reachable(const DependencyTable& deps, Symbol entry);
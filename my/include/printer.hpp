@@ -0,0 +1,71 @@
+#pragma once
+
+#include <ast.hpp>
+#include <heap.hpp>
+
+#include <fmt/format.h>
+#include <tsl/hopscotch_map.h>
+#include <tsl/hopscotch_set.h>
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct PrintOptions
+{
+  // print subterms reachable over more than one path once, using `let` notation; only terms on
+  // the heap share subterms, the tree reducers copy every term they substitute
+  bool share = false;
+  // maximum number of bytes to emit, 0 means unbounded
+  std::size_t max_size = 0;
+};
+
+class Printer
+{
+public:
+  Printer(PrintOptions opts = {});
+
+  // the returned view stays valid until the next call
+  std::string_view print(const Expression& expr);
+  std::string_view print(const Statement& stmt);
+  // prints straight from the cells, without building a tree first
+  std::string_view print(const Heap& heap, CellRef root);
+
+  bool truncated() const;
+private:
+  struct Item
+  {
+    const Expression* node;
+    const char* text;
+  };
+
+  // the closed cells reachable over more than one path, nested ones first
+  std::vector<CellRef> collect_shared(const Heap& heap, CellRef root);
+  // binds the let-bound terms referenced in the term in front of it where that is sound
+  void collect_thunks(const Expression& root);
+  // the term of a referenced thunk with the substitutions pending in it carried out
+  const Expression* thunk_term(const Shared& ref);
+  // a copy of the text that stays valid until the next term is printed
+  const char* keep(std::string text);
+  void emit(const Expression& root);
+  void emit(const Heap& heap, CellRef root);
+  void drain();
+  void append(std::string_view text);
+  void append_node(const Expression* node);
+private:
+  PrintOptions opts;
+  fmt::memory_buffer buffer;
+  bool was_truncated;
+
+  std::vector<Item> work;
+  std::vector<const Expression*> shared;
+  tsl::hopscotch_map<const Expression*, std::string> shared_names;
+  // settled copies of the terms of printed fixpoints and thunks
+  std::vector<Expression::Ptr> unfolded;
+  tsl::hopscotch_map<const Thunk*, const Expression*> thunk_terms;
+  std::deque<std::string> texts;
+  tsl::hopscotch_map<CellRef, std::string> cell_names;
+  tsl::hopscotch_set<CellRef> named_cells;
+};
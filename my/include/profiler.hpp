@@ -0,0 +1,64 @@
+#pragma once
+
+#include <source_range.hpp>
+#include <symbol.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+
+struct Origin
+{
+  Origin(Symbol definition, SourceRange loc, const Origin* caller);
+
+  Symbol definition;
+  SourceRange loc;
+  // definition this subtree was inlined into, nullptr for a top-level definition
+  const Origin* caller;
+
+  mutable std::atomic<std::uint_fast64_t> beta_steps;
+  mutable std::atomic<std::uint_fast64_t> allocations;
+  mutable std::atomic<std::uint_fast64_t> nanoseconds;
+};
+
+class Profiler
+{
+public:
+  // charges one contraction and the time spent in it to the redex' origin
+  class Step
+  {
+  public:
+    Step(const Origin* origin);
+    ~Step();
+  private:
+    const Origin* origin;
+    const Origin* outer;
+    std::chrono::steady_clock::time_point start;
+  };
+
+  // charges the nodes allocated while in scope to an origin, without counting a step
+  class Charge
+  {
+  public:
+    Charge(const Origin* origin);
+    ~Charge();
+  private:
+    const Origin* outer;
+  };
+
+  static void enable();
+  static bool enabled();
+
+  static const Origin* root(Symbol definition, SourceRange loc);
+  static const Origin* nest(const Origin* origin, const Origin* caller);
+
+  static const Origin* active();
+  static void charge_allocation(const Origin* origin);
+
+  static void report(std::ostream& os);
+  static void write_folded(std::ostream& os);
+private:
+  static bool is_enabled;
+  thread_local static const Origin* active_origin;
+};
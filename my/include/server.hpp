@@ -0,0 +1,37 @@
+#pragma once
+
+#include <evaluator.hpp>
+#include <parser.hpp>
+#include <printer.hpp>
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+struct ServerOptions
+{
+  std::string socket_path;
+  // 0 workers picks one per hardware thread
+  std::size_t jobs = 0;
+  // clients beyond this wait until an open connection is closed
+  std::size_t max_connections = 64;
+
+  // used for requests that don't carry their own
+  EvaluationStrategy strategy = EvaluationStrategy::CallByValue;
+  Engine engine = Engine::Tree;
+  std::uint_fast64_t budget = 0;
+
+  PrintOptions print_opts;
+};
+
+// Serves newline-delimited JSON requests of the form
+//   {"id": 1, "term": "succ zero", "strategy": "cbv", "budget": 1000}
+// on a Unix domain socket, answering each with
+//   {"id": 1, "result": "...", "steps": 3, "exhausted": false, "time_us": 12}
+// or {"id": 1, "error": "...", "diagnostics": [{"row": 1, "column": 3, "message": "..."}]}.
+// The id must be a number or a string. A term is a single expression, parsed against
+// the resident definitions, which stay loaded for the lifetime of the server.
+int run_server(DefinitionTable resident, const ServerOptions& opts);
+
+// sends every line of `in` as a request and writes the response before sending the next one
+int run_client(const std::string& socket_path, std::istream& in, std::ostream& out);
@@ -1,27 +1,86 @@
 #pragma once
 
+#include <tsl/hopscotch_map.h>
+
 #include <cstdint>
+#include <deque>
 #include <ostream>
+#include <shared_mutex>
+#include <string>
+#include <vector>
 
-struct SourceRange
+struct SourcePosition
 {
-  const char* module;
+  // both count from 1
+  std::uint32_t column;
+  std::uint32_t row;
+};
 
-  std::size_t column_beg;
-  std::size_t row_beg;
+// Byte offsets into a module, rows and columns are only looked up when a location is printed.
+struct SourceRange
+{
+  std::uint32_t module;
 
-  std::size_t column_end;
-  std::size_t row_end;
+  std::uint32_t begin;
+  std::uint32_t end;
 
   SourceRange() = default;
 
-  SourceRange(const char* module, std::size_t column_beg, std::size_t row_beg,
-                                  std::size_t column_end, std::size_t row_end);
+  SourceRange(std::uint32_t module, std::uint32_t begin, std::uint32_t end);
 
   void widen(const SourceRange& range);
 
+  std::string module_name() const;
+  SourcePosition position() const;
+
   friend std::ostream& operator<<(std::ostream& os, const SourceRange& src_range);
 };
 
 SourceRange operator+(const SourceRange& left, const SourceRange& right);
 
+// Names and line starts of all modules read so far, shared by all threads. Module 0 is unnamed
+// and used for locations that do not point into any source.
+class SourceModules
+{
+public:
+  // Files read under the same name share an id and a line table, lines are only recorded past
+  // the last known line start.
+  static std::uint32_t add(const std::string& name);
+  // a module of its own for one short stream, under a name other streams may share as well
+  static std::uint32_t add_stream(const std::string& name);
+  // hands the id of a stream module out again, nothing may refer to its locations anymore
+  static void release(std::uint32_t module);
+  static void add_line(std::uint32_t module, std::uint32_t offset);
+
+  // a copy, the module may be released and its id handed out again while the caller holds it
+  static std::string name(std::uint32_t module);
+  static SourcePosition resolve(std::uint32_t module, std::uint32_t offset);
+private:
+  struct Module
+  {
+    std::string name;
+    // offsets of the first byte of each line, ascending
+    std::vector<std::uint32_t> line_starts;
+  };
+
+  // entries are never moved once added
+  static std::shared_mutex modules_mutex;
+  static std::deque<Module> modules;
+  static tsl::hopscotch_map<std::string, std::uint32_t> module_index;
+  static std::vector<std::uint32_t> released;
+};
+
+// The stream module of one request, released when the request is done.
+class StreamModule
+{
+public:
+  StreamModule(const std::string& name);
+  ~StreamModule();
+
+  StreamModule(const StreamModule&) = delete;
+  StreamModule& operator=(const StreamModule&) = delete;
+
+  std::uint32_t id() const;
+private:
+  std::uint32_t module;
+};
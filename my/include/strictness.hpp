@@ -0,0 +1,29 @@
+#pragma once
+
+#include <ast.hpp>
+
+#include <cstdint>
+
+// the parameters a function value certainly evaluates once it is applied to `arity` arguments
+struct Strictness
+{
+  std::uint32_t arity = 0;
+  // bit i stands for the i-th parameter, only the first 64 are tracked
+  std::uint64_t params = 0;
+  // the λ binding the parameters, nullptr if the value isn't written as one
+  const Lambda* fn = nullptr;
+};
+
+// Abstract interpretation of a term to the set of variables certainly reduced to weak head
+// normal form when the term is:
+//   - a λ is strict in the parameters its body evaluates, once it has all of its arguments
+//   - names bound to a λ by let or letrec carry its strictness to their calls, recursive ones are
+//     iterated to a fixpoint starting from strict in every parameter
+//   - a primitive evaluates its strict operands, ifz the condition and what both branches share
+//   - a case evaluates the scrutinee and what all of its alternatives share
+// Every λ of the term is marked with the result, call-by-name and normal order then reduce these
+// arguments before the call. The call would need them anyway, so no term diverges that didn't.
+// Returns the strictness of the term itself.
+Strictness analyze_strictness(const Expression::Ptr& term);
+// whether any term has been analyzed yet, reducers skip looking for strict arguments until then
+bool strictness_marked();
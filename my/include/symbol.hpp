@@ -4,7 +4,11 @@
 #include <tsl/hopscotch_set.h>
 
 #include <cstdint>
+#include <deque>
 #include <iosfwd>
+#include <shared_mutex>
+#include <string>
+#include <vector>
 
 struct Symbol
 {
@@ -23,10 +27,21 @@ struct Symbol
 
   const std::string& get_string() const;
   std::uint_fast32_t get_hash() const;
+  // number of symbols interned before this one
+  std::uint32_t ordinal() const;
 private:
-  static std::string& lookup_or_emplace(std::uint_fast32_t hash, const char* str);
+  struct Entry
+  {
+    const std::string* text = nullptr;
+    std::uint32_t ordinal = 0;
+  };
+
+  static const std::string& lookup_or_emplace(std::uint_fast32_t hash, const char* str);
 private:
-  thread_local static tsl::hopscotch_map<std::uint_fast32_t, std::string> symbols;
+  // shared by all threads, strings are never moved once interned
+  static std::shared_mutex symbols_mutex;
+  static std::deque<std::string> symbol_storage;
+  static tsl::hopscotch_map<std::uint_fast32_t, Entry> symbols;
 
   std::uint_fast32_t hash;
 };
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+  // 0 workers picks one per hardware thread
+  ThreadPool(std::size_t workers = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  void submit(std::function<void()> task);
+  // blocks until every submitted task has finished
+  void wait();
+
+  std::size_t size() const;
+private:
+  void work();
+private:
+  std::vector<std::thread> workers;
+  std::deque<std::function<void()>> tasks;
+
+  std::mutex mutex;
+  std::condition_variable has_task;
+  std::condition_variable is_idle;
+  std::size_t running;
+  bool stopping;
+};
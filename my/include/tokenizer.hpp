@@ -1,14 +1,15 @@
 #pragma once
 
-#include <tsl/hopscotch_map.h>
-
 #include <source_range.hpp>
+#include <symbol.hpp>
 #include <util.hpp>
 
 #include <cstdint>
 #include <istream>
 #include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
 
 enum class TokenKind : std::int_fast16_t
 {
@@ -16,6 +17,7 @@ enum class TokenKind : std::int_fast16_t
 #define TOK_CONTROL(x, v) x = v,
 #define TOK_EXPR_OP(x, v) x = v,
 #define TOK_COMPOUND(x, v) x = hash_string<const char*, std::int_fast16_t>(v),
+#define TOK_KEYWORD(x, v) x = hash_string<const char*, std::int_fast16_t>(v),
 
 #include "tokens.def"
 };
@@ -26,9 +28,9 @@ struct Token
 {
   Token() = default;
   Token(SourceRange range, TokenKind kind)
-    : range(range), kind(kind)
+    : range(range), kind(kind), data(nullptr)
   {  }
-  Token(SourceRange range, TokenKind kind, void* data)
+  Token(SourceRange range, TokenKind kind, const char* data)
     : range(range), kind(kind), data(data)
   {  }
 
@@ -36,7 +38,7 @@ struct Token
   { return kind; }
 
   const char* data_as_text() const
-  { return reinterpret_cast<const char*>(data); }
+  { return data; }
 
   const SourceRange& loc() const
   { return range; }
@@ -47,29 +49,82 @@ struct Token
 private:
   SourceRange range;
   TokenKind kind;
-  void* data;
+  const char* data;
+
+};
 
+// The tokens of a stream read so far, one array per field. Identifiers are numbered in order of
+// first appearance, the digits of numbers are kept in `literals`.
+struct TokenBuffer
+{
+  std::uint32_t module;
+
+  std::vector<TokenKind> kinds;
+  // name id of an identifier, offset into literals for a number
+  std::vector<std::uint32_t> symbols;
+  std::vector<std::uint32_t> begins;
+  std::vector<std::uint32_t> ends;
+
+  std::vector<Symbol> names;
+  SymbolMap<std::uint32_t> name_ids;
+  std::string literals;
+
+  std::size_t size() const
+  { return kinds.size(); }
+
+  SourceRange loc(std::size_t index) const
+  { return SourceRange(module, begins[index], ends[index]); }
+  // only valid until more tokens are read
+  const char* text(std::size_t index) const;
+  Token token(std::size_t index) const;
+
+  void push(TokenKind kind, std::uint32_t symbol, std::uint32_t begin, std::uint32_t end);
+  std::uint32_t add_name(const std::string& name);
+  std::uint32_t add_literal(std::string_view digits);
+  void clear();
 };
 
 class Tokenizer
 {
 public:
+  // tokens read at once when the buffer runs dry
+  static constexpr std::size_t batch_size = 256;
+
   Tokenizer(const char* module, std::istream& handle);
+  // reads into a module registered by the caller
+  Tokenizer(std::uint32_t module, std::istream& handle);
+
+  // reads up to `count` more tokens, nothing after the end of the stream
+  void fill(std::size_t count);
+  const TokenBuffer& tokens() const;
 
+  // the token at the read position, which then moves on unless it is the end of the stream
   Token get();
+  std::size_t position() const;
+  void seek(std::size_t index);
   void reset();
 
-  const std::string& module_name() const;
+  std::string module_name() const;
 private:
-  char read(); 
-  bool accept(std::string substr);
+  void lex();
+  // the next byte that is not white space, EOF at the end of the stream
+  int read();
+  bool next_line();
+
+  unsigned char byte_at(std::size_t pos) const;
+  // length of the compound token starting at `pos`, 0 if there is none
+  std::size_t compound_at(std::size_t pos) const;
+  bool continues_identifier(std::size_t pos) const;
 private:
-  const std::string module;
+  const std::uint32_t module;
   std::istream& handle;
   std::string linebuf;
-  std::size_t row;
+  // offsets of the current line and the one after it
+  std::uint32_t line_offset;
+  std::uint32_t next_line_offset;
   std::size_t col; 
 
-  tsl::hopscotch_map<std::uint_fast32_t, std::vector<std::uint_fast8_t>> token_data_table;
+  TokenBuffer buffer;
+  std::size_t cursor;
 };
 
@@ -3,12 +3,18 @@
 #include "tokenizer.hpp"
 #include "parser.hpp"
 #include "ast.hpp"
+#include "log.hpp"
 
 #include <algorithm>
 #include <iostream>
 #include <sstream>
 #include <cctype>
 
+REPL::REPL(DefinitionTable trees, EvaluationStrategy strat, Engine engine, std::uint_fast64_t budget,
+           PrintOptions print_opts)
+  : trees(std::move(trees)), strat(strat), command_strat(strat), engine(engine), budget(budget), printer(print_opts)
+{  }
+
 void REPL::loop()
 {
   Statement::Ptr root;
@@ -26,25 +32,12 @@ void REPL::loop()
     }
     else
     {
-      // apply evaluation strategy
-      // TODO: lookup strategy in global config [<- can be served via cmd arg]
-      ///// for now just cbv
-
-      std::string last_ast, new_ast;
-      do
-      {
-        root = root->eval(EvaluationStrategy::CallByValue);
-
-        std::stringstream aststream;
-        root->print(aststream);
+      EvaluationStats stats;
+      root = normalize(root, command_strat, engine, budget, stats);
 
-        new_ast = aststream.str();
-        last_ast = new_ast;
-      } while(last_ast != new_ast);
-      
-      // print
-      root->print(std::cout);
-      std::cout << "\n";
+      std::cout << printer.print(*root) << "\n";
+      if(stats.exhausted)
+        std::cout << "(stopped after " << stats.steps << " steps)\n";
 
       root = nullptr;
     }
@@ -68,9 +61,33 @@ redo:
   else if(input.empty())
     goto redo;
 
+  // ":whnf term" reduces one term under another strategy, ":whnf" alone switches to it
+  command_strat = strat;
+  if(input.front() == ':')
+  {
+    const std::size_t end = std::min(input.find(' '), input.size());
+    EvaluationStrategy chosen;
+    if(!parse_strategy(input.substr(1, end - 1), chosen))
+    {
+      std::cout << "Unknown evaluation strategy \"" << input.substr(1, end - 1) << "\".\n > ";
+      goto redo;
+    }
+    input.erase(0, end);
+    if(input.find_first_not_of(' ') == std::string::npos)
+    {
+      strat = command_strat = chosen;
+      std::cout << " > ";
+      goto redo;
+    }
+    command_strat = chosen;
+  }
+
   std::stringstream ss(input);
-  Tokenizer tokenizer("REPL", ss);
+  // definitions made here outlive the input, so its module is never released
+  Tokenizer tokenizer(SourceModules::add_stream("REPL"), ss);
 
-  return parse(tokenizer);
+  auto stmts = parse(tokenizer, trees);
+  flush_diagnostics();
+  return stmts;
 }
 
@@ -1,7 +1,896 @@
 #include <ast.hpp>
+#include <church.hpp>
+#include <profiler.hpp>
+#include <printer.hpp>
+#include <strictness.hpp>
+#include <algorithm>
+#include <optional>
 #include <set>
+#include <vector>
 
-std::uint_fast64_t GIDTag::gid_counter = 0;
+std::atomic<std::uint_fast64_t> GIDTag::gid_counter = 0;
+
+// number of contractions performed by this thread, lets callers detect a normal form
+thread_local static std::uint_fast64_t contractions = 0;
+
+std::uint_fast64_t contraction_count()
+{ return contractions; }
+
+// Iterative implementations of everything that walks an expression tree.
+struct TreeOps
+{
+  static Expression::Ptr clone(const Expression& root)
+  {
+    Expression::Ptr result;
+    std::vector<std::pair<const Expression*, Expression::Ptr*>> work { { &root, &result } };
+    while(!work.empty())
+    {
+      auto [node, slot] = work.back();
+      work.pop_back();
+
+      switch(node->kind())
+      {
+      default:
+        *slot = const_cast<Expression*>(node)->clone();
+        break;
+
+      case ExpressionKind::FunctionCall:
+        {
+          auto call = static_cast<const FunctionCall*>(node);
+          auto copy = node->keep_origin(std::make_shared<FunctionCall>(node->source_range(), nullptr, nullptr));
+          copy->free_summary = node->free_summary;
+          *slot = copy;
+          work.push_back({ call->arg.get(), &copy->arg });
+          work.push_back({ call->fn.get(), &copy->fn });
+        } break;
+
+      case ExpressionKind::Lambda:
+        {
+          auto fn = static_cast<const Lambda*>(node);
+          auto binding = std::static_pointer_cast<Identifier>(fn->binding->clone());
+          auto copy = node->keep_origin(std::make_shared<Lambda>(node->source_range(), binding, nullptr));
+          copy->free_summary = node->free_summary;
+          copy->mark_strict(fn->strict_count, fn->strict_mask);
+          *slot = copy;
+          work.push_back({ fn->body.get(), &copy->body });
+        } break;
+
+      case ExpressionKind::LetRec:
+        {
+          auto rec = static_cast<const LetRec*>(node);
+          auto binding = std::static_pointer_cast<Identifier>(rec->binding->clone());
+          auto copy = node->keep_origin(std::make_shared<LetRec>(node->source_range(), binding, nullptr, nullptr));
+          copy->free_summary = node->free_summary;
+          *slot = copy;
+          work.push_back({ rec->body.get(), &copy->body });
+          work.push_back({ rec->bound.get(), &copy->bound });
+        } break;
+
+      case ExpressionKind::Let:
+        {
+          auto let = static_cast<const Let*>(node);
+          auto binding = std::static_pointer_cast<Identifier>(let->binding->clone());
+          auto copy = node->keep_origin(std::make_shared<Let>(node->source_range(), binding, nullptr, nullptr));
+          copy->free_summary = node->free_summary;
+          *slot = copy;
+          work.push_back({ let->body.get(), &copy->body });
+          work.push_back({ let->bound.get(), &copy->bound });
+        } break;
+
+      case ExpressionKind::Constructor:
+        {
+          auto con = static_cast<const Constructor*>(node);
+          auto copy = node->keep_origin(std::make_shared<Constructor>(node->source_range(), con->con_tag, con->con_arity,
+                                                                      std::vector<Expression::Ptr>(con->con_fields.size())));
+          copy->free_summary = node->free_summary;
+          *slot = copy;
+          for(std::size_t i = con->con_fields.size(); i-- > 0; )
+            work.push_back({ con->con_fields[i].get(), &copy->con_fields[i] });
+        } break;
+
+      case ExpressionKind::Case:
+        {
+          auto match = static_cast<const Case*>(node);
+          std::vector<Alternative> alts;
+          alts.reserve(match->alts.size());
+          for(auto& alt : match->alts)
+            alts.push_back({ alt.tag, alt.binders, nullptr });
+          auto copy = node->keep_origin(std::make_shared<Case>(node->source_range(), nullptr, std::move(alts),
+                                                               match->dispatch));
+          copy->free_summary = node->free_summary;
+          *slot = copy;
+          for(std::size_t i = match->alts.size(); i-- > 0; )
+            work.push_back({ match->alts[i].body.get(), &copy->alts[i].body });
+          work.push_back({ match->scrutinee.get(), &copy->scrutinee });
+        } break;
+
+      case ExpressionKind::Substitution:
+        {
+          // the value is never changed, so the copy can share it
+          auto sub = static_cast<const Substitution*>(node);
+          auto copy = node->keep_origin(std::make_shared<Substitution>(node->source_range(), nullptr, sub->with));
+          copy->free_summary = node->free_summary;
+          *slot = copy;
+          work.push_back({ sub->body.get(), &copy->body });
+        } break;
+      }
+    }
+    return result;
+  }
+
+  // binders are entered with their node, except those of lets and case alternatives, which are
+  // bound and unbound through their identifiers
+  enum class Visit : std::uint8_t
+  {
+    Enter,
+    Leave,
+    Bind,
+    Unbind
+  };
+
+  static void free_variables(const Expression& root, SymbolSet& out)
+  {
+    // how often each symbol is bound on the path to the current node
+    SymbolMap<std::uint_fast32_t> bound;
+    std::vector<std::pair<const Expression*, Visit>> work { { &root, Visit::Enter } };
+    while(!work.empty())
+    {
+      auto [node, visit] = work.back();
+      work.pop_back();
+      if(node->is_closed())
+        continue;
+
+      switch(node->kind())
+      {
+      default: break;
+
+      case ExpressionKind::Identifier:
+        {
+          const Symbol sym = static_cast<const Identifier*>(node)->id();
+          if(visit == Visit::Bind)
+            bound[sym]++;
+          else if(visit == Visit::Unbind)
+            bound[sym]--;
+          else if(auto it = bound.find(sym); it == bound.end() || it->second == 0)
+            out.insert(sym);
+        } break;
+
+      case ExpressionKind::FunctionCall:
+        work.push_back({ static_cast<const FunctionCall*>(node)->arg.get(), Visit::Enter });
+        work.push_back({ static_cast<const FunctionCall*>(node)->fn.get(), Visit::Enter });
+        break;
+
+      case ExpressionKind::Lambda:
+        {
+          auto fn = static_cast<const Lambda*>(node);
+          if(visit == Visit::Leave)
+          {
+            bound[fn->binding->id()]--;
+            break;
+          }
+          bound[fn->binding->id()]++;
+          work.push_back({ node, Visit::Leave });
+          work.push_back({ fn->body.get(), Visit::Enter });
+        } break;
+
+      case ExpressionKind::LetRec:
+        {
+          auto rec = static_cast<const LetRec*>(node);
+          if(visit == Visit::Leave)
+          {
+            bound[rec->binding->id()]--;
+            break;
+          }
+          bound[rec->binding->id()]++;
+          work.push_back({ node, Visit::Leave });
+          work.push_back({ rec->body.get(), Visit::Enter });
+          work.push_back({ rec->bound.get(), Visit::Enter });
+        } break;
+
+      case ExpressionKind::Let:
+        {
+          auto let = static_cast<const Let*>(node);
+          work.push_back({ let->binding.get(), Visit::Unbind });
+          work.push_back({ let->body.get(), Visit::Enter });
+          work.push_back({ let->binding.get(), Visit::Bind });
+          work.push_back({ let->bound.get(), Visit::Enter });
+        } break;
+
+      case ExpressionKind::Constructor:
+        for(auto& field : static_cast<const Constructor*>(node)->con_fields)
+          work.push_back({ field.get(), Visit::Enter });
+        break;
+
+      case ExpressionKind::Case:
+        {
+          auto match = static_cast<const Case*>(node);
+          for(auto& alt : match->alts)
+          {
+            for(auto& binder : alt.binders)
+              work.push_back({ binder.get(), Visit::Unbind });
+            work.push_back({ alt.body.get(), Visit::Enter });
+            for(auto& binder : alt.binders)
+              work.push_back({ binder.get(), Visit::Bind });
+          }
+          work.push_back({ match->scrutinee.get(), Visit::Enter });
+        } break;
+
+      case ExpressionKind::Recursive:
+        for(auto& sym : free_variables(*static_cast<const Recursive*>(node)->fix))
+          if(auto it = bound.find(sym); it == bound.end() || it->second == 0)
+            out.insert(sym);
+        break;
+
+      case ExpressionKind::Shared:
+        for(auto& sym : free_variables(*static_cast<const Shared*>(node)->thunk))
+          if(auto it = bound.find(sym); it == bound.end() || it->second == 0)
+            out.insert(sym);
+        break;
+
+      case ExpressionKind::Substitution:
+        {
+          SymbolSet inner;
+          pending_free_variables(*static_cast<const Substitution*>(node), inner);
+          for(auto& sym : inner)
+            if(auto it = bound.find(sym); it == bound.end() || it->second == 0)
+              out.insert(sym);
+        } break;
+      }
+    }
+  }
+
+  // Free variables of a term with pending substitutions, bottom up: the variable of a substitution
+  // is only replaced by the free variables of its value if it occurs in the body.
+  static void pending_free_variables(const Substitution& root, SymbolSet& out)
+  {
+    std::vector<SymbolSet> results;
+    std::vector<std::pair<const Expression*, bool>> work { { &root, false } };
+    while(!work.empty())
+    {
+      auto [node, leaving] = work.back();
+      work.pop_back();
+
+      if(node->is_closed())
+      {
+        results.emplace_back();
+        continue;
+      }
+
+      switch(node->kind())
+      {
+      default:
+        results.emplace_back();
+        break;
+
+      case ExpressionKind::Identifier:
+        results.emplace_back();
+        results.back().insert(static_cast<const Identifier*>(node)->id());
+        break;
+
+      case ExpressionKind::FunctionCall:
+        if(leaving)
+        {
+          SymbolSet arg = std::move(results.back());
+          results.pop_back();
+          results.back().insert(arg.begin(), arg.end());
+          break;
+        }
+        work.push_back({ node, true });
+        work.push_back({ static_cast<const FunctionCall*>(node)->arg.get(), false });
+        work.push_back({ static_cast<const FunctionCall*>(node)->fn.get(), false });
+        break;
+
+      case ExpressionKind::Lambda:
+        if(leaving)
+        {
+          results.back().erase(static_cast<const Lambda*>(node)->binding->id());
+          break;
+        }
+        work.push_back({ node, true });
+        work.push_back({ static_cast<const Lambda*>(node)->body.get(), false });
+        break;
+
+      case ExpressionKind::LetRec:
+        if(leaving)
+        {
+          SymbolSet body = std::move(results.back());
+          results.pop_back();
+          results.back().insert(body.begin(), body.end());
+          results.back().erase(static_cast<const LetRec*>(node)->binding->id());
+          break;
+        }
+        work.push_back({ node, true });
+        work.push_back({ static_cast<const LetRec*>(node)->body.get(), false });
+        work.push_back({ static_cast<const LetRec*>(node)->bound.get(), false });
+        break;
+
+      case ExpressionKind::Let:
+        if(leaving)
+        {
+          SymbolSet body = std::move(results.back());
+          results.pop_back();
+          body.erase(static_cast<const Let*>(node)->binding->id());
+          results.back().insert(body.begin(), body.end());
+          break;
+        }
+        work.push_back({ node, true });
+        work.push_back({ static_cast<const Let*>(node)->body.get(), false });
+        work.push_back({ static_cast<const Let*>(node)->bound.get(), false });
+        break;
+
+      case ExpressionKind::Constructor:
+        {
+          auto& fields = static_cast<const Constructor*>(node)->con_fields;
+          if(leaving)
+          {
+            for(std::size_t i = 1; i < fields.size(); ++i)
+            {
+              SymbolSet field = std::move(results.back());
+              results.pop_back();
+              results.back().insert(field.begin(), field.end());
+            }
+            break;
+          }
+          if(fields.empty())
+          {
+            results.emplace_back();
+            break;
+          }
+          work.push_back({ node, true });
+          for(std::size_t i = fields.size(); i-- > 0; )
+            work.push_back({ fields[i].get(), false });
+        } break;
+
+      case ExpressionKind::Case:
+        {
+          auto match = static_cast<const Case*>(node);
+          if(leaving)
+          {
+            SymbolSet bodies;
+            for(std::size_t i = match->alts.size(); i-- > 0; )
+            {
+              SymbolSet body = std::move(results.back());
+              results.pop_back();
+              for(auto& binder : match->alts[i].binders)
+                body.erase(binder->id());
+              bodies.insert(body.begin(), body.end());
+            }
+            results.back().insert(bodies.begin(), bodies.end());
+            break;
+          }
+          work.push_back({ node, true });
+          for(std::size_t i = match->alts.size(); i-- > 0; )
+            work.push_back({ match->alts[i].body.get(), false });
+          work.push_back({ match->scrutinee.get(), false });
+        } break;
+
+      case ExpressionKind::Recursive:
+        results.push_back(free_variables(*static_cast<const Recursive*>(node)->fix));
+        break;
+
+      case ExpressionKind::Shared:
+        results.push_back(free_variables(*static_cast<const Shared*>(node)->thunk));
+        break;
+
+      case ExpressionKind::Substitution:
+        {
+          auto sub = static_cast<const Substitution*>(node);
+          if(!leaving)
+          {
+            work.push_back({ node, true });
+            work.push_back({ sub->body.get(), false });
+            break;
+          }
+          if(results.back().erase(sub->with->variable))
+          {
+            const SymbolSet& value = free_variables(*sub->with);
+            results.back().insert(value.begin(), value.end());
+          }
+        } break;
+      }
+    }
+    out.insert(results.back().begin(), results.back().end());
+  }
+
+  static const SymbolSet& free_variables(Replacement& with)
+  {
+    if(!with.free)
+    {
+      with.free.emplace();
+      with.term->free_variables(*with.free);
+    }
+    return *with.free;
+  }
+
+  static const SymbolSet& free_variables(Fixpoint& fix)
+  {
+    if(!fix.free)
+    {
+      fix.free.emplace();
+      fix.term->free_variables(*fix.free);
+      fix.free->erase(fix.name);
+    }
+    return *fix.free;
+  }
+
+  static const SymbolSet& free_variables(Thunk& thunk)
+  {
+    if(!thunk.free)
+    {
+      thunk.free.emplace();
+      thunk.term->free_variables(*thunk.free);
+    }
+    return *thunk.free;
+  }
+
+  // a binding for the same name that occurs neither in the value of the substitution nor free in
+  // the terms it scopes over, nullptr if the binding can stay as it is
+  static Identifier::Ptr avoid_capture(const Identifier& binding, Replacement& with,
+                                       std::initializer_list<const Expression*> scopes, const SymbolSet* also = nullptr)
+  {
+    // the summary rules out most captures without computing the free variables of `with`
+    const bool may_capture = with.term->free_summary & binding.free_summary;
+    if(!may_capture || !free_variables(with).count(binding.id()))
+      return nullptr;
+
+    const SymbolSet& fv_with = free_variables(with);
+    SymbolSet in_scope;
+    for(auto scope : scopes)
+      free_variables(*scope, in_scope);
+    // our binding occurs as free variable in `with`, so we change it!
+    std::string name = binding.id().get_string() + "'";
+    for(Symbol fresh(name.c_str()); ; fresh = Symbol(name.c_str()))
+    {
+      if(!fv_with.count(fresh) && !in_scope.count(fresh) && !(also && also->count(fresh)))
+        return std::make_shared<Identifier>(binding.source_range(), fresh);
+      name += "'";
+    }
+  }
+
+  static bool is_atom(const Expression& node)
+  {
+    switch(node.kind())
+    {
+    default: return false;
+
+    case ExpressionKind::Error:
+    case ExpressionKind::Identifier:
+    case ExpressionKind::Integer:
+    case ExpressionKind::Primitive:
+    case ExpressionKind::Church:
+    case ExpressionKind::Recursive:
+    case ExpressionKind::Shared: return true;
+    }
+  }
+
+  // the child with the substitution pending, or already carried out where that is just as cheap
+  static Expression::Ptr wrap(Expression::Ptr child, const std::shared_ptr<Replacement>& with)
+  {
+    if(child->kind() == ExpressionKind::Identifier)
+    {
+      if(static_cast<const Identifier*>(child.get())->id() != with->variable)
+        return child;
+      if(is_atom(*with->term))
+        return with->term->clone();
+    }
+    else if(is_atom(*child))
+      return child;
+    // a child shared with a fixpoint stays wrapped even if nothing is replaced in it, the next
+    // push copies it
+    else if(!(child->free_summary & with->variable_bit) && child.use_count() == 1)
+      return child;
+    const SourceRange loc = child->source_range();
+    return std::make_shared<Substitution>(loc, std::move(child), with);
+  }
+
+  // replaces nothing, wraps the shared children of a binder that shadows the variable being
+  // substituted so they are still copied before anything changes them
+  static const std::shared_ptr<Replacement>& copying()
+  {
+    thread_local static const auto with = std::make_shared<Replacement>(
+      Replacement { Symbol(""), free_bit(Symbol("")), std::make_shared<Integer>(SourceRange(), 0), std::nullopt });
+    return with;
+  }
+
+  // a copy of the node sharing its children
+  static Expression::Ptr copy_node(const Expression::Ptr& node)
+  {
+    switch(node->kind())
+    {
+    default: return node;
+
+    case ExpressionKind::FunctionCall:
+      {
+        auto call = static_cast<const FunctionCall*>(node.get());
+        return node->keep_origin(std::make_shared<FunctionCall>(node->source_range(), call->fn, call->arg));
+      }
+    case ExpressionKind::Lambda:
+      {
+        auto fn = static_cast<const Lambda*>(node.get());
+        auto copy = std::make_shared<Lambda>(node->source_range(), fn->binding, fn->body);
+        copy->mark_strict(fn->strict_count, fn->strict_mask);
+        return node->keep_origin(copy);
+      }
+    case ExpressionKind::LetRec:
+      {
+        auto rec = static_cast<const LetRec*>(node.get());
+        return node->keep_origin(std::make_shared<LetRec>(node->source_range(), rec->binding, rec->bound, rec->body));
+      }
+    case ExpressionKind::Let:
+      {
+        auto let = static_cast<const Let*>(node.get());
+        return node->keep_origin(std::make_shared<Let>(node->source_range(), let->binding, let->bound, let->body));
+      }
+    case ExpressionKind::Constructor:
+      {
+        auto con = static_cast<const Constructor*>(node.get());
+        return node->keep_origin(std::make_shared<Constructor>(node->source_range(), con->con_tag, con->con_arity,
+                                                               con->con_fields));
+      }
+    case ExpressionKind::Case:
+      {
+        auto match = static_cast<const Case*>(node.get());
+        return node->keep_origin(std::make_shared<Case>(node->source_range(), match->scrutinee, match->alts,
+                                                        match->dispatch));
+      }
+    }
+  }
+
+  // a copy of a term no reduction may change, made lazily by the pushes
+  static Expression::Ptr copy(const Expression::Ptr& term)
+  {
+    if(is_atom(*term))
+      return term->clone();
+    return std::make_shared<Substitution>(term->source_range(), term, copying());
+  }
+
+  // the reference to a thunk with the substitution carried out in its term, all references to
+  // the thunk the substitution reaches share one copy
+  static Expression::Ptr substitute(const Shared& ref, const Substitution& sub)
+  {
+    Thunk& thunk = *ref.thunk;
+    if(!free_variables(thunk).count(sub.with->variable))
+      return std::make_shared<Shared>(ref.source_range(), ref.thunk);
+
+    for(auto& [from, to] : sub.with->thunks)
+      if(from.lock() == ref.thunk)
+        if(auto made = to.lock())
+          return std::make_shared<Shared>(ref.source_range(), std::move(made));
+
+    // a term that is still being reduced in place can't be shared with the copy
+    Expression::Ptr term = thunk.forced ? thunk.term : clone(*thunk.term);
+    term = std::make_shared<Substitution>(term->source_range(), std::move(term), sub.with);
+    auto made = std::make_shared<Thunk>(thunk.name, std::move(term), false);
+    sub.with->thunks.push_back({ ref.thunk, made });
+    return std::make_shared<Shared>(ref.source_range(), std::move(made));
+  }
+
+  // the reference to a fixpoint with the substitution carried out in its term
+  static Expression::Ptr substitute(const Recursive& ref, const Substitution& sub)
+  {
+    Fixpoint& fix = *ref.fix;
+    if(!free_variables(fix).count(sub.with->variable))
+      return std::make_shared<Recursive>(ref.source_range(), ref.fix);
+
+    Symbol name = fix.name;
+    Expression::Ptr term = fix.term;
+    const Identifier binding(ref.source_range(), fix.name, fix.name_bit);
+    if(auto fresh = avoid_capture(binding, *sub.with, {  }, &free_variables(fix)))
+    {
+      name = fresh->id();
+      auto with = std::make_shared<Replacement>(Replacement { fix.name, fix.name_bit, fresh, std::nullopt });
+      term = std::make_shared<Substitution>(term->source_range(), std::move(term), std::move(with));
+    }
+    term = std::make_shared<Substitution>(term->source_range(), std::move(term), sub.with);
+    return std::make_shared<Recursive>(ref.source_range(), std::make_shared<Fixpoint>(name, std::move(term)));
+  }
+
+  // moves the substitution in the slot below the node it wraps, which must not be a substitution
+  static void push(Expression::Ptr& slot)
+  {
+    // keeps the substitution alive until it has been copied to the children
+    Expression::Ptr owner = std::move(slot);
+    auto sub = static_cast<Substitution*>(owner.get());
+    // the copies are part of the contraction that left the substitution behind
+    Profiler::Charge charge(owner->origin());
+    // a substitution in the term of a fixpoint is left as it is for the other unfoldings
+    Expression::Ptr body = owner.use_count() > 1 ? sub->body : std::move(sub->body);
+    if(body.use_count() > 1)
+      body = copy_node(body);
+    else if(!(body->free_summary & sub->with->variable_bit))
+    {
+      slot = std::move(body);
+      return;
+    }
+    switch(body->kind())
+    {
+    default:
+      slot = std::move(body);
+      break;
+
+    case ExpressionKind::Identifier:
+      if(static_cast<Identifier*>(body.get())->id() != sub->with->variable)
+        slot = std::move(body);
+      // data is copied as it is taken apart, a case only looks at the outermost constructor
+      else if(sub->with->term->kind() == ExpressionKind::Constructor)
+        slot = copy(sub->with->term);
+      else
+        slot = sub->with->term->clone();
+      break;
+
+    case ExpressionKind::FunctionCall:
+      {
+        auto call = static_cast<FunctionCall*>(body.get());
+        call->fn = wrap(std::move(call->fn), sub->with);
+        call->arg = wrap(std::move(call->arg), sub->with);
+        call->free_summary = call->fn->free_summary | call->arg->free_summary;
+        slot = std::move(body);
+      } break;
+
+    case ExpressionKind::Lambda:
+      {
+        auto fn = static_cast<Lambda*>(body.get());
+        // only replace if there is no rebinding
+        if(fn->binding->id() != sub->with->variable)
+        {
+          if(auto new_binding = avoid_capture(*fn->binding, *sub->with, { fn->body.get() }))
+          {
+            fn->replace(new_binding);
+            fn->binding = new_binding;
+          }
+          fn->body = wrap(std::move(fn->body), sub->with);
+          fn->free_summary = bind(fn->body->free_summary, fn->binding->free_summary);
+        }
+        else
+          fn->body = wrap(std::move(fn->body), copying());
+        slot = std::move(body);
+      } break;
+
+    case ExpressionKind::LetRec:
+      {
+        auto rec = static_cast<LetRec*>(body.get());
+        if(rec->binding->id() != sub->with->variable)
+        {
+          if(auto new_binding = avoid_capture(*rec->binding, *sub->with, { rec->bound.get(), rec->body.get() }))
+            rec->rename(new_binding);
+          rec->bound = wrap(std::move(rec->bound), sub->with);
+          rec->body = wrap(std::move(rec->body), sub->with);
+          rec->free_summary = bind(rec->bound->free_summary | rec->body->free_summary, rec->binding->free_summary);
+        }
+        else
+        {
+          rec->bound = wrap(std::move(rec->bound), copying());
+          rec->body = wrap(std::move(rec->body), copying());
+        }
+        slot = std::move(body);
+      } break;
+
+    case ExpressionKind::Let:
+      {
+        auto let = static_cast<Let*>(body.get());
+        let->bound = wrap(std::move(let->bound), sub->with);
+        if(let->binding->id() != sub->with->variable)
+        {
+          if(auto new_binding = avoid_capture(*let->binding, *sub->with, { let->body.get() }))
+            let->rename(new_binding);
+          let->body = wrap(std::move(let->body), sub->with);
+        }
+        else
+          let->body = wrap(std::move(let->body), copying());
+        let->free_summary = let->bound->free_summary | bind(let->body->free_summary, let->binding->free_summary);
+        slot = std::move(body);
+      } break;
+
+    case ExpressionKind::Recursive:
+      slot = substitute(*static_cast<Recursive*>(body.get()), *sub);
+      break;
+
+    case ExpressionKind::Shared:
+      slot = substitute(*static_cast<Shared*>(body.get()), *sub);
+      break;
+
+    case ExpressionKind::Constructor:
+      {
+        auto con = static_cast<Constructor*>(body.get());
+        con->free_summary = 0;
+        for(auto& field : con->con_fields)
+        {
+          field = wrap(std::move(field), sub->with);
+          con->free_summary |= field->free_summary;
+        }
+        slot = std::move(body);
+      } break;
+
+    case ExpressionKind::Case:
+      {
+        auto match = static_cast<Case*>(body.get());
+        match->scrutinee = wrap(std::move(match->scrutinee), sub->with);
+        for(auto& alt : match->alts)
+        {
+          const bool shadowed = std::any_of(alt.binders.begin(), alt.binders.end(),
+                                            [&sub](const Identifier::Ptr& binder) { return binder->id() == sub->with->variable; });
+          if(shadowed)
+          {
+            alt.body = wrap(std::move(alt.body), copying());
+            continue;
+          }
+          for(auto& binder : alt.binders)
+          {
+            if(!(sub->with->term->free_summary & binder->free_summary))
+              continue;
+            // the new name must not clash with the other binders of the alternative either
+            SymbolSet siblings;
+            for(auto& other : alt.binders)
+              siblings.insert(other->id());
+            if(auto new_binding = avoid_capture(*binder, *sub->with, { alt.body.get() }, &siblings))
+            {
+              auto with = std::make_shared<Replacement>(Replacement { binder->id(), binder->free_summary, new_binding,
+                                                                      std::nullopt });
+              alt.body = std::make_shared<Substitution>(alt.body->source_range(), std::move(alt.body), std::move(with));
+              binder = new_binding;
+            }
+          }
+          alt.body = wrap(std::move(alt.body), sub->with);
+        }
+        match->update_free_summary();
+        slot = std::move(body);
+      } break;
+    }
+  }
+
+  // pushes substitutions down until the slot holds something else
+  static void expose(Expression::Ptr& slot)
+  {
+    if(slot->kind() != ExpressionKind::Substitution)
+      return;
+
+    // a substitution can only be pushed once its body is exposed
+    std::vector<Expression::Ptr*> chain { &slot };
+    while(!chain.empty())
+    {
+      Expression::Ptr* top = chain.back();
+      if((*top)->kind() != ExpressionKind::Substitution)
+        chain.pop_back();
+      else if(auto sub = static_cast<Substitution*>(top->get()); sub->body->kind() == ExpressionKind::Substitution)
+        chain.push_back(&sub->body);
+      else
+        push(*top);
+    }
+  }
+
+  // exposes what a reducer looks at in an application: the spine down to the head and, if that is
+  // a primitive or Church form, its operands
+  static void expose_spine(FunctionCall& root)
+  {
+    constexpr std::size_t reach = std::max(Primitive::max_arity, Church::max_arity);
+    std::array<FunctionCall*, reach> calls;
+    std::size_t count = 0;
+    for(FunctionCall* call = &root; ; call = static_cast<FunctionCall*>(call->fn.get()))
+    {
+      calls[count++] = call;
+      expose(call->fn);
+      if(count == reach || call->fn->kind() != ExpressionKind::FunctionCall)
+        break;
+    }
+    const ExpressionKind head = calls[count - 1]->fn->kind();
+    if(head == ExpressionKind::Primitive || head == ExpressionKind::Church)
+      for(std::size_t i = 0; i < count; ++i)
+        expose(calls[i]->arg);
+  }
+
+  static void settle(Expression::Ptr& root)
+  {
+    std::vector<Expression::Ptr*> work { &root };
+    while(!work.empty())
+    {
+      Expression::Ptr* slot = work.back();
+      work.pop_back();
+
+      expose(*slot);
+      Expression* node = slot->get();
+      if(node->kind() == ExpressionKind::FunctionCall)
+      {
+        work.push_back(&static_cast<FunctionCall*>(node)->arg);
+        work.push_back(&static_cast<FunctionCall*>(node)->fn);
+      }
+      else if(node->kind() == ExpressionKind::Lambda)
+        work.push_back(&static_cast<Lambda*>(node)->body);
+      else if(node->kind() == ExpressionKind::LetRec)
+      {
+        work.push_back(&static_cast<LetRec*>(node)->body);
+        work.push_back(&static_cast<LetRec*>(node)->bound);
+      }
+      else if(node->kind() == ExpressionKind::Let)
+      {
+        work.push_back(&static_cast<Let*>(node)->body);
+        work.push_back(&static_cast<Let*>(node)->bound);
+      }
+      else if(node->kind() == ExpressionKind::Constructor)
+      {
+        for(auto& field : static_cast<Constructor*>(node)->con_fields)
+          work.push_back(&field);
+      }
+      else if(node->kind() == ExpressionKind::Case)
+      {
+        for(auto& alt : static_cast<Case*>(node)->alts)
+          work.push_back(&alt.body);
+        work.push_back(&static_cast<Case*>(node)->scrutinee);
+      }
+    }
+  }
+
+  static void attribute(Expression& root, const Origin* caller)
+  {
+    std::vector<Expression*> work { &root };
+    while(!work.empty())
+    {
+      Expression* node = work.back();
+      work.pop_back();
+
+      node->provenance = Profiler::nest(node->provenance, caller);
+      if(node->kind() == ExpressionKind::FunctionCall)
+      {
+        work.push_back(static_cast<FunctionCall*>(node)->arg.get());
+        work.push_back(static_cast<FunctionCall*>(node)->fn.get());
+      }
+      else if(node->kind() == ExpressionKind::Lambda)
+      {
+        work.push_back(static_cast<Lambda*>(node)->body.get());
+        work.push_back(static_cast<Lambda*>(node)->binding.get());
+      }
+      else if(node->kind() == ExpressionKind::LetRec)
+      {
+        work.push_back(static_cast<LetRec*>(node)->body.get());
+        work.push_back(static_cast<LetRec*>(node)->bound.get());
+        work.push_back(static_cast<LetRec*>(node)->binding.get());
+      }
+      else if(node->kind() == ExpressionKind::Let)
+      {
+        work.push_back(static_cast<Let*>(node)->body.get());
+        work.push_back(static_cast<Let*>(node)->bound.get());
+        work.push_back(static_cast<Let*>(node)->binding.get());
+      }
+      else if(node->kind() == ExpressionKind::Constructor)
+      {
+        for(auto& field : static_cast<Constructor*>(node)->con_fields)
+          work.push_back(field.get());
+      }
+      else if(node->kind() == ExpressionKind::Case)
+      {
+        for(auto& alt : static_cast<Case*>(node)->alts)
+        {
+          work.push_back(alt.body.get());
+          for(auto& binder : alt.binders)
+            work.push_back(binder.get());
+        }
+        work.push_back(static_cast<Case*>(node)->scrutinee.get());
+      }
+    }
+  }
+
+  // Drops a reference to a child. If that destroys it, its own children are released by the
+  // outermost call in this thread rather than recursively, so deep trees tear down in constant stack.
+  static void release(Expression::Ptr& child)
+  {
+    thread_local static bool releasing = false;
+    thread_local static std::vector<Expression::Ptr> pending;
+
+    if(!child)
+      return;
+    pending.push_back(std::move(child));
+    if(releasing)
+      return;
+
+    releasing = true;
+    while(!pending.empty())
+    {
+      Expression::Ptr node = std::move(pending.back());
+      pending.pop_back();
+      node.reset();
+    }
+    releasing = false;
+  }
+};
 
 std::uint_fast64_t GIDTag::gid() const
 { return gid_val; }
@@ -14,12 +903,37 @@ SourceRange Statement::source_range() const
 { return loc; }
 
 Expression::Expression(SourceRange loc)
-  : loc(loc)
-{  }
+  : loc(loc), provenance(Profiler::active())
+{ Profiler::charge_allocation(provenance); }
 
-SourceRange Expression::source_range()
+SourceRange Expression::source_range() const
 { return loc; }
 
+FreeBits free_bit(Symbol sym)
+{ return FreeBits(1) << std::min<std::uint32_t>(sym.ordinal(), 63); }
+
+FreeBits bind(FreeBits bits, FreeBits bit)
+{
+  // the shared bit may still stand for other variables
+  constexpr FreeBits shared = FreeBits(1) << 63;
+  return bit == shared ? bits : bits & ~bit;
+}
+
+const Origin* Expression::origin() const
+{ return provenance; }
+
+void Expression::print(std::ostream& os)
+{
+  Printer printer;
+  os << printer.print(*this);
+}
+
+void Expression::attribute_to(const Origin* caller)
+{ TreeOps::attribute(*this, caller); }
+
+void Expression::free_variables(SymbolSet& out) const
+{ TreeOps::free_variables(*this, out); }
+
 ErrorStatement::ErrorStatement(SourceRange loc)
   : Statement(loc)
 {  }
@@ -31,7 +945,8 @@ Statement::Ptr ErrorStatement::clone()
 
 void ErrorStatement::print(std::ostream& os)
 {
-  os << "?ERR?";
+  Printer printer;
+  os << printer.print(*this);
 }
 
 Statement::Ptr ErrorStatement::reduce_step_normal()
@@ -43,53 +958,47 @@ Statement::Ptr ErrorStatement::reduce_step_callbyname()
 Statement::Ptr ErrorStatement::reduce_step_callbyvalue()
 { return shared_from_this(); }
 
+Statement::Ptr ErrorStatement::reduce_step_applicative()
+{ return shared_from_this(); }
+
+Statement::Ptr ErrorStatement::reduce_step_headnormal()
+{ return shared_from_this(); }
+
+Statement::Ptr ErrorStatement::reduce_step_weakheadnormal()
+{ return shared_from_this(); }
+
 Identifier::Identifier(SourceRange loc, Symbol symbol)
-  : Expression(loc), symbol(symbol)
+  : Identifier(loc, symbol, free_bit(symbol))
 {  }
 
+Identifier::Identifier(SourceRange loc, Symbol symbol, FreeBits bit)
+  : Expression(loc), symbol(symbol)
+{ free_summary = bit; }
+
 Expression::Ptr Identifier::clone()
 {
-  return std::make_shared<Identifier>(source_range(), symbol);
+  return keep_origin(std::make_shared<Identifier>(source_range(), symbol, free_summary));
 }
 
-void Identifier::print(std::ostream& os)
-{
-  os << symbol;
-}
+ExpressionKind Identifier::kind() const
+{ return ExpressionKind::Identifier; }
 
 Symbol Identifier::id() const
 { return symbol; }
 
-void Identifier::fv(SymbolSet& cur)
-{ cur.insert(symbol); }
-
-Expression::Ptr Identifier::reduce_step_normal()
-{ return shared_from_this(); }
-
-Expression::Ptr Identifier::reduce_step_callbyname()
-{ return shared_from_this(); }
-
-Expression::Ptr Identifier::reduce_step_callbyvalue()
-{ return shared_from_this(); }
-
 Definition::Definition(SourceRange loc, Expression::Ptr id, Expression::Ptr body)
   : Statement(loc), id(id), body(body)
 {  }
 
 Statement::Ptr Definition::clone()
 {
-  return std::make_shared<Definition>(source_range(), id->clone(), body->clone());
+  return std::make_shared<Definition>(source_range(), id ? id->clone() : nullptr, body->clone());
 }
 
 void Definition::print(std::ostream& os)
 {
-  if(id)
-  {
-    id->print(os);
-    os << " ";
-  }
-  os << "= ";
-  body->print(os);
+  Printer printer;
+  os << printer.print(*this);
 }
 
 Identifier::Ptr Definition::identifier() const
@@ -99,14 +1008,50 @@ Identifier::Ptr Definition::identifier() const
   return nullptr;
 }
 
+const Expression::Ptr& Definition::expression() const
+{ return body; }
+
 Statement::Ptr Definition::reduce_step_normal()
-{ body->reduce_step_normal(); return shared_from_this(); }
+{
+  Focus(body, EvaluationStrategy::Normal).step();
+  Substitution::settle(body);
+  return shared_from_this();
+}
 
 Statement::Ptr Definition::reduce_step_callbyname()
-{ body->reduce_step_callbyname(); return shared_from_this(); }
+{
+  Focus(body, EvaluationStrategy::CallByName).step();
+  Substitution::settle(body);
+  return shared_from_this();
+}
 
 Statement::Ptr Definition::reduce_step_callbyvalue()
-{ body->reduce_step_callbyvalue(); return shared_from_this(); }
+{
+  Focus(body, EvaluationStrategy::CallByValue).step();
+  Substitution::settle(body);
+  return shared_from_this();
+}
+
+Statement::Ptr Definition::reduce_step_applicative()
+{
+  Focus(body, EvaluationStrategy::Applicative).step();
+  Substitution::settle(body);
+  return shared_from_this();
+}
+
+Statement::Ptr Definition::reduce_step_headnormal()
+{
+  Focus(body, EvaluationStrategy::HeadNormal).step();
+  Substitution::settle(body);
+  return shared_from_this();
+}
+
+Statement::Ptr Definition::reduce_step_weakheadnormal()
+{
+  Focus(body, EvaluationStrategy::WeakHeadNormal).step();
+  Substitution::settle(body);
+  return shared_from_this();
+}
 
 ErrorExpression::ErrorExpression(SourceRange loc)
   : Expression(loc)
@@ -114,51 +1059,129 @@ ErrorExpression::ErrorExpression(SourceRange loc)
 
 Expression::Ptr ErrorExpression::clone()
 {
-  return std::make_shared<ErrorExpression>(source_range());
+  return keep_origin(std::make_shared<ErrorExpression>(source_range()));
 }
 
-void ErrorExpression::print(std::ostream& os)
+ExpressionKind ErrorExpression::kind() const
+{ return ExpressionKind::Error; }
+
+Integer::Integer(SourceRange loc, std::int64_t value)
+  : Expression(loc), val(value)
+{  }
+
+Expression::Ptr Integer::clone()
 {
-  os << "?ERR?";
+  return keep_origin(std::make_shared<Integer>(source_range(), val));
 }
 
-Expression::Ptr ErrorExpression::reduce_step_normal()
-{ return shared_from_this(); }
+ExpressionKind Integer::kind() const
+{ return ExpressionKind::Integer; }
 
-Expression::Ptr ErrorExpression::reduce_step_callbyname()
-{ return shared_from_this(); }
+std::int64_t Integer::value() const
+{ return val; }
 
-Expression::Ptr ErrorExpression::reduce_step_callbyvalue()
-{ return shared_from_this(); }
+Primitive::Primitive(SourceRange loc, PrimitiveOp op)
+  : Expression(loc), operation(op)
+{  }
+
+Expression::Ptr Primitive::clone()
+{
+  return keep_origin(std::make_shared<Primitive>(source_range(), operation));
+}
+
+ExpressionKind Primitive::kind() const
+{ return ExpressionKind::Primitive; }
+
+PrimitiveOp Primitive::op() const
+{ return operation; }
+
+const char* Primitive::name() const
+{ return name(operation); }
+
+const char* Primitive::name(PrimitiveOp op)
+{
+  switch(op)
+  {
+  default:
+  case PrimitiveOp::Add: return "+";
+  case PrimitiveOp::Sub: return "-";
+  case PrimitiveOp::Mul: return "*";
+  case PrimitiveOp::Div: return "/";
+  case PrimitiveOp::Less: return "<";
+  case PrimitiveOp::IfZero: return "ifz";
+  }
+}
+
+std::size_t Primitive::arity() const
+{ return arity(operation); }
+
+std::size_t Primitive::strict_arity() const
+{ return strict_arity(operation); }
+
+std::size_t Primitive::arity(PrimitiveOp op)
+{ return op == PrimitiveOp::IfZero ? 3 : 2; }
+
+std::size_t Primitive::strict_arity(PrimitiveOp op)
+{ return op == PrimitiveOp::IfZero ? 1 : 2; }
+
+bool Primitive::compute(PrimitiveOp op, std::int64_t lhs, std::int64_t rhs, std::int64_t& result)
+{
+  // wrap around instead of overflowing
+  const auto ulhs = static_cast<std::uint64_t>(lhs);
+  const auto urhs = static_cast<std::uint64_t>(rhs);
+  switch(op)
+  {
+  default:
+  case PrimitiveOp::Add: result = static_cast<std::int64_t>(ulhs + urhs); break;
+  case PrimitiveOp::Sub: result = static_cast<std::int64_t>(ulhs - urhs); break;
+  case PrimitiveOp::Mul: result = static_cast<std::int64_t>(ulhs * urhs); break;
+  case PrimitiveOp::Less: result = lhs < rhs ? 1 : 0; break;
+  case PrimitiveOp::Div:
+    if(rhs == 0 || (lhs == INT64_MIN && rhs == -1))
+      return false;
+    result = lhs / rhs;
+    break;
+  }
+  return true;
+}
+
+Expression::Ptr Primitive::apply(SourceRange loc, const std::array<Expression::Ptr*, max_arity>& args) const
+{
+  const auto lhs = static_cast<const Integer*>(args[0]->get())->value();
+  if(operation == PrimitiveOp::IfZero)
+    return lhs == 0 ? *args[1] : *args[2];
+
+  const auto rhs = static_cast<const Integer*>(args[1]->get())->value();
+  std::int64_t result = 0;
+  if(!compute(operation, lhs, rhs, result))
+    return nullptr;
+  return std::make_shared<Integer>(loc, result);
+}
 
 FunctionCall::FunctionCall(SourceRange range, Expression::Ptr fn, Expression::Ptr arg)
   : Expression(range), fn(fn), arg(arg)
-{  }
+{ free_summary = (fn ? fn->free_summary : 0) | (arg ? arg->free_summary : 0); }
 
-Expression::Ptr FunctionCall::clone()
+FunctionCall::~FunctionCall()
 {
-  return std::make_shared<FunctionCall>(source_range(), fn->clone(), arg->clone());
+  TreeOps::release(fn);
+  TreeOps::release(arg);
 }
 
-void FunctionCall::print(std::ostream& os)
+Expression::Ptr FunctionCall::clone()
 {
-  bool is_fn0 = !!std::dynamic_pointer_cast<Lambda>(fn);
-  if(is_fn0)
-    os << "(";
-  os << "(";
-  fn->print(os);
-  if(is_fn0)
-    os << ")";
-  os << " ";
-  bool is_fn = !!std::dynamic_pointer_cast<Lambda>(arg);
-  if(is_fn)
-    os << "(";
-  arg->print(os);
-  if(is_fn)
-    os << ")";
-  os << ")";
+  return TreeOps::clone(*this);
 }
 
+ExpressionKind FunctionCall::kind() const
+{ return ExpressionKind::FunctionCall; }
+
+const Expression::Ptr& FunctionCall::fn_expr() const
+{ return fn; }
+
+const Expression::Ptr& FunctionCall::arg_expr() const
+{ return arg; }
+
 bool FunctionCall::is_simple() const
 {
   const bool  fn_is_var = !!std::dynamic_pointer_cast<Identifier>(fn);
@@ -167,165 +1190,873 @@ bool FunctionCall::is_simple() const
   return fn_is_var && arg_is_var;
 }
 
-void FunctionCall::fv(SymbolSet& cur)
+Expression::Ptr FunctionCall::contract(const Lambda::Ptr& fn)
 {
-  fn->fv(cur);
-  arg->fv(cur);
+  Profiler::Step step(origin());
+  ++contractions;
+
+  fn->replace(arg);
+  return fn->fn_body();
 }
 
-void FunctionCall::replace(Identifier::Ptr what, Expression::Ptr with)
+Expression::Ptr* FunctionCall::spine(std::size_t depth, std::array<Expression::Ptr*, Primitive::max_arity>& args,
+                                     std::size_t& count)
 {
-  auto fn_is_var = std::dynamic_pointer_cast<Identifier>(fn);
-  if(fn_is_var)
+  FunctionCall* call = this;
+  for(count = 1; ; ++count)
   {
-    if(fn_is_var->id() == what->id())
-    {
-      fn = with->clone();
-    }
+    args[Primitive::max_arity - count] = &call->arg;
+    if(count == depth || call->fn->kind() != ExpressionKind::FunctionCall)
+      break;
+    call = static_cast<FunctionCall*>(call->fn.get());
   }
-  else
-    fn->replace(what, with);
+  std::rotate(args.begin(), args.begin() + (Primitive::max_arity - count), args.end());
+  return &call->fn;
+}
 
-  auto arg_is_var = std::dynamic_pointer_cast<Identifier>(arg);
-  if(arg_is_var)
-  {
-    if(arg_is_var->id() == what->id())
-    {
-      arg = with->clone();
-    }
-  }
-  else
-    arg->replace(what, with);
+Primitive* FunctionCall::applied_primitive(std::array<Expression::Ptr*, Primitive::max_arity>& args, std::size_t& count)
+{
+  // primitives take at most max_arity operands, so there is no need to walk further down the spine
+  auto head = spine(Primitive::max_arity, args, count);
+  if((*head)->kind() != ExpressionKind::Primitive)
+    return nullptr;
+  return static_cast<Primitive*>(head->get());
 }
 
-Expression::Ptr FunctionCall::reduce_step_normal()
+bool FunctionCall::is_lazy_operand()
 {
-  if(auto is_fn = std::dynamic_pointer_cast<Lambda>(fn))
-  {
-    is_fn->replace(arg);
-    return is_fn->fn_body();
-  }
-  else
+  std::array<Expression::Ptr*, Primitive::max_arity> args;
+  std::size_t count;
+  auto prim = applied_primitive(args, count);
+  return prim && count <= prim->arity() && count > prim->strict_arity();
+}
+
+Expression::Ptr FunctionCall::delta(Expression::Ptr*& operand)
+{
+  std::array<Expression::Ptr*, Primitive::max_arity> args;
+  std::size_t count;
+  auto prim = applied_primitive(args, count);
+  if(!prim || count != prim->arity())
+    return nullptr;
+
+  // operands are strict under every strategy, they are reduced left to right
+  for(std::size_t i = 0; i < prim->strict_arity(); ++i)
   {
-    fn = fn->reduce_step_normal();
-    return shared_from_this();
+    if((*args[i])->kind() != ExpressionKind::Integer)
+    {
+      operand = args[i];
+      return nullptr;
+    }
   }
-}
 
-Expression::Ptr FunctionCall::reduce_step_callbyname()
-{ return reduce_step_normal(); }
+  auto result = prim->apply(source_range(), args);
+  if(!result)
+    return nullptr;
 
-Expression::Ptr FunctionCall::reduce_step_callbyvalue()
+  Profiler::Step step(origin());
+  ++contractions;
+  return result;
+}
+
+Expression::Ptr FunctionCall::accelerate(EvaluationStrategy strat, Expression::Ptr*& operand)
 {
-  auto is_fn = std::dynamic_pointer_cast<Lambda>(arg);
-  if(is_fn)
-  {   
-    // arg is fully evaluated, so we may β-reduce
-    return reduce_step_normal();
-  }   
-  // we first need to fully reduce our argument
-  auto new_arg = arg->reduce_step_callbyvalue();
-  if(arg == new_arg)
-  {   
-    is_fn = std::dynamic_pointer_cast<Lambda>(fn);
-    if(is_fn)
-    {   
-      is_fn->replace(arg);
-      return is_fn->fn_body();
-    }   
-    else
+  std::array<Expression::Ptr*, Primitive::max_arity> args;
+  std::size_t count;
+  auto head = spine(Church::max_arity, args, count);
+  if((*head)->kind() != ExpressionKind::Church)
+    return nullptr;
+
+  auto church = std::static_pointer_cast<Church>(*head);
+  if(count == church->arity())
+  {
+    for(std::size_t i = 0; i < count; ++i)
+    {
+      auto is_church = std::dynamic_pointer_cast<Church>(*args[i]);
+      if(is_church && is_church->form() == ChurchForm::Numeral)
+        continue;
+      // lazy strategies must not evaluate arguments the λ-term would not
+      if(strat == EvaluationStrategy::CallByValue || strat == EvaluationStrategy::Normal
+         || strat == EvaluationStrategy::Applicative)
+      {
+        operand = args[i];
+        return nullptr;
+      }
+      break;
+    }
+    if(auto result = church->apply(source_range(), args))
     {
-      // for stuff like ((λ x. λ y. y x) a b)
-      fn = fn->reduce_step_normal();
+      Profiler::Step step(origin());
+      ++contractions;
+      return result;
     }
   }
-  return shared_from_this();
+  else if(head != &fn)
+    return nullptr;
+
+  // no native operation applies, continue with the λ-term it stands for
+  *head = church->expand();
+  return nullptr;
 }
 
+void FunctionCall::expand_church()
+{
+  std::array<Expression::Ptr*, Primitive::max_arity> args;
+  std::size_t count;
+  auto head = spine(Church::max_arity, args, count);
+  if((*head)->kind() == ExpressionKind::Church)
+    *head = static_cast<Church*>(head->get())->expand();
+}
 
 Lambda::Lambda(SourceRange loc, Identifier::Ptr binding, Expression::Ptr body)
   : Expression(loc), binding(binding), body(body)
-{  }
+{
+  if(body)
+    free_summary = bind(body->free_summary, binding->free_summary);
+}
+
+Lambda::~Lambda()
+{
+  TreeOps::release(body);
+}
 
 Expression::Ptr Lambda::clone()
 {
-  return std::make_shared<Lambda>(source_range(), std::static_pointer_cast<Identifier>(binding->clone()), body->clone());
+  return TreeOps::clone(*this);
+}
+
+ExpressionKind Lambda::kind() const
+{ return ExpressionKind::Lambda; }
+
+Expression::Ptr Lambda::fn_body() const
+{ return body; }
+
+const Identifier::Ptr& Lambda::fn_binding() const
+{ return binding; }
+
+void Lambda::mark_strict(std::uint32_t arity, std::uint64_t params)
+{
+  strict_count = arity;
+  strict_mask = params;
 }
 
-void Lambda::print(std::ostream& os)
+std::uint32_t Lambda::strict_arity() const
+{ return strict_count; }
+
+std::uint64_t Lambda::strict_params() const
+{ return strict_mask; }
+
+void Lambda::replace(Expression::Ptr what)
 {
-  os << "λ ";
-  binding->print(os);
-  os << ". ";
+  auto with = std::make_shared<Replacement>(Replacement { binding->id(), binding->free_summary, what, std::nullopt });
+  const SourceRange loc = body->source_range();
+  body = std::make_shared<Substitution>(loc, std::move(body), std::move(with));
+  free_summary = bind(body->free_summary, binding->free_summary);
+}
 
-  const bool is_fn = !!std::dynamic_pointer_cast<Lambda>(body);
-  if(is_fn)
-    os << "(";
-  body->print(os);
+Let::Let(SourceRange loc, Identifier::Ptr binding, Expression::Ptr bound, Expression::Ptr body)
+  : Expression(loc), binding(binding), bound(bound), body(body)
+{
+  if(bound && body)
+    free_summary = bound->free_bits() | bind(body->free_bits(), binding->free_bits());
+}
 
-  if(is_fn)
-    os << ")";
+Let::~Let()
+{
+  TreeOps::release(bound);
+  TreeOps::release(body);
 }
 
-Expression::Ptr Lambda::fn_body() const
+Expression::Ptr Let::clone()
+{
+  return TreeOps::clone(*this);
+}
+
+ExpressionKind Let::kind() const
+{ return ExpressionKind::Let; }
+
+const Identifier::Ptr& Let::let_binding() const
+{ return binding; }
+
+const Expression::Ptr& Let::let_bound() const
+{ return bound; }
+
+const Expression::Ptr& Let::let_body() const
 { return body; }
 
-void Lambda::replace(Expression::Ptr what)
+Expression::Ptr Let::contract(bool evaluated)
 {
-  auto is_var = std::dynamic_pointer_cast<Identifier>(body);
-  if(is_var)
+  Profiler::Step step(origin());
+  ++contractions;
+
+  // atoms are as cheap to copy as a reference would be
+  Expression::Ptr value = std::move(bound);
+  if(!TreeOps::is_atom(*value))
   {
-    if(is_var->id() == binding->id())
-      body = what->clone();
-    else
-      ; // we have something like `λ x.y`
+    const bool forced = evaluated || value->kind() == ExpressionKind::Lambda;
+    auto thunk = std::make_shared<Thunk>(binding->id(), std::move(value), forced);
+    value = std::make_shared<Shared>(binding->source_range(), std::move(thunk));
   }
-  else
+  auto with = std::make_shared<Replacement>(Replacement { binding->id(), binding->free_bits(), value, std::nullopt });
+  const SourceRange loc = body->source_range();
+  return std::make_shared<Substitution>(loc, std::move(body), std::move(with));
+}
+
+void Let::rename(Identifier::Ptr to)
+{
+  auto with = std::make_shared<Replacement>(Replacement { binding->id(), binding->free_bits(), to, std::nullopt });
+  body = std::make_shared<Substitution>(body->source_range(), std::move(body), std::move(with));
+  binding = std::move(to);
+  free_summary = bound->free_bits() | bind(body->free_bits(), binding->free_bits());
+}
+
+Constructor::Constructor(SourceRange loc, std::uint32_t tag, std::uint32_t arity, std::vector<Expression::Ptr> fields)
+  : Expression(loc), con_tag(tag), con_arity(arity), con_fields(std::move(fields))
+{
+  for(auto& field : con_fields)
+    if(field)
+      free_summary |= field->free_bits();
+}
+
+Constructor::~Constructor()
+{
+  for(auto& field : con_fields)
+    TreeOps::release(field);
+}
+
+Expression::Ptr Constructor::clone()
+{
+  return TreeOps::clone(*this);
+}
+
+ExpressionKind Constructor::kind() const
+{ return ExpressionKind::Constructor; }
+
+std::uint32_t Constructor::tag() const
+{ return con_tag; }
+
+std::uint32_t Constructor::arity() const
+{ return con_arity; }
+
+const std::vector<Expression::Ptr>& Constructor::fields() const
+{ return con_fields; }
+
+bool Constructor::is_saturated() const
+{ return con_fields.size() == con_arity; }
+
+Case::Case(SourceRange loc, Expression::Ptr scrutinee, std::vector<Alternative> alts)
+  : Expression(loc), scrutinee(std::move(scrutinee)), alts(std::move(alts)), dispatch()
+{
+  std::uint32_t max_tag = 0;
+  for(auto& alt : this->alts)
+    max_tag = std::max(max_tag, alt.tag);
+  auto table = std::make_shared<std::vector<std::uint32_t>>(this->alts.empty() ? 0 : max_tag + 1, 0);
+  // the first alternative for a tag wins
+  for(std::size_t i = this->alts.size(); i-- > 0;)
+    (*table)[this->alts[i].tag] = i + 1;
+  dispatch = std::move(table);
+  update_free_summary();
+}
+
+Case::Case(SourceRange loc, Expression::Ptr scrutinee, std::vector<Alternative> alts,
+           std::shared_ptr<const std::vector<std::uint32_t>> dispatch)
+  : Expression(loc), scrutinee(std::move(scrutinee)), alts(std::move(alts)), dispatch(std::move(dispatch))
+{ update_free_summary(); }
+
+Case::~Case()
+{
+  TreeOps::release(scrutinee);
+  for(auto& alt : alts)
+    TreeOps::release(alt.body);
+}
+
+Expression::Ptr Case::clone()
+{
+  return TreeOps::clone(*this);
+}
+
+ExpressionKind Case::kind() const
+{ return ExpressionKind::Case; }
+
+const Expression::Ptr& Case::case_scrutinee() const
+{ return scrutinee; }
+
+const std::vector<Alternative>& Case::alternatives() const
+{ return alts; }
+
+const Alternative* Case::select(std::uint32_t tag) const
+{
+  if(tag >= dispatch->size() || (*dispatch)[tag] == 0)
+    return nullptr;
+  return &alts[(*dispatch)[tag] - 1];
+}
+
+Expression::Ptr Case::contract()
+{
+  auto con = static_cast<Constructor*>(scrutinee.get());
+  const Alternative* selected = select(con->con_tag);
+  if(!selected || selected->binders.size() != con->con_fields.size())
+    return nullptr;
+
+  Profiler::Step step(origin());
+  ++contractions;
+
+  Alternative& alt = alts[selected - alts.data()];
+  std::vector<Expression::Ptr> fields = scrutinee.use_count() == 1 ? std::move(con->con_fields) : con->con_fields;
+  Expression::Ptr body = std::move(alt.body);
+
+  // the fields are substituted one after the other, so no binder may occur free in a field
+  FreeBits field_bits = 0;
+  for(auto& field : fields)
+    field_bits |= field->free_bits();
+  std::optional<SymbolSet> in_fields;
+  SymbolSet avoid;
+  for(auto& binder : alt.binders)
   {
-    body->replace(binding, what);
+    if(!(field_bits & binder->free_bits()))
+      continue;
+    if(!in_fields)
+    {
+      in_fields.emplace();
+      for(auto& field : fields)
+        TreeOps::free_variables(*field, *in_fields);
+      avoid = *in_fields;
+      TreeOps::free_variables(*body, avoid);
+      for(auto& other : alt.binders)
+        avoid.insert(other->id());
+    }
+    if(!in_fields->count(binder->id()))
+      continue;
+    std::string name = binder->id().get_string();
+    do
+      name += "'";
+    while(avoid.count(Symbol(name.c_str())));
+    auto fresh = std::make_shared<Identifier>(binder->source_range(), Symbol(name.c_str()));
+    avoid.insert(fresh->id());
+    auto with = std::make_shared<Replacement>(Replacement { binder->id(), binder->free_bits(), fresh, std::nullopt });
+    body = std::make_shared<Substitution>(body->source_range(), std::move(body), std::move(with));
+    binder = std::move(fresh);
+  }
+  for(std::size_t i = 0; i < fields.size(); ++i)
+  {
+    auto with = std::make_shared<Replacement>(Replacement { alt.binders[i]->id(), alt.binders[i]->free_bits(),
+                                                            std::move(fields[i]), std::nullopt });
+    body = std::make_shared<Substitution>(body->source_range(), std::move(body), std::move(with));
+  }
+  return body;
+}
+
+void Case::update_free_summary()
+{
+  free_summary = scrutinee ? scrutinee->free_bits() : 0;
+  for(auto& alt : alts)
+  {
+    if(!alt.body)
+      continue;
+    FreeBits bits = alt.body->free_bits();
+    for(auto& binder : alt.binders)
+      bits = bind(bits, binder->free_bits());
+    free_summary |= bits;
   }
 }
 
-void Lambda::fv(SymbolSet& cur)
+LetRec::LetRec(SourceRange loc, Identifier::Ptr binding, Expression::Ptr bound, Expression::Ptr body)
+  : Expression(loc), binding(binding), bound(bound), body(body)
+{
+  if(bound && body)
+    free_summary = bind(bound->free_bits() | body->free_bits(), binding->free_bits());
+}
+
+LetRec::~LetRec()
+{
+  TreeOps::release(bound);
+  TreeOps::release(body);
+}
+
+Expression::Ptr LetRec::clone()
+{
+  return TreeOps::clone(*this);
+}
+
+ExpressionKind LetRec::kind() const
+{ return ExpressionKind::LetRec; }
+
+const Identifier::Ptr& LetRec::rec_binding() const
+{ return binding; }
+
+const Expression::Ptr& LetRec::rec_bound() const
+{ return bound; }
+
+const Expression::Ptr& LetRec::rec_body() const
+{ return body; }
+
+Expression::Ptr LetRec::contract()
+{
+  Profiler::Step step(origin());
+  ++contractions;
+
+  auto fix = std::make_shared<Fixpoint>(binding->id(), std::move(bound));
+  auto ref = std::make_shared<Recursive>(binding->source_range(), std::move(fix));
+  auto with = std::make_shared<Replacement>(Replacement { binding->id(), binding->free_bits(), ref, std::nullopt });
+  const SourceRange loc = body->source_range();
+  return std::make_shared<Substitution>(loc, std::move(body), std::move(with));
+}
+
+void LetRec::rename(Identifier::Ptr to)
+{
+  auto with = std::make_shared<Replacement>(Replacement { binding->id(), binding->free_bits(), to, std::nullopt });
+  bound = std::make_shared<Substitution>(bound->source_range(), std::move(bound), with);
+  body = std::make_shared<Substitution>(body->source_range(), std::move(body), std::move(with));
+  binding = std::move(to);
+  free_summary = bind(bound->free_bits() | body->free_bits(), binding->free_bits());
+}
+
+Substitution::Substitution(SourceRange loc, Expression::Ptr body, std::shared_ptr<Replacement> with)
+  : Expression(loc), body(std::move(body)), with(std::move(with))
+{
+  if(!this->body)
+    return;
+  const FreeBits bit = this->with->variable_bit;
+  free_summary = bind(this->body->free_bits(), bit);
+  if(this->body->free_bits() & bit)
+    free_summary |= this->with->term->free_bits();
+}
+
+Substitution::~Substitution()
+{
+  TreeOps::release(body);
+  // values may hold substitutions themselves, the last user releases them like a child
+  if(with && with.use_count() == 1)
+    TreeOps::release(with->term);
+}
+
+Expression::Ptr Substitution::clone()
+{
+  return TreeOps::clone(*this);
+}
+
+ExpressionKind Substitution::kind() const
+{ return ExpressionKind::Substitution; }
+
+const Expression::Ptr& Substitution::sub_body() const
+{ return body; }
+
+Symbol Substitution::variable() const
+{ return with->variable; }
+
+const Expression::Ptr& Substitution::value() const
+{ return with->term; }
+
+void Substitution::settle(Expression::Ptr& root)
+{ TreeOps::settle(root); }
+
+void Substitution::settle(Statement& stmt)
+{
+  if(auto def = dynamic_cast<Definition*>(&stmt); def && def->body)
+    settle(def->body);
+}
+
+Fixpoint::Fixpoint(Symbol name, Expression::Ptr term)
+  : name(name), name_bit(free_bit(name)), term(std::move(term)), free()
+{  }
+
+Fixpoint::~Fixpoint()
+{
+  TreeOps::release(term);
+}
+
+Recursive::Recursive(SourceRange loc, std::shared_ptr<Fixpoint> fix)
+  : Expression(loc), fix(std::move(fix))
+{ free_summary = bind(this->fix->term->free_bits(), this->fix->name_bit); }
+
+Expression::Ptr Recursive::clone()
+{
+  return keep_origin(std::make_shared<Recursive>(source_range(), fix));
+}
+
+ExpressionKind Recursive::kind() const
+{ return ExpressionKind::Recursive; }
+
+Symbol Recursive::name() const
+{ return fix->name; }
+
+const Expression::Ptr& Recursive::term() const
+{ return fix->term; }
+
+bool Recursive::is_function() const
+{
+  const Expression* node = fix->term.get();
+  while(node->kind() == ExpressionKind::Substitution)
+    node = static_cast<const Substitution*>(node)->sub_body().get();
+  return node->kind() == ExpressionKind::Lambda;
+}
+
+Expression::Ptr Recursive::unfold() const
 {
-  body->fv(cur);
-  if(auto it = cur.find(binding->id()); it != cur.end())
-    cur.erase(it);
+  auto ref = keep_origin(std::make_shared<Recursive>(source_range(), fix));
+  auto with = std::make_shared<Replacement>(Replacement { fix->name, fix->name_bit, std::move(ref), std::nullopt });
+  return std::make_shared<Substitution>(source_range(), fix->term, std::move(with));
 }
 
-void Lambda::replace(Identifier::Ptr what, Expression::Ptr with)
+Thunk::Thunk(Symbol name, Expression::Ptr term, bool forced)
+  : name(name), term(std::move(term)), forced(forced), free()
+{  }
+
+Thunk::~Thunk()
 {
-  // only replace if there is no rebinding
-  if(what->id() != binding->id())
+  TreeOps::release(term);
+}
+
+Shared::Shared(SourceRange loc, std::shared_ptr<Thunk> thunk)
+  : Expression(loc), thunk(std::move(thunk))
+{ free_summary = this->thunk->term->free_bits(); }
+
+Expression::Ptr Shared::clone()
+{
+  return keep_origin(std::make_shared<Shared>(source_range(), thunk));
+}
+
+ExpressionKind Shared::kind() const
+{ return ExpressionKind::Shared; }
+
+Symbol Shared::name() const
+{ return thunk->name; }
+
+const Expression::Ptr& Shared::term() const
+{ return thunk->term; }
+
+bool Shared::is_forced() const
+{ return thunk->forced; }
+
+const Thunk* Shared::binding() const
+{ return thunk.get(); }
+
+Expression::Ptr Shared::value() const
+{ return TreeOps::copy(thunk->term); }
+
+Focus::Focus(Expression::Ptr& root, EvaluationStrategy strat)
+  : strat(reduction_order(strat)), work { { &root, Phase::Enter, 0, false } }, path()
+{  }
+
+Focus::Focus(Statement& stmt, EvaluationStrategy strat)
+  : strat(reduction_order(strat)), work(), path()
+{
+  if(auto def = dynamic_cast<Definition*>(&stmt); def && def->body)
+    work.push_back({ &def->body, Phase::Enter, 0, false });
+}
+
+bool Focus::step()
+{
+  // the first contraction ends the search
+  while(!work.empty())
   {
-    SymbolSet FV; with->fv(FV); 
-    while(FV.find(binding->id()) != FV.end())
-    { 
-      // our binding occurs as free variable in what, so we change it!
-      auto new_binding = std::make_shared<Identifier>(binding->source_range(), (binding->id().get_string() + "\'").c_str());
-      body->replace(binding, new_binding);
-      binding = new_binding;
+    const Item item = work.back();
+    work.pop_back();
+    path.resize(item.depth);
+    path.push_back({ item.slot, work.size(), item.weak });
+    const std::size_t below = path.size();
+
+    TreeOps::expose(*item.slot);
+    Expression* node = item.slot->get();
+    if(node->kind() == ExpressionKind::Let)
+    {
+      auto let = static_cast<Let*>(node);
+      // call-by-value evaluates the bound term first, like the argument of a β-redex
+      if(eager() && item.phase == Phase::Enter)
+      {
+        work.push_back({ item.slot, Phase::Head, item.depth, item.weak });
+        work.push_back({ &let->bound, Phase::Enter, below, item.weak });
+        continue;
+      }
+      *item.slot = let->contract(eager());
+      refocus();
+      return true;
+    }
+    if(node->kind() == ExpressionKind::Shared)
+    {
+      auto ref = static_cast<Shared*>(node);
+      if(item.phase == Phase::Force)
+        ref->thunk->forced = true;
+      if(!ref->thunk->forced)
+      {
+        // the first use reduces the term where it is, the other references see the result
+        work.push_back({ item.slot, Phase::Force, item.depth, item.weak });
+        work.push_back({ &ref->thunk->term, Phase::Enter, below, true });
+        continue;
+      }
+      // not a contraction, but the copy may form a redex with the nodes above
+      *item.slot = ref->value();
+      refocus();
+      continue;
+    }
+    if(node->kind() == ExpressionKind::LetRec)
+    {
+      *item.slot = static_cast<LetRec*>(node)->contract();
+      refocus();
+      return true;
+    }
+    if(node->kind() == ExpressionKind::Recursive)
+    {
+      // a recursive function is a value until it is applied, anything else is unfolded by itself
+      auto ref = static_cast<Recursive*>(node);
+      if(ref->is_function())
+        continue;
+      Profiler::Step step(ref->origin());
+      ++contractions;
+      *item.slot = ref->unfold();
+      refocus();
+      return true;
+    }
+    if(node->kind() == ExpressionKind::Case)
+    {
+      auto match = static_cast<Case*>(node);
+      if(item.phase == Phase::Enter)
+      {
+        // only the tag of the scrutinee is needed to pick an alternative
+        work.push_back({ item.slot, Phase::Head, item.depth, item.weak });
+        work.push_back({ &match->scrutinee, Phase::Enter, below, true });
+        continue;
+      }
+      TreeOps::expose(match->scrutinee);
+      if(match->scrutinee->kind() == ExpressionKind::Constructor
+         && static_cast<Constructor*>(match->scrutinee.get())->is_saturated())
+      {
+        if(auto result = match->contract())
+        {
+          *item.slot = std::move(result);
+          refocus();
+          return true;
+        }
+      }
+      // stuck, normal forms still need the parts reduced
+      if(into_arguments(item.weak))
+      {
+        for(auto it = match->alts.rbegin(); it != match->alts.rend(); ++it)
+          work.push_back({ &it->body, Phase::Enter, below, false });
+        work.push_back({ &match->scrutinee, Phase::Enter, below, false });
+      }
+      continue;
+    }
+    if(node->kind() == ExpressionKind::Constructor)
+    {
+      if(into_arguments(item.weak))
+      {
+        auto& fields = static_cast<Constructor*>(node)->con_fields;
+        for(auto it = fields.rbegin(); it != fields.rend(); ++it)
+          work.push_back({ &*it, Phase::Enter, below, false });
+      }
+      continue;
+    }
+    if(node->kind() == ExpressionKind::Lambda)
+    {
+      if(under_binders(item.weak))
+        work.push_back({ &static_cast<Lambda*>(node)->body, Phase::Enter, below, false });
+      continue;
+    }
+    if(node->kind() != ExpressionKind::FunctionCall)
+      continue;
+
+    auto call = static_cast<FunctionCall*>(node);
+    TreeOps::expose_spine(*call);
+    if(item.phase == Phase::Enter && reduce_strict_arguments(*call, item, below))
+      continue;
+    const Phase phase = item.phase == Phase::Strict ? Phase::Head : item.phase;
+    if(phase == Phase::Enter && eager() && !call->is_lazy_operand())
+    {
+      // we first need to fully reduce our argument
+      work.push_back({ item.slot, Phase::Head, item.depth, item.weak });
+      work.push_back({ &call->arg, Phase::Enter, below, item.weak });
+      continue;
+    }
+    if(phase == Phase::Enter || phase == Phase::Head)
+    {
+      if(ChurchEncoding::enabled())
+      {
+        Expression::Ptr* operand = nullptr;
+        if(auto result = call->accelerate(strat, operand))
+        {
+          *item.slot = result;
+          refocus();
+          return true;
+        }
+        if(operand)
+        {
+          work.push_back({ item.slot, Phase::ChurchOperand, item.depth, item.weak });
+          work.push_back({ operand, Phase::Enter, below, item.weak });
+          continue;
+        }
+      }
+    }
+    else if(phase == Phase::ChurchOperand)
+      call->expand_church();
+
+    if(phase != Phase::DeltaOperand)
+    {
+      // unfolding the recursive function is part of the β-step applying it
+      if(call->fn->kind() == ExpressionKind::Recursive && static_cast<Recursive*>(call->fn.get())->is_function())
+      {
+        call->fn = static_cast<Recursive*>(call->fn.get())->unfold();
+        TreeOps::expose(call->fn);
+      }
+      // a constructor takes its fields one argument at a time, this is not a contraction
+      if(call->fn->kind() == ExpressionKind::Constructor && !static_cast<Constructor*>(call->fn.get())->is_saturated())
+      {
+        auto con = static_cast<Constructor*>(call->fn.get());
+        con->free_summary |= call->arg->free_bits();
+        con->con_fields.push_back(std::move(call->arg));
+        *item.slot = std::move(call->fn);
+        refocus();
+        continue;
+      }
+      // the argument is in normal form if required by the strategy, so we may β-reduce
+      if(call->fn->kind() == ExpressionKind::Lambda)
+      {
+        *item.slot = call->contract(std::static_pointer_cast<Lambda>(call->fn));
+        refocus();
+        return true;
+      }
+
+      Expression::Ptr* operand = nullptr;
+      if(auto result = call->delta(operand))
+      {
+        *item.slot = result;
+        refocus();
+        return true;
+      }
+      if(operand)
+      {
+        work.push_back({ item.slot, Phase::DeltaOperand, item.depth, item.weak });
+        work.push_back({ operand, Phase::Enter, below, item.weak });
+        continue;
+      }
     }
-    auto is_var = std::dynamic_pointer_cast<Identifier>(body);
-    if(!is_var)
-      body->replace(what, with);
     else
-    { 
-      if(is_var->id() == what->id())
-        body = with;
+    {
+      // stuck on an operand that was just reduced, only the ones after it are left; walking the
+      // spine again would revisit it once per level of nested stuck primitives
+      if(into_arguments(item.weak))
+      {
+        std::array<Expression::Ptr*, Primitive::max_arity> args;
+        std::size_t count;
+        auto prim = call->applied_primitive(args, count);
+        std::size_t stuck = 0;
+        while(stuck < count && (*args[stuck])->kind() == ExpressionKind::Integer)
+          ++stuck;
+        for(std::size_t i = count; prim && i-- > stuck + 1; )
+        {
+          if(!eager() || i >= prim->strict_arity())
+            work.push_back({ args[i], Phase::Enter, below, false });
+        }
+      }
+      continue;
     }
+
+    // leftmost redex first, the argument only once the function is in normal form; eager
+    // strategies already reduced it before the call, pushing it again doubles the work per level
+    if(into_arguments(item.weak) && (!eager() || call->is_lazy_operand()))
+      work.push_back({ &call->arg, Phase::Enter, below, false });
+    work.push_back({ &call->fn, Phase::Enter, below, item.weak });
   }
+  path.clear();
+  return false;
 }
 
-Expression::Ptr Lambda::reduce_step_normal()
+bool Focus::eager() const
+{ return strat == EvaluationStrategy::CallByValue || strat == EvaluationStrategy::Applicative; }
+
+bool Focus::under_binders(bool weak) const
 {
-  body = body->reduce_step_normal();
-  return shared_from_this();
+  return !weak && (strat == EvaluationStrategy::Normal || strat == EvaluationStrategy::Applicative
+                   || strat == EvaluationStrategy::HeadNormal);
 }
 
-Expression::Ptr Lambda::reduce_step_callbyname()
-{ return shared_from_this(); }
+bool Focus::into_arguments(bool weak) const
+{ return !weak && (strat == EvaluationStrategy::Normal || strat == EvaluationStrategy::Applicative); }
 
-Expression::Ptr Lambda::reduce_step_callbyvalue()
-{ return shared_from_this(); }
+bool Focus::reduce_strict_arguments(FunctionCall& call, const Item& item, std::size_t below)
+{
+  if(eager() || !strictness_marked())
+    return false;
+  // only the outermost call of a spine has all of the arguments, the inner ones were looked at with it
+  if(item.depth > 0)
+  {
+    const Expression* parent = path[item.depth - 1].slot->get();
+    if(parent->kind() == ExpressionKind::FunctionCall && &static_cast<const FunctionCall*>(parent)->fn == item.slot)
+      return false;
+  }
 
+  std::size_t count = 1;
+  FunctionCall* spine = &call;
+  for(; ; ++count)
+  {
+    TreeOps::expose(spine->fn);
+    if(spine->fn->kind() != ExpressionKind::FunctionCall)
+      break;
+    spine = static_cast<FunctionCall*>(spine->fn.get());
+  }
+  const Expression* fn = spine->fn.get();
+  if(fn->kind() == ExpressionKind::Recursive && static_cast<const Recursive*>(fn)->is_function())
+  {
+    fn = static_cast<const Recursive*>(fn)->term().get();
+    while(fn->kind() == ExpressionKind::Substitution)
+      fn = static_cast<const Substitution*>(fn)->sub_body().get();
+  }
+  if(fn->kind() != ExpressionKind::Lambda)
+    return false;
+  auto lambda = static_cast<const Lambda*>(fn);
+  // a partial application is a value, it doesn't evaluate anything yet
+  if(lambda->strict_arity() == 0 || lambda->strict_arity() > count)
+    return false;
+
+  // the arguments the λ binds are the innermost ones, collected from the outermost one
+  std::vector<Expression::Ptr*> args;
+  spine = &call;
+  for(std::size_t i = 0; ; ++i)
+  {
+    if(i >= count - lambda->strict_arity())
+      args.push_back(&spine->arg);
+    if(i + 1 == count)
+      break;
+    spine = static_cast<FunctionCall*>(spine->fn.get());
+  }
+  std::vector<Expression::Ptr*> strict;
+  for(std::size_t i = 0; i < lambda->strict_arity() && i < 64; ++i)
+  {
+    Expression::Ptr& arg = *args[args.size() - 1 - i];
+    if(!(lambda->strict_params() & (std::uint64_t(1) << i)))
+      continue;
+    TreeOps::expose(arg);
+    switch(arg->kind())
+    {
+    default: strict.push_back(&arg); break;
+
+    case ExpressionKind::Lambda:
+    case ExpressionKind::Integer:
+    case ExpressionKind::Primitive:
+    case ExpressionKind::Church:
+    case ExpressionKind::Constructor:
+    case ExpressionKind::Identifier:
+    case ExpressionKind::Error: break;
+    }
+  }
+  if(strict.empty())
+    return false;
+
+  // evaluating them first can't diverge where the call wouldn't, the call needs their values anyway
+  work.push_back({ item.slot, Phase::Strict, item.depth, item.weak });
+  for(auto it = strict.rbegin(); it != strict.rend(); ++it)
+    work.push_back({ *it, Phase::Enter, below, true });
+  return true;
+}
+
+void Focus::refocus()
+{
+  // A node looks at most three levels down (the spine of a primitive), so ancestors further up
+  // than that make the same choices as before and the alternatives they left pending still hold.
+  constexpr std::size_t reach = 3;
+  const std::size_t at = path.size() > reach ? path.size() - 1 - reach : 0;
+  const Frame frame = path[at];
+
+  work.resize(frame.pending);
+  path.resize(at);
+  work.push_back({ frame.slot, Phase::Enter, at, frame.weak });
+}
@@ -0,0 +1,303 @@
+#include <church.hpp>
+
+#include <limits>
+#include <vector>
+
+namespace
+{
+constexpr std::uint64_t no_value = std::numeric_limits<std::uint64_t>::max();
+
+bool checked_mul(std::uint64_t lhs, std::uint64_t rhs, std::uint64_t& result)
+{
+  if(lhs != 0 && rhs > std::numeric_limits<std::uint64_t>::max() / lhs)
+    return false;
+  result = lhs * rhs;
+  return true;
+}
+
+bool checked_pow(std::uint64_t base, std::uint64_t exponent, std::uint64_t& result)
+{
+  result = 1;
+  for(; exponent > 0; --exponent)
+  {
+    if(!checked_mul(result, base, result))
+      return false;
+    // 0 and 1 stay put, everything else overflows within 64 rounds
+    if(result <= 1)
+      break;
+  }
+  return true;
+}
+
+std::uint64_t numeral_value(const Expression::Ptr& expr)
+{
+  auto is_church = std::dynamic_pointer_cast<Church>(expr);
+  if(!is_church || is_church->form() != ChurchForm::Numeral)
+    return no_value;
+  return is_church->value();
+}
+
+Identifier::Ptr var(SourceRange loc, const char* name)
+{ return std::make_shared<Identifier>(loc, Symbol(name)); }
+
+Expression::Ptr app(SourceRange loc, Expression::Ptr fn, Expression::Ptr arg)
+{ return std::make_shared<FunctionCall>(loc, fn, arg); }
+
+Expression::Ptr lam(SourceRange loc, const char* binding, Expression::Ptr body)
+{ return std::make_shared<Lambda>(loc, var(loc, binding), body); }
+
+bool is_var(const Expression::Ptr& expr, Symbol sym)
+{
+  return expr->kind() == ExpressionKind::Identifier && static_cast<const Identifier*>(expr.get())->id() == sym;
+}
+
+bool is_app(const Expression::Ptr& expr, Symbol fn, Symbol arg)
+{
+  if(expr->kind() != ExpressionKind::FunctionCall)
+    return false;
+  auto call = static_cast<const FunctionCall*>(expr.get());
+  return is_var(call->fn_expr(), fn) && is_var(call->arg_expr(), arg);
+}
+
+const FunctionCall* as_app(const Expression::Ptr& expr)
+{
+  if(expr->kind() != ExpressionKind::FunctionCall)
+    return nullptr;
+  return static_cast<const FunctionCall*>(expr.get());
+}
+}
+
+Church::Church(SourceRange loc, ChurchForm form, std::uint64_t value)
+  : Expression(loc), church_form(form), val(value)
+{  }
+
+Expression::Ptr Church::clone()
+{
+  return keep_origin(std::make_shared<Church>(source_range(), church_form, val));
+}
+
+ExpressionKind Church::kind() const
+{ return ExpressionKind::Church; }
+
+ChurchForm Church::form() const
+{ return church_form; }
+
+std::uint64_t Church::value() const
+{ return val; }
+
+std::string Church::name() const
+{
+  switch(church_form)
+  {
+  default:
+  case ChurchForm::Numeral: return "#" + std::to_string(val);
+  case ChurchForm::True: return "#true";
+  case ChurchForm::Succ: return "#succ";
+  case ChurchForm::Plus: return "#plus";
+  case ChurchForm::Mult: return "#mult";
+  case ChurchForm::Exp: return "#exp";
+  }
+}
+
+std::size_t Church::arity() const
+{
+  switch(church_form)
+  {
+  default:
+  case ChurchForm::True: return 0;
+
+  case ChurchForm::Numeral:
+  case ChurchForm::Succ: return 1;
+
+  case ChurchForm::Plus:
+  case ChurchForm::Mult:
+  case ChurchForm::Exp: return 2;
+  }
+}
+
+Expression::Ptr Church::apply(SourceRange loc, const std::array<Expression::Ptr*, Primitive::max_arity>& args) const
+{
+  std::uint64_t operands[max_arity];
+  for(std::size_t i = 0; i < arity(); ++i)
+    if((operands[i] = numeral_value(*args[i])) == no_value)
+      return nullptr;
+
+  std::uint64_t result = 0;
+  switch(church_form)
+  {
+  default:
+  case ChurchForm::True: return nullptr;
+
+  case ChurchForm::Numeral:
+    if(!checked_pow(operands[0], val, result))
+      return nullptr;
+    break;
+  case ChurchForm::Succ:
+    if((result = operands[0] + 1) == no_value)
+      return nullptr;
+    break;
+  case ChurchForm::Plus:
+    if((result = operands[0] + operands[1]) < operands[0] || result == no_value)
+      return nullptr;
+    break;
+  case ChurchForm::Mult:
+    if(!checked_mul(operands[0], operands[1], result) || result == no_value)
+      return nullptr;
+    break;
+  case ChurchForm::Exp:
+    if(!checked_pow(operands[0], operands[1], result) || result == no_value)
+      return nullptr;
+    break;
+  }
+  return std::make_shared<Church>(loc, ChurchForm::Numeral, result);
+}
+
+Expression::Ptr Church::expand()
+{
+  const SourceRange loc = source_range();
+  switch(church_form)
+  {
+  default:
+  case ChurchForm::Numeral:
+    {
+      Expression::Ptr body = var(loc, "x");
+      for(std::uint64_t i = 0; i < val; ++i)
+        body = app(loc, var(loc, "f"), body);
+      return lam(loc, "f", lam(loc, "x", body));
+    }
+  case ChurchForm::True:
+    return lam(loc, "t", lam(loc, "f", var(loc, "t")));
+  case ChurchForm::Succ:
+    return lam(loc, "n", lam(loc, "f", lam(loc, "x",
+             app(loc, var(loc, "f"), app(loc, app(loc, var(loc, "n"), var(loc, "f")), var(loc, "x"))))));
+  case ChurchForm::Plus:
+    return lam(loc, "m", lam(loc, "n", lam(loc, "f", lam(loc, "x",
+             app(loc, app(loc, var(loc, "m"), var(loc, "f")),
+                      app(loc, app(loc, var(loc, "n"), var(loc, "f")), var(loc, "x")))))));
+  case ChurchForm::Mult:
+    return lam(loc, "m", lam(loc, "n", lam(loc, "f",
+             app(loc, var(loc, "m"), app(loc, var(loc, "n"), var(loc, "f"))))));
+  case ChurchForm::Exp:
+    return lam(loc, "m", lam(loc, "n", app(loc, var(loc, "n"), var(loc, "m"))));
+  }
+}
+
+bool ChurchEncoding::is_enabled = false;
+
+void ChurchEncoding::enable()
+{ is_enabled = true; }
+
+bool ChurchEncoding::enabled()
+{ return is_enabled; }
+
+void ChurchEncoding::encode(Statement& stmt)
+{
+  if(auto def = dynamic_cast<Definition*>(&stmt); def && def->body)
+    encode(def->body);
+}
+
+void ChurchEncoding::encode(Expression::Ptr& root)
+{
+  std::vector<Expression::Ptr*> work { &root };
+  while(!work.empty())
+  {
+    Expression::Ptr* slot = work.back();
+    work.pop_back();
+
+    if(auto church = match(*slot))
+    {
+      *slot = church;
+      continue;
+    }
+    switch((*slot)->kind())
+    {
+    default: break;
+
+    case ExpressionKind::FunctionCall:
+      work.push_back(&static_cast<FunctionCall*>(slot->get())->arg);
+      work.push_back(&static_cast<FunctionCall*>(slot->get())->fn);
+      break;
+
+    case ExpressionKind::Lambda:
+      work.push_back(&static_cast<Lambda*>(slot->get())->body);
+      break;
+    }
+  }
+}
+
+Church::Ptr ChurchEncoding::match(const Expression::Ptr& expr)
+{
+  // collect up to four distinct binders of nested λs
+  const Identifier* binders[4];
+  std::size_t count = 0;
+  const Expression::Ptr* body = &expr;
+  while(count < 4 && (*body)->kind() == ExpressionKind::Lambda)
+  {
+    auto fn = static_cast<const Lambda*>(body->get());
+    for(std::size_t i = 0; i < count; ++i)
+      if(binders[i]->id() == fn->fn_binding()->id())
+        return nullptr;
+    binders[count++] = fn->fn_binding().get();
+    body = &fn->body;
+  }
+  if(count < 2)
+    return nullptr;
+
+  const SourceRange loc = expr->source_range();
+  const Expression::Ptr& b = *body;
+  // the innermost two binders, a numeral is λf. λx. f (f … x)
+  const Symbol f = binders[count - 2]->id(), x = binders[count - 1]->id();
+  if(count == 2)
+  {
+    if(is_var(b, f))
+      return std::make_shared<Church>(loc, ChurchForm::True);
+    if(is_app(b, x, f))
+      return std::make_shared<Church>(loc, ChurchForm::Exp);
+
+    std::uint64_t n = 0;
+    const Expression::Ptr* it = &b;
+    while(auto call = as_app(*it))
+    {
+      if(!is_var(call->fn_expr(), f))
+        return nullptr;
+      it = &call->arg_expr();
+      ++n;
+    }
+    if(is_var(*it, x))
+      return std::make_shared<Church>(loc, ChurchForm::Numeral, n);
+    return nullptr;
+  }
+
+  if(count == 3)
+  {
+    const Symbol a = binders[0]->id();
+    // succ: λn. λf. λx. f (n f x)  or  λn. λf. λx. n f (f x)
+    if(auto call = as_app(b))
+    {
+      if(is_var(call->fn_expr(), f))
+        if(auto inner = as_app(call->arg_expr()); inner && is_app(inner->fn_expr(), a, f) && is_var(inner->arg_expr(), x))
+          return std::make_shared<Church>(loc, ChurchForm::Succ);
+      if(is_app(call->fn_expr(), a, f) && is_app(call->arg_expr(), f, x))
+        return std::make_shared<Church>(loc, ChurchForm::Succ);
+    }
+    // mult: λm. λn. λf. m (n f)
+    const Symbol m = binders[0]->id(), n = binders[1]->id(), g = binders[2]->id();
+    if(auto call = as_app(b); call && is_var(call->fn_expr(), m) && is_app(call->arg_expr(), n, g))
+      return std::make_shared<Church>(loc, ChurchForm::Mult);
+    return nullptr;
+  }
+
+  const Symbol m = binders[0]->id(), n = binders[1]->id();
+  if(auto call = as_app(b))
+  {
+    // plus: λm. λn. λf. λx. m f (n f x)
+    if(is_app(call->fn_expr(), m, f))
+      if(auto inner = as_app(call->arg_expr()); inner && is_app(inner->fn_expr(), n, f) && is_var(inner->arg_expr(), x))
+        return std::make_shared<Church>(loc, ChurchForm::Plus);
+    // mult: λm. λn. λf. λx. m (n f) x
+    if(is_var(call->arg_expr(), x))
+      if(auto inner = as_app(call->fn_expr()); inner && is_var(inner->fn_expr(), m) && is_app(inner->arg_expr(), n, f))
+        return std::make_shared<Church>(loc, ChurchForm::Mult);
+  }
+  return nullptr;
+}
@@ -0,0 +1,428 @@
+#include <combinator.hpp>
+
+#include <algorithm>
+#include <limits>
+
+namespace
+{
+constexpr CellRef no_cell = std::numeric_limits<CellRef>::max();
+
+void link(Heap& heap, CellRef parent, bool second, CellRef child, CellRef& result)
+{
+  if(parent == no_cell)
+    result = child;
+  else if(second)
+    heap.set_second(parent, child);
+  else
+    heap.set_first(parent, child);
+}
+}
+
+bool lift(Heap& heap, const Expression& root, CombinatorProgram& out)
+{
+  // a combinator whose body is still being emitted
+  struct Open
+  {
+    std::vector<Cell> code;
+    // binders of the enclosing λs have the levels below
+    std::uint32_t first_level;
+    std::vector<Symbol> names;
+    // levels of enclosing binders the body refers to
+    std::vector<std::uint32_t> captured;
+  };
+  std::vector<Open> open(1);
+  open.back().first_level = 0;
+  // binders enclosing the current node by level, outermost first
+  std::vector<Symbol> scope;
+  std::vector<std::pair<const Expression*, bool>> work { { &root, false } };
+  while(!work.empty())
+  {
+    auto [node, leaving] = work.back();
+    work.pop_back();
+
+    Open& current = open.back();
+    const std::uint32_t loc = heap.add_location(node->source_range());
+    switch(node->kind())
+    {
+    default:
+      return false;
+
+    case ExpressionKind::Identifier:
+      {
+        const Symbol sym = static_cast<const Identifier*>(node)->id();
+        auto it = std::find(scope.rbegin(), scope.rend(), sym);
+        if(it == scope.rend())
+        {
+          current.code.push_back({ CellKind::Free, heap.intern(sym), 0, loc });
+          break;
+        }
+        const auto level = static_cast<std::uint32_t>(scope.rend() - it - 1);
+        current.code.push_back({ CellKind::Var, level, 0, loc });
+        if(level < current.first_level)
+          current.captured.push_back(level);
+      } break;
+
+    case ExpressionKind::Integer:
+      current.code.push_back(int_cell(static_cast<const Integer*>(node)->value(), loc));
+      break;
+
+    case ExpressionKind::Primitive:
+      {
+        const auto op = static_cast<const Primitive*>(node)->op();
+        current.code.push_back({ CellKind::Prim, static_cast<std::uint32_t>(op), 0, loc });
+      } break;
+
+    case ExpressionKind::FunctionCall:
+      {
+        if(leaving)
+        {
+          current.code.push_back({ CellKind::App, 0, 0, loc });
+          break;
+        }
+        auto call = static_cast<const FunctionCall*>(node);
+        work.push_back({ node, true });
+        work.push_back({ call->arg_expr().get(), false });
+        work.push_back({ call->fn_expr().get(), false });
+      } break;
+
+    case ExpressionKind::Lambda:
+      {
+        if(!leaving)
+        {
+          // directly nested λs become parameters of the same combinator
+          Open inner;
+          inner.first_level = static_cast<std::uint32_t>(scope.size());
+          const Expression* body = node;
+          for(; body->kind() == ExpressionKind::Lambda; body = static_cast<const Lambda*>(body)->fn_body().get())
+          {
+            inner.names.push_back(static_cast<const Lambda*>(body)->fn_binding()->id());
+            scope.push_back(inner.names.back());
+          }
+          open.push_back(std::move(inner));
+          work.push_back({ node, true });
+          work.push_back({ body, false });
+          break;
+        }
+
+        Open done = std::move(open.back());
+        open.pop_back();
+        std::sort(done.captured.begin(), done.captured.end());
+        done.captured.erase(std::unique(done.captured.begin(), done.captured.end()), done.captured.end());
+
+        Supercombinator sc;
+        sc.captured = done.captured.size();
+        for(std::uint32_t level : done.captured)
+          sc.params.push_back(scope[level]);
+        sc.params.insert(sc.params.end(), done.names.begin(), done.names.end());
+        // levels become parameter positions
+        for(Cell& cell : done.code)
+        {
+          if(cell.kind != CellKind::Var)
+            continue;
+          if(cell.a < done.first_level)
+            cell.a = static_cast<std::uint32_t>(std::lower_bound(done.captured.begin(), done.captured.end(), cell.a)
+                                                - done.captured.begin());
+          else
+            cell.a = static_cast<std::uint32_t>(sc.captured + cell.a - done.first_level);
+        }
+        sc.body = std::move(done.code);
+        scope.erase(scope.begin() + done.first_level, scope.end());
+
+        // the λ itself turns into the combinator applied to the variables it captures
+        Open& parent = open.back();
+        parent.code.push_back({ CellKind::Comb, static_cast<std::uint32_t>(out.combinators.size()), 0, loc });
+        for(std::uint32_t level : done.captured)
+        {
+          parent.code.push_back({ CellKind::Var, level, 0, loc });
+          parent.code.push_back({ CellKind::App, 0, 0, loc });
+          if(level < parent.first_level)
+            parent.captured.push_back(level);
+        }
+        out.combinators.push_back(std::move(sc));
+      } break;
+    }
+  }
+  out.main = std::move(open.back().code);
+  return true;
+}
+
+GraphReducer::GraphReducer(Heap& heap, const CombinatorProgram& program, EvaluationStrategy strat,
+                           std::uint_fast64_t budget)
+  : heap(heap), program(program), strat(reduction_order(strat)), budget(budget), count(0), stopped(false),
+    stack(), frames(), pending(), items(), operands(), values()
+{
+  heap.add_roots(&stack);
+  heap.add_roots(&pending);
+}
+
+GraphReducer::~GraphReducer()
+{
+  heap.remove_roots(&pending);
+  heap.remove_roots(&stack);
+}
+
+std::uint_fast64_t GraphReducer::steps() const
+{ return count; }
+
+bool GraphReducer::exhausted() const
+{ return stopped; }
+
+CellRef GraphReducer::run(Heap& out)
+{
+  operands.clear();
+  pending.assign(1, instantiate(program.main));
+  items.assign(1, { no_cell, false, 0, true });
+
+  // Builds the result top down. Each item reads back one cell: the head of its spine and the
+  // arguments, which become items of their own.
+  CellRef result = no_cell;
+  std::vector<CellRef> spine;
+  while(!items.empty())
+  {
+    Item item = items.back();
+    items.pop_back();
+    CellRef cell = pending.back();
+    pending.pop_back();
+    const bool evaluated = item.evaluate && !stopped;
+    if(evaluated)
+      cell = whnf(cell);
+
+    // the applications around the head, outermost first
+    spine.clear();
+    for(cell = resolve(cell); heap.kind(cell) == CellKind::App; cell = resolve(heap.first(cell)))
+      spine.push_back(cell);
+    const Cell head = heap.get(cell);
+
+    // A combinator is read back as a λ with its captured variables filled in. Once it is in weak
+    // head normal form, the arguments of a partial application are filled in as well.
+    const Supercombinator* sc = head.kind == CellKind::Comb ? &program.combinators[head.a] : nullptr;
+    std::size_t given = 0;
+    if(sc)
+      given = evaluated && spine.size() < sc->params.size() ? spine.size() : std::min(spine.size(), sc->captured);
+    // under call-by-name nothing but the head is reduced
+    const bool evaluate_arguments = item.evaluate && strat != EvaluationStrategy::CallByName;
+    for(std::size_t i = 0; i < spine.size() - given; ++i)
+    {
+      const CellRef app = out.alloc({ CellKind::App, 0, 0, out.add_location(heap.location(heap.get(spine[i]).loc)) });
+      link(out, item.parent, item.second, app, result);
+      pending.push_back(resolve(heap.second(spine[i])));
+      items.push_back({ app, true, item.depth, evaluate_arguments });
+      item.parent = app;
+      item.second = false;
+    }
+
+    const std::uint32_t loc = out.add_location(heap.location(head.loc));
+    CellRef made = no_cell;
+    switch(head.kind)
+    {
+    default:
+      made = out.alloc({ head.kind, head.a, head.b, loc });
+      break;
+
+    case CellKind::Var:
+      made = out.alloc({ CellKind::Var, item.depth - 1 - head.a, 0, loc });
+      break;
+
+    case CellKind::Free:
+      made = out.alloc({ CellKind::Free, out.intern(heap.name(head.a)), 0, loc });
+      break;
+
+    case CellKind::Comb:
+      {
+        operands.clear();
+        for(std::size_t i = 0; i < given; ++i)
+          operands.push_back(resolve(heap.second(spine[spine.size() - 1 - i])));
+        // the binders of the parameters still missing
+        for(std::size_t i = given; i < sc->params.size(); ++i)
+        {
+          const CellRef lam = out.alloc({ CellKind::Lam, 0, out.intern(sc->params[i]), loc });
+          link(out, item.parent, item.second, lam, result);
+          operands.push_back(heap.alloc({ CellKind::Var, item.depth, 0, head.loc }));
+          item = { lam, false, item.depth + 1, item.evaluate };
+        }
+        pending.push_back(instantiate(sc->body));
+        items.push_back({ item.parent, false, item.depth, item.evaluate && strat == EvaluationStrategy::Normal });
+      } continue;
+    }
+    link(out, item.parent, item.second, made, result);
+  }
+  return result;
+}
+
+CellRef GraphReducer::whnf(CellRef root)
+{
+  stack.assign(1, root);
+  frames.assign(1, { 0, 0 });
+  while(!stopped)
+  {
+    const CellRef top = resolve(stack.back());
+    stack.back() = top;
+
+    bool progress = false;
+    switch(heap.kind(top))
+    {
+    default: break;
+
+    case CellKind::App:
+      {
+        // skips indirections for good, the next unwinding goes straight to the value
+        const CellRef fn = resolve(heap.first(top));
+        heap.set_first(top, fn);
+        stack.push_back(fn);
+        progress = true;
+      } break;
+
+    case CellKind::Comb:
+      progress = apply_combinator(top);
+      break;
+
+    case CellKind::Prim:
+      progress = apply_primitive(top);
+      break;
+    }
+    if(progress)
+    {
+      if(heap.should_collect())
+        heap.collect();
+      continue;
+    }
+
+    // the root of the frame is in weak head normal form
+    if(frames.size() == 1)
+      break;
+    stack.resize(frames.back().base);
+    frames.pop_back();
+  }
+  const CellRef result = resolve(stack.front());
+  stack.clear();
+  return result;
+}
+
+bool GraphReducer::apply_combinator(CellRef head)
+{
+  const Supercombinator& sc = program.combinators[heap.first(head)];
+  const std::size_t arity = sc.params.size();
+  const std::size_t top = stack.size() - 1;
+  if(top - frames.back().base < arity)
+    return false;
+  // call-by-value passes arguments in weak head normal form
+  if(strat == EvaluationStrategy::CallByValue && !force_arguments(arity))
+    return true;
+  if(!may_step())
+    return false;
+
+  update(stack[top - arity], arity, sc.body);
+  stack.resize(top - arity + 1);
+  frames.back().done = 0;
+  return true;
+}
+
+bool GraphReducer::apply_primitive(CellRef head)
+{
+  const auto op = static_cast<PrimitiveOp>(heap.first(head));
+  const std::size_t arity = Primitive::arity(op);
+  const std::size_t top = stack.size() - 1;
+  if(top - frames.back().base < arity)
+    return false;
+  if(!force_arguments(Primitive::strict_arity(op)))
+    return true;
+  for(std::size_t i = 0; i < Primitive::strict_arity(op); ++i)
+    if(heap.kind(argument(i)) != CellKind::Int)
+      return false;
+
+  const CellRef redex = stack[top - arity];
+  const std::int64_t lhs = heap.value(argument(0));
+  if(op == PrimitiveOp::IfZero)
+  {
+    if(!may_step())
+      return false;
+    heap.set(redex, { CellKind::Ind, argument(lhs == 0 ? 1 : 2), 0, heap.get(redex).loc });
+  }
+  else
+  {
+    std::int64_t result = 0;
+    if(!Primitive::compute(op, lhs, heap.value(argument(1)), result) || !may_step())
+      return false;
+    heap.set(redex, int_cell(result, heap.get(redex).loc));
+  }
+  stack.resize(top - arity + 1);
+  frames.back().done = 0;
+  return true;
+}
+
+bool GraphReducer::force_arguments(std::size_t count)
+{
+  // arguments that are not applications can't be reduced any further
+  for(Frame& frame = frames.back(); frame.done < count; )
+  {
+    const CellRef arg = argument(frame.done++);
+    if(heap.kind(arg) == CellKind::App)
+    {
+      frames.push_back({ stack.size(), 0 });
+      stack.push_back(arg);
+      return false;
+    }
+  }
+  return true;
+}
+
+CellRef GraphReducer::argument(std::size_t i) const
+{ return resolve(heap.second(stack[stack.size() - 2 - i])); }
+
+bool GraphReducer::may_step()
+{
+  if(budget && count >= budget)
+  {
+    stopped = true;
+    return false;
+  }
+  ++count;
+  return true;
+}
+
+void GraphReducer::update(CellRef redex, std::size_t arity, const std::vector<Cell>& body)
+{
+  operands.clear();
+  for(std::size_t i = 0; i < arity; ++i)
+    operands.push_back(argument(i));
+  const CellRef result = instantiate(body);
+
+  // an argument may be shared, so the redex refers to it; a fresh root is just moved into the redex
+  if(body.back().kind == CellKind::Var)
+    heap.set(redex, { CellKind::Ind, result, 0, heap.get(redex).loc });
+  else
+    heap.set(redex, heap.get(result));
+}
+
+CellRef GraphReducer::instantiate(const std::vector<Cell>& body)
+{
+  values.clear();
+  for(const Cell& node : body)
+  {
+    switch(node.kind)
+    {
+    default:
+      values.push_back(heap.alloc(node));
+      break;
+
+    case CellKind::Var:
+      values.push_back(operands[node.a]);
+      break;
+
+    case CellKind::App:
+      {
+        const CellRef arg = values.back();
+        values.pop_back();
+        values.back() = heap.alloc({ CellKind::App, values.back(), arg, node.loc });
+      } break;
+    }
+  }
+  return values.back();
+}
+
+CellRef GraphReducer::resolve(CellRef ref) const
+{
+  while(heap.kind(ref) == CellKind::Ind)
+    ref = heap.first(ref);
+  return ref;
+}
@@ -0,0 +1,850 @@
+#include <emit_c.hpp>
+#include <combinator.hpp>
+
+#include <string>
+
+namespace
+{
+// Cells, allocation and the collector's spaces. Generated code between the two halves of the
+// runtime only calls alloc, which never collects; callers reserve the cells beforehand.
+constexpr const char* runtime_head = R"C(#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint32_t ref;
+
+/* APP a: function, b: argument    COMB a: combinator    FREE a: name    INT a, b: low and high half
+   PRIM a: operator                VAR a: level of a variable introduced while reading back
+   IND a: the value of an updated redex                  LAM a: body, b: name (results only) */
+enum { APP, COMB, FREE, INT, PRIM, VAR, IND, LAM, MOVED };
+enum { ADD, SUB, MUL, DIV, LESS, IFZ };
+
+#define NO_CELL UINT32_MAX
+
+struct combinator
+{
+  uint32_t arity;
+  /* number of cells the body allocates */
+  uint32_t cells;
+  /* the body is one of the parameters */
+  int forwards;
+  ref (*build)(const ref* x);
+  const uint32_t* params;
+};
+
+struct entry
+{
+  const char* prefix;
+  uint32_t cells;
+  ref (*build)(const ref* x);
+};
+
+static unsigned char* kinds;
+static uint32_t* firsts;
+static uint32_t* seconds;
+static size_t used;
+static size_t capacity;
+
+static ref alloc(unsigned char kind, uint32_t a, uint32_t b)
+{
+  kinds[used] = kind;
+  firsts[used] = a;
+  seconds[used] = b;
+  return (ref)used++;
+}
+
+)C";
+
+// Reduction to weak head normal form by template instantiation, read back under binders by
+// applying partial applications to fresh variables, and printing.
+constexpr const char* runtime_tail = R"C(
+static const char* const prim_names[] = { "+", "-", "*", "/", "<", "ifz" };
+
+static void out_of_memory(void)
+{
+  fputs("out of memory\n", stderr);
+  exit(1);
+}
+
+static void* grow(void* items, size_t count, size_t size)
+{
+  void* result = realloc(items, count * size);
+  if(!result)
+    out_of_memory();
+  return result;
+}
+
+struct refs
+{
+  ref* items;
+  size_t size;
+  size_t capacity;
+};
+
+static void push(struct refs* v, ref r)
+{
+  if(v->size == v->capacity)
+  {
+    v->capacity = v->capacity ? 2 * v->capacity : 64;
+    v->items = grow(v->items, v->capacity, sizeof(ref));
+  }
+  v->items[v->size++] = r;
+}
+
+struct frame
+{
+  size_t base;
+  /* leading operands of the redex at the top that are evaluated already */
+  size_t done;
+};
+
+/* roots of the collector */
+static struct refs stack;
+static struct refs pending;
+
+static struct frame* frames;
+static size_t frame_count;
+static size_t frame_capacity;
+static struct refs operands;
+static struct refs spine;
+
+static unsigned char* spare_kinds;
+static uint32_t* spare_firsts;
+static uint32_t* spare_seconds;
+static size_t copied;
+
+static void resize_spaces(size_t cells)
+{
+  kinds = grow(kinds, cells, 1);
+  firsts = grow(firsts, cells, sizeof(uint32_t));
+  seconds = grow(seconds, cells, sizeof(uint32_t));
+  spare_kinds = grow(spare_kinds, cells, 1);
+  spare_firsts = grow(spare_firsts, cells, sizeof(uint32_t));
+  spare_seconds = grow(spare_seconds, cells, sizeof(uint32_t));
+  capacity = cells;
+}
+
+static ref evacuate(ref r)
+{
+  if(kinds[r] == MOVED)
+    return firsts[r];
+  spare_kinds[copied] = kinds[r];
+  spare_firsts[copied] = firsts[r];
+  spare_seconds[copied] = seconds[r];
+  kinds[r] = MOVED;
+  firsts[r] = (ref)copied;
+  return (ref)copied++;
+}
+
+/* Cheney's algorithm, the spaces double whenever more than half is alive */
+static void collect(size_t needed)
+{
+  size_t i, scan;
+  unsigned char* k;
+  uint32_t* f;
+  uint32_t* s;
+
+  copied = 0;
+  for(i = 0; i < stack.size; ++i)
+    stack.items[i] = evacuate(stack.items[i]);
+  for(i = 0; i < pending.size; ++i)
+    pending.items[i] = evacuate(pending.items[i]);
+  for(scan = 0; scan < copied; ++scan)
+  {
+    if(spare_kinds[scan] == APP)
+      spare_seconds[scan] = evacuate(spare_seconds[scan]);
+    if(spare_kinds[scan] == APP || spare_kinds[scan] == IND)
+      spare_firsts[scan] = evacuate(spare_firsts[scan]);
+  }
+  k = kinds; kinds = spare_kinds; spare_kinds = k;
+  f = firsts; firsts = spare_firsts; spare_firsts = f;
+  s = seconds; seconds = spare_seconds; spare_seconds = s;
+  used = copied;
+  if(2 * (used + needed) > capacity)
+    resize_spaces(2 * (used + needed) > 2 * capacity ? 2 * (used + needed) : 2 * capacity);
+}
+
+static void reserve(size_t cells)
+{
+  if(used + cells > capacity)
+    collect(cells);
+}
+
+static ref resolve(ref r)
+{
+  while(kinds[r] == IND)
+    r = firsts[r];
+  return r;
+}
+
+static int64_t value(ref r)
+{ return (int64_t)((uint64_t)seconds[r] << 32 | firsts[r]); }
+
+static void push_frame(size_t base)
+{
+  if(frame_count == frame_capacity)
+  {
+    frame_capacity = frame_capacity ? 2 * frame_capacity : 16;
+    frames = grow(frames, frame_capacity, sizeof(struct frame));
+  }
+  frames[frame_count].base = base;
+  frames[frame_count].done = 0;
+  ++frame_count;
+}
+
+static ref argument(size_t i)
+{ return resolve(seconds[stack.items[stack.size - 2 - i]]); }
+
+/* pushes a frame for the first operand up to count that may still be reducible */
+static int force(size_t count)
+{
+  struct frame* frame = &frames[frame_count - 1];
+  while(frame->done < count)
+  {
+    ref arg = argument(frame->done++);
+    if(kinds[arg] == APP)
+    {
+      push_frame(stack.size);
+      push(&stack, arg);
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static int apply_combinator(ref head)
+{
+  const struct combinator* sc = &combinators[firsts[head]];
+  size_t top = stack.size - 1;
+  size_t i;
+  ref redex, result;
+
+  if(top - frames[frame_count - 1].base < sc->arity)
+    return 0;
+  reserve(sc->cells);
+  operands.size = 0;
+  for(i = 0; i < sc->arity; ++i)
+    push(&operands, argument(i));
+  redex = stack.items[top - sc->arity];
+  result = sc->build(operands.items);
+  if(sc->forwards)
+  {
+    kinds[redex] = IND;
+    firsts[redex] = result;
+  }
+  else
+  {
+    kinds[redex] = kinds[result];
+    firsts[redex] = firsts[result];
+    seconds[redex] = seconds[result];
+  }
+  stack.size = top - sc->arity + 1;
+  frames[frame_count - 1].done = 0;
+  return 1;
+}
+
+static int apply_primitive(ref head)
+{
+  uint32_t op = firsts[head];
+  size_t arity = op == IFZ ? 3 : 2;
+  size_t strict = op == IFZ ? 1 : 2;
+  size_t top = stack.size - 1;
+  size_t i;
+  ref redex;
+  int64_t lhs, rhs, result;
+
+  if(top - frames[frame_count - 1].base < arity)
+    return 0;
+  if(!force(strict))
+    return 1;
+  for(i = 0; i < strict; ++i)
+    if(kinds[argument(i)] != INT)
+      return 0;
+
+  redex = stack.items[top - arity];
+  lhs = value(argument(0));
+  if(op == IFZ)
+  {
+    firsts[redex] = argument(lhs == 0 ? 1 : 2);
+    kinds[redex] = IND;
+  }
+  else
+  {
+    /* wrap around instead of overflowing */
+    rhs = value(argument(1));
+    switch(op)
+    {
+    default:
+    case ADD: result = (int64_t)((uint64_t)lhs + (uint64_t)rhs); break;
+    case SUB: result = (int64_t)((uint64_t)lhs - (uint64_t)rhs); break;
+    case MUL: result = (int64_t)((uint64_t)lhs * (uint64_t)rhs); break;
+    case LESS: result = lhs < rhs ? 1 : 0; break;
+    case DIV:
+      if(rhs == 0 || (lhs == INT64_MIN && rhs == -1))
+        return 0;
+      result = lhs / rhs;
+      break;
+    }
+    kinds[redex] = INT;
+    firsts[redex] = (uint32_t)(uint64_t)result;
+    seconds[redex] = (uint32_t)((uint64_t)result >> 32);
+  }
+  stack.size = top - arity + 1;
+  frames[frame_count - 1].done = 0;
+  return 1;
+}
+
+static ref whnf(ref root)
+{
+  ref top, fn;
+  int progress;
+
+  stack.size = 0;
+  push(&stack, root);
+  frame_count = 0;
+  push_frame(0);
+  for(;;)
+  {
+    top = resolve(stack.items[stack.size - 1]);
+    stack.items[stack.size - 1] = top;
+    progress = 0;
+    switch(kinds[top])
+    {
+    default: break;
+
+    case APP:
+      fn = resolve(firsts[top]);
+      firsts[top] = fn;
+      push(&stack, fn);
+      progress = 1;
+      break;
+
+    case COMB: progress = apply_combinator(top); break;
+    case PRIM: progress = apply_primitive(top); break;
+    }
+    if(progress)
+      continue;
+    /* the root of the frame is in weak head normal form */
+    if(frame_count == 1)
+      break;
+    stack.size = frames[--frame_count].base;
+  }
+  root = resolve(stack.items[0]);
+  stack.size = 0;
+  return root;
+}
+
+/* the result, built without sharing and never collected; VAR a is a de Bruijn index here */
+static unsigned char* out_kinds;
+static uint32_t* out_firsts;
+static uint32_t* out_seconds;
+static size_t out_used;
+static size_t out_capacity;
+
+static ref out_alloc(unsigned char kind, uint32_t a, uint32_t b)
+{
+  if(out_used == out_capacity)
+  {
+    out_capacity = out_capacity ? 2 * out_capacity : 1024;
+    out_kinds = grow(out_kinds, out_capacity, 1);
+    out_firsts = grow(out_firsts, out_capacity, sizeof(uint32_t));
+    out_seconds = grow(out_seconds, out_capacity, sizeof(uint32_t));
+  }
+  out_kinds[out_used] = kind;
+  out_firsts[out_used] = a;
+  out_seconds[out_used] = b;
+  return (ref)out_used++;
+}
+
+struct item
+{
+  ref parent;
+  int second;
+  uint32_t depth;
+};
+
+static struct item* items;
+static size_t item_count;
+static size_t item_capacity;
+
+static void push_item(ref parent, int second, uint32_t depth)
+{
+  if(item_count == item_capacity)
+  {
+    item_capacity = item_capacity ? 2 * item_capacity : 64;
+    items = grow(items, item_capacity, sizeof(struct item));
+  }
+  items[item_count].parent = parent;
+  items[item_count].second = second;
+  items[item_count].depth = depth;
+  ++item_count;
+}
+
+static void attach(const struct item* at, ref child, ref* result)
+{
+  if(at->parent == NO_CELL)
+    *result = child;
+  else if(at->second)
+    out_seconds[at->parent] = child;
+  else
+    out_firsts[at->parent] = child;
+}
+
+static ref read_back(ref root)
+{
+  ref result = NO_CELL;
+  ref cell, made, app, lam;
+  struct item item;
+  const struct combinator* sc;
+  size_t i, given;
+
+  push(&pending, root);
+  push_item(NO_CELL, 0, 0);
+  while(item_count)
+  {
+    item = items[--item_count];
+    cell = whnf(pending.items[--pending.size]);
+    /* enough room for any λ read back below, the cell stays a root meanwhile */
+    push(&pending, cell);
+    reserve(max_instance);
+    cell = pending.items[--pending.size];
+
+    spine.size = 0;
+    for(cell = resolve(cell); kinds[cell] == APP; cell = resolve(firsts[cell]))
+      push(&spine, cell);
+    /* a partial application is a λ with the arguments filled in */
+    sc = kinds[cell] == COMB ? &combinators[firsts[cell]] : NULL;
+    given = sc ? spine.size : 0;
+    for(i = 0; i < spine.size - given; ++i)
+    {
+      app = out_alloc(APP, 0, 0);
+      attach(&item, app, &result);
+      push(&pending, resolve(seconds[spine.items[i]]));
+      push_item(app, 1, item.depth);
+      item.parent = app;
+      item.second = 0;
+    }
+
+    switch(kinds[cell])
+    {
+    default:
+      made = out_alloc(kinds[cell], firsts[cell], seconds[cell]);
+      break;
+
+    case VAR:
+      made = out_alloc(VAR, item.depth - 1 - firsts[cell], 0);
+      break;
+
+    case COMB:
+      operands.size = 0;
+      for(i = 0; i < given; ++i)
+        push(&operands, resolve(seconds[spine.items[spine.size - 1 - i]]));
+      for(i = given; i < sc->arity; ++i)
+      {
+        lam = out_alloc(LAM, 0, sc->params[i]);
+        attach(&item, lam, &result);
+        push(&operands, alloc(VAR, item.depth, 0));
+        item.parent = lam;
+        item.second = 0;
+        ++item.depth;
+      }
+      push(&pending, sc->build(operands.items));
+      push_item(item.parent, 0, item.depth);
+      continue;
+    }
+    attach(&item, made, &result);
+  }
+  return result;
+}
+
+/* names of the binders in the order they are met, primed where they would capture a variable */
+static const char** binders;
+/* a name is the first lengths[i] bytes of binders[i] followed by primes[i] primes */
+static size_t* lengths;
+static size_t* primes;
+static size_t binder_count;
+static char* captures;
+static size_t* scope;
+static size_t scope_capacity;
+
+struct visit
+{
+  ref cell;
+  size_t depth;
+  const char* text;
+};
+
+static struct visit* visits;
+static size_t visit_count;
+static size_t visit_capacity;
+
+static void push_visit(ref cell, size_t depth, const char* text)
+{
+  if(visit_count == visit_capacity)
+  {
+    visit_capacity = visit_capacity ? 2 * visit_capacity : 64;
+    visits = grow(visits, visit_capacity, sizeof(struct visit));
+  }
+  visits[visit_count].cell = cell;
+  visits[visit_count].depth = depth;
+  visits[visit_count].text = text;
+  ++visit_count;
+}
+
+static void enter_scope(size_t depth, size_t binder)
+{
+  if(depth == scope_capacity)
+  {
+    scope_capacity = scope_capacity ? 2 * scope_capacity : 64;
+    scope = grow(scope, scope_capacity, sizeof(size_t));
+  }
+  scope[depth] = binder;
+}
+
+static void add_binder(const char* text)
+{
+  size_t length = strlen(text);
+
+  binders = grow(binders, binder_count + 1, sizeof(char*));
+  lengths = grow(lengths, binder_count + 1, sizeof(size_t));
+  primes = grow(primes, binder_count + 1, sizeof(size_t));
+  captures = grow(captures, binder_count + 1, 1);
+  binders[binder_count] = text;
+  primes[binder_count] = 0;
+  while(length && text[length - 1] == '\'')
+  {
+    --length;
+    ++primes[binder_count];
+  }
+  lengths[binder_count] = length;
+  captures[binder_count++] = 0;
+}
+
+static int same_name(size_t lhs, size_t rhs)
+{
+  return lengths[lhs] == lengths[rhs] && primes[lhs] == primes[rhs]
+    && strncmp(binders[lhs], binders[rhs], lengths[lhs]) == 0;
+}
+
+/* the name of the binder equals the text */
+static int named(size_t binder, const char* text)
+{
+  size_t i;
+
+  if(strlen(text) != lengths[binder] + primes[binder] || strncmp(text, binders[binder], lengths[binder]) != 0)
+    return 0;
+  for(i = lengths[binder]; text[i]; ++i)
+    if(text[i] != '\'')
+      return 0;
+  return 1;
+}
+
+static void print_binder(size_t binder)
+{
+  size_t i;
+
+  fwrite(binders[binder], 1, lengths[binder], stdout);
+  for(i = 0; i < primes[binder]; ++i)
+    putchar('\'');
+}
+
+static void name_binders(ref root)
+{
+  size_t i, next, binder, depth;
+  ref cell;
+  int renamed = 1;
+
+  binder_count = 0;
+  while(renamed)
+  {
+    for(i = 0; i < binder_count; ++i)
+      captures[i] = 0;
+    next = 0;
+    visit_count = 0;
+    push_visit(root, 0, NULL);
+    while(visit_count)
+    {
+      cell = visits[--visit_count].cell;
+      depth = visits[visit_count].depth;
+      switch(out_kinds[cell])
+      {
+      default: break;
+
+      case VAR:
+        binder = scope[depth - 1 - out_firsts[cell]];
+        /* λs between the variable and its binder must not reuse the name */
+        for(i = depth - out_firsts[cell]; i < depth; ++i)
+          if(same_name(scope[i], binder))
+            captures[scope[i]] = 1;
+        break;
+
+      case FREE:
+        for(i = 0; i < depth; ++i)
+          if(named(scope[i], names[out_firsts[cell]]))
+            captures[scope[i]] = 1;
+        break;
+
+      case APP:
+        push_visit(out_seconds[cell], depth, NULL);
+        push_visit(out_firsts[cell], depth, NULL);
+        break;
+
+      case LAM:
+        binder = next++;
+        if(binder == binder_count)
+          add_binder(names[out_seconds[cell]]);
+        enter_scope(depth, binder);
+        push_visit(out_firsts[cell], depth + 1, NULL);
+        break;
+      }
+    }
+
+    renamed = 0;
+    for(i = 0; i < binder_count; ++i)
+    {
+      if(!captures[i])
+        continue;
+      ++primes[i];
+      renamed = 1;
+    }
+  }
+}
+
+static void push_child(ref cell, size_t depth)
+{
+  int parens = out_kinds[cell] == LAM;
+  if(parens)
+    push_visit(0, 0, ")");
+  push_visit(cell, depth, NULL);
+  if(parens)
+    push_visit(0, 0, "(");
+}
+
+static void print(ref root)
+{
+  size_t next = 0, depth;
+  ref cell;
+  const char* text;
+
+  name_binders(root);
+  visit_count = 0;
+  push_visit(root, 0, NULL);
+  while(visit_count)
+  {
+    --visit_count;
+    cell = visits[visit_count].cell;
+    depth = visits[visit_count].depth;
+    text = visits[visit_count].text;
+    if(text)
+    {
+      fputs(text, stdout);
+      continue;
+    }
+    switch(out_kinds[cell])
+    {
+    default: break;
+
+    case VAR: print_binder(scope[depth - 1 - out_firsts[cell]]); break;
+    case FREE: fputs(names[out_firsts[cell]], stdout); break;
+    case INT: printf("%lld", (long long)((int64_t)((uint64_t)out_seconds[cell] << 32 | out_firsts[cell]))); break;
+    case PRIM: fputs(prim_names[out_firsts[cell]], stdout); break;
+
+    case APP:
+      push_visit(0, 0, ")");
+      push_child(out_seconds[cell], depth);
+      push_visit(0, 0, " ");
+      push_child(out_firsts[cell], depth);
+      push_visit(0, 0, "(");
+      break;
+
+    case LAM:
+      enter_scope(depth, next);
+      fputs("λ ", stdout);
+      print_binder(next++);
+      fputs(". ", stdout);
+      push_child(out_firsts[cell], depth + 1);
+      break;
+    }
+  }
+}
+
+int main(void)
+{
+  size_t i;
+  ref root;
+
+  resize_spaces(1 << 16);
+  for(i = 0; entries[i].build; ++i)
+  {
+    used = 0;
+    out_used = 0;
+    reserve(entries[i].cells);
+    root = entries[i].build(NULL);
+    fputs(entries[i].prefix, stdout);
+    print(read_back(root));
+    putchar('\n');
+  }
+  return 0;
+}
+)C";
+
+std::string c_string(const std::string& text)
+{
+  std::string literal = "\"";
+  for(char c : text)
+  {
+    if(c == '"' || c == '\\')
+      literal += '\\';
+    literal += c;
+  }
+  return literal + "\"";
+}
+
+// Collects the combinators of all definitions in one table and writes them as C functions.
+class CEmitter
+{
+public:
+  CEmitter(std::ostream& os)
+    : os(os), heap(), names(), name_index(), combinator_count(0), max_instance(0), entries()
+  {  }
+
+  bool add(const Definition& def)
+  {
+    CombinatorProgram program;
+    try
+    {
+      if(!def.expression() || !lift(heap, *def.expression(), program))
+        return false;
+    }
+    catch(const HeapExhausted&)
+    {
+      return false;
+    }
+
+    const std::size_t offset = combinator_count;
+    for(auto& sc : program.combinators)
+    {
+      std::vector<std::uint32_t> params;
+      for(Symbol param : sc.params)
+        params.push_back(name(param));
+      const std::string id = "sc_" + std::to_string(combinator_count++);
+      os << "static const uint32_t " << id << "_params[] = { ";
+      for(std::uint32_t param : params)
+        os << param << ", ";
+      os << "};\n";
+      const std::size_t cells = emit_body(id, sc.body, offset);
+      max_instance = std::max(max_instance, cells + sc.params.size());
+      table.push_back("{ " + std::to_string(sc.params.size()) + ", " + std::to_string(cells) + ", "
+                      + (sc.body.back().kind == CellKind::Var ? "1" : "0") + ", " + id + ", " + id + "_params }");
+    }
+
+    const std::string id = "entry_" + std::to_string(entries.size());
+    const std::size_t cells = emit_body(id, program.main, offset);
+    std::string prefix = "= ";
+    if(auto ident = def.identifier())
+      prefix = ident->id().get_string() + " " + prefix;
+    entries.push_back("{ " + c_string(prefix) + ", " + std::to_string(cells) + ", " + id + " }");
+    return true;
+  }
+
+  // the tables, which must follow all functions
+  void finish()
+  {
+    os << "static const char* const names[] = { ";
+    for(Symbol sym : names)
+      os << c_string(sym.get_string()) << ", ";
+    os << "\"\" };\n";
+    os << "static const struct combinator combinators[] = {\n";
+    for(auto& row : table)
+      os << "  " << row << ",\n";
+    os << "  { 0, 0, 0, NULL, NULL }\n};\n";
+    os << "static const struct entry entries[] = {\n";
+    for(auto& row : entries)
+      os << "  " << row << ",\n";
+    os << "  { NULL, 0, NULL }\n};\n";
+    os << "static const size_t max_instance = " << max_instance << ";\n";
+  }
+private:
+  std::uint32_t name(Symbol sym)
+  {
+    if(auto it = name_index.find(sym); it != name_index.end())
+      return it->second;
+    names.push_back(sym);
+    return name_index[sym] = static_cast<std::uint32_t>(names.size() - 1);
+  }
+
+  // one function building the body, returns the number of cells it allocates
+  std::size_t emit_body(const std::string& id, const std::vector<Cell>& body, std::size_t offset)
+  {
+    os << "static ref " << id << "(const ref* x)\n{\n";
+    std::vector<std::string> values;
+    std::size_t cells = 0;
+    for(const Cell& node : body)
+    {
+      std::string made = "v" + std::to_string(cells);
+      std::string fields;
+      switch(node.kind)
+      {
+      default: break;
+
+      case CellKind::Var:
+        values.push_back("x[" + std::to_string(node.a) + "]");
+        continue;
+
+      case CellKind::App:
+        fields = "APP, " + values[values.size() - 2] + ", " + values.back();
+        values.pop_back();
+        values.pop_back();
+        break;
+
+      case CellKind::Comb:
+        fields = "COMB, " + std::to_string(offset + node.a) + ", 0";
+        break;
+
+      case CellKind::Free:
+        fields = "FREE, " + std::to_string(name(heap.name(node.a))) + ", 0";
+        break;
+
+      case CellKind::Int:
+        fields = "INT, " + std::to_string(node.a) + "u, " + std::to_string(node.b) + "u";
+        break;
+
+      case CellKind::Prim:
+        fields = "PRIM, " + std::to_string(node.a) + ", 0";
+        break;
+      }
+      os << "  ref " << made << " = alloc(" << fields << ");\n";
+      values.push_back(made);
+      ++cells;
+    }
+    os << "  (void)x;\n  return " << values.back() << ";\n}\n\n";
+    return cells;
+  }
+private:
+  std::ostream& os;
+  // only used for the names and locations lifting records
+  Heap heap;
+  std::vector<Symbol> names;
+  SymbolMap<std::uint32_t> name_index;
+  std::size_t combinator_count;
+  std::size_t max_instance;
+  std::vector<std::string> table;
+  std::vector<std::string> entries;
+};
+}
+
+Statement::Ptr emit_c(const std::vector<Statement::Ptr>& stmts, std::ostream& os)
+{
+  os << "/* generated by mf --emit-c */\n" << runtime_head;
+  CEmitter emitter(os);
+  for(auto& stmt : stmts)
+  {
+    auto def = std::dynamic_pointer_cast<Definition>(stmt);
+    if(!def || !emitter.add(*def))
+      return stmt;
+  }
+  emitter.finish();
+  os << runtime_tail;
+  return nullptr;
+}
@@ -0,0 +1,232 @@
+#include <evaluator.hpp>
+#include <combinator.hpp>
+#include <thread_pool.hpp>
+#include <church.hpp>
+#include <printer.hpp>
+
+namespace
+{
+// the engines on cells implement call-by-value, call-by-name (and so weak head normal form) and
+// normal order, trees reduce the other strategies
+bool on_cells(EvaluationStrategy strat)
+{
+  strat = reduction_order(strat);
+  return strat == EvaluationStrategy::CallByValue || strat == EvaluationStrategy::CallByName
+         || strat == EvaluationStrategy::Normal;
+}
+
+// the heap engine takes definitions without Church forms that fit on a heap, only trees reduce
+// Church forms natively
+bool load_definition(const Statement::Ptr& root, EvaluationStrategy strat, Heap& heap, CellRef& term)
+{
+  if(ChurchEncoding::enabled() || !on_cells(strat))
+    return false;
+  auto def = std::dynamic_pointer_cast<Definition>(root);
+  try
+  {
+    return def && def->expression() && load(heap, *def->expression(), term);
+  }
+  catch(const HeapExhausted&)
+  {
+    return false;
+  }
+}
+
+// false if the term outgrew the heap, the tree engine starts over then
+bool reduce_on_heap(Heap& heap, CellRef& term, EvaluationStrategy strat, std::uint_fast64_t budget,
+                    EvaluationStats& stats)
+{
+  EvaluationStats local;
+  heap.add_root(&term);
+  try
+  {
+    HeapReducer reducer(heap, term, strat);
+    for(;;)
+    {
+      if(budget && local.steps >= budget)
+      {
+        local.exhausted = true;
+        break;
+      }
+      if(!reducer.step())
+        break;
+      ++local.steps;
+
+      if(heap.should_collect())
+      {
+        heap.collect();
+        reducer.reset();
+      }
+    }
+  }
+  catch(const HeapExhausted&)
+  {
+    heap.remove_root(&term);
+    return false;
+  }
+  heap.remove_root(&term);
+  local.heap = heap.stats();
+  stats.steps += local.steps;
+  stats.exhausted = local.exhausted;
+  stats.heap += local.heap;
+  return true;
+}
+
+// the result is built on `out`, false if the definition can't be lifted or outgrew the heap
+bool reduce_lifted(const Statement::Ptr& root, EvaluationStrategy strat, std::uint_fast64_t budget,
+                   EvaluationStats& stats, Heap& out, CellRef& term)
+{
+  auto def = std::dynamic_pointer_cast<Definition>(root);
+  if(ChurchEncoding::enabled() || !on_cells(strat) || !def || !def->expression())
+    return false;
+  Heap heap;
+  CombinatorProgram program;
+  try
+  {
+    if(!lift(heap, *def->expression(), program))
+      return false;
+
+    GraphReducer reducer(heap, program, strat, budget);
+    term = reducer.run(out);
+    stats.steps += reducer.steps();
+    stats.exhausted = reducer.exhausted();
+  }
+  catch(const HeapExhausted&)
+  {
+    return false;
+  }
+  stats.heap += heap.stats();
+  return true;
+}
+}
+
+bool parse_strategy(const std::string& name, EvaluationStrategy& strat)
+{
+  if(name == "cbv" || name == "callbyvalue")
+    strat = EvaluationStrategy::CallByValue;
+  else if(name == "cbn" || name == "callbyname")
+    strat = EvaluationStrategy::CallByName;
+  else if(name == "normal")
+    strat = EvaluationStrategy::Normal;
+  else if(name == "applicative")
+    strat = EvaluationStrategy::Applicative;
+  else if(name == "hnf" || name == "headnormal")
+    strat = EvaluationStrategy::HeadNormal;
+  else if(name == "whnf" || name == "weakheadnormal")
+    strat = EvaluationStrategy::WeakHeadNormal;
+  else
+    return false;
+  return true;
+}
+
+bool parse_engine(const std::string& name, Engine& engine)
+{
+  if(name == "tree")
+    engine = Engine::Tree;
+  else if(name == "heap")
+    engine = Engine::Heap;
+  else if(name == "combinator")
+    engine = Engine::Combinator;
+  else
+    return false;
+  return true;
+}
+
+std::string to_string(EvaluationStrategy strat)
+{
+  switch(strat)
+  {
+  default:
+  case EvaluationStrategy::CallByValue: return "cbv";
+  case EvaluationStrategy::CallByName: return "cbn";
+  case EvaluationStrategy::Normal: return "normal";
+  case EvaluationStrategy::Applicative: return "applicative";
+  case EvaluationStrategy::HeadNormal: return "hnf";
+  case EvaluationStrategy::WeakHeadNormal: return "whnf";
+  }
+}
+
+Statement::Ptr normalize(Statement::Ptr root, EvaluationStrategy strat, Engine engine, std::uint_fast64_t budget,
+                         EvaluationStats& stats)
+{
+  if(engine == Engine::Heap)
+  {
+    Heap heap;
+    CellRef term;
+    if(load_definition(root, strat, heap, term) && reduce_on_heap(heap, term, strat, budget, stats))
+    {
+      auto def = std::static_pointer_cast<Definition>(root);
+      return std::make_shared<Definition>(def->source_range(), def->identifier(), read_back(heap, term));
+    }
+  }
+  else if(engine == Engine::Combinator)
+  {
+    Heap out;
+    CellRef term;
+    if(reduce_lifted(root, strat, budget, stats, out, term))
+    {
+      auto def = std::static_pointer_cast<Definition>(root);
+      return std::make_shared<Definition>(def->source_range(), def->identifier(), read_back(out, term));
+    }
+  }
+
+  if(ChurchEncoding::enabled())
+    ChurchEncoding::encode(*root);
+
+  // the focus resumes next to the previous contraction instead of searching from the root
+  Focus focus(*root, strat);
+  for(;;)
+  {
+    if(budget && stats.steps >= budget)
+    {
+      stats.exhausted = true;
+      break;
+    }
+    const auto before = contraction_count();
+    if(!focus.step())
+      break;
+    stats.steps += contraction_count() - before;
+  }
+  // substitutions into parts no contraction needed are carried out only now
+  Substitution::settle(*root);
+  // numerals built by ordinary β-steps are read back compactly as well
+  if(ChurchEncoding::enabled())
+    ChurchEncoding::encode(*root);
+  return root;
+}
+
+std::vector<BatchResult> evaluate_all(const std::vector<Statement::Ptr>& stmts, EvaluationStrategy strat,
+                                      Engine engine, std::uint_fast64_t budget, const PrintOptions& print_opts,
+                                      ThreadPool& pool)
+{
+  // definitions are independent once parsed, the parser inlined every reference
+  std::vector<BatchResult> results(stmts.size());
+  for(std::size_t i = 0; i < stmts.size(); ++i)
+  {
+    pool.submit([&stmts, &results, &print_opts, strat, engine, budget, i]()
+                {
+                  BatchResult& res = results[i];
+                  Printer printer(print_opts);
+                  Heap heap;
+                  CellRef term;
+                  bool reduced = false;
+                  if(engine == Engine::Heap)
+                    reduced = load_definition(stmts[i], strat, heap, term)
+                              && reduce_on_heap(heap, term, strat, budget, res.stats);
+                  else if(engine == Engine::Combinator)
+                    reduced = reduce_lifted(stmts[i], strat, budget, res.stats, heap, term);
+                  if(!reduced)
+                  {
+                    res.text = printer.print(*normalize(stmts[i], strat, Engine::Tree, budget, res.stats));
+                    return;
+                  }
+                  // printed from the cells, the result is never turned back into a tree
+                  if(auto id = std::static_pointer_cast<Definition>(stmts[i])->identifier())
+                    res.text = id->id().get_string() + " ";
+                  res.text += "= ";
+                  res.text += printer.print(heap, term);
+                });
+  }
+  pool.wait();
+  return results;
+}
@@ -0,0 +1,646 @@
+#include <heap.hpp>
+#include <util.hpp>
+
+#include <algorithm>
+#include <limits>
+#include <tuple>
+
+namespace
+{
+constexpr CellRef no_cell = std::numeric_limits<CellRef>::max();
+// collecting a small heap is not worth the trouble
+constexpr std::size_t min_threshold = 1 << 16;
+
+std::int64_t int_value(const Cell& cell)
+{ return static_cast<std::int64_t>(static_cast<std::uint64_t>(cell.b) << 32 | cell.a); }
+
+void link(Heap& heap, CellRef parent, bool second, CellRef child, CellRef& result)
+{
+  if(parent == no_cell)
+    result = child;
+  else if(second)
+    heap.set_second(parent, child);
+  else
+    heap.set_first(parent, child);
+}
+}
+
+Cell int_cell(std::int64_t value, std::uint32_t loc)
+{
+  const auto bits = static_cast<std::uint64_t>(value);
+  return { CellKind::Int, static_cast<std::uint32_t>(bits), static_cast<std::uint32_t>(bits >> 32), loc };
+}
+
+std::size_t SourceRangeHasher::operator()(const SourceRange& loc) const
+{
+  return hash_combine(hash_combine(loc.module, loc.begin), loc.end);
+}
+
+bool SourceRangeComparer::operator()(const SourceRange& lhs, const SourceRange& rhs) const
+{
+  return lhs.module == rhs.module && lhs.begin == rhs.begin && lhs.end == rhs.end;
+}
+
+HeapStats& HeapStats::operator+=(const HeapStats& other)
+{
+  allocated += other.allocated;
+  collections += other.collections;
+  copied += other.copied;
+  peak = std::max(peak, other.peak);
+  return *this;
+}
+
+Heap::Heap()
+  : kinds(), firsts(), seconds(), locs(), spare_kinds(), spare_firsts(), spare_seconds(), spare_locs(),
+    roots(), root_vectors(), threshold(min_threshold), names(), name_index(), locations(), location_index(), heap_stats()
+{  }
+
+CellRef Heap::alloc(const Cell& cell)
+{
+  // the largest reference is kept free to mark missing cells
+  if(kinds.size() >= no_cell)
+    throw HeapExhausted();
+  ++heap_stats.allocated;
+  kinds.push_back(cell.kind);
+  firsts.push_back(cell.a);
+  seconds.push_back(cell.b);
+  locs.push_back(cell.loc);
+  return static_cast<CellRef>(kinds.size() - 1);
+}
+
+Cell Heap::get(CellRef ref) const
+{ return { kinds[ref], firsts[ref], seconds[ref], locs[ref] }; }
+
+void Heap::set(CellRef ref, const Cell& cell)
+{
+  kinds[ref] = cell.kind;
+  firsts[ref] = cell.a;
+  seconds[ref] = cell.b;
+  locs[ref] = cell.loc;
+}
+
+std::int64_t Heap::value(CellRef ref) const
+{ return int_value(get(ref)); }
+
+std::uint32_t Heap::intern(Symbol name)
+{
+  if(auto it = name_index.find(name); it != name_index.end())
+    return it->second;
+  names.push_back(name);
+  return name_index[name] = static_cast<std::uint32_t>(names.size() - 1);
+}
+
+Symbol Heap::name(std::uint32_t index) const
+{ return names[index]; }
+
+std::uint32_t Heap::add_location(const SourceRange& loc)
+{
+  // inlined definitions are copies, so many nodes share their location
+  if(auto it = location_index.find(loc); it != location_index.end())
+    return it->second;
+  locations.push_back(loc);
+  return location_index[loc] = static_cast<std::uint32_t>(locations.size() - 1);
+}
+
+const SourceRange& Heap::location(std::uint32_t index) const
+{ return locations[index]; }
+
+void Heap::add_root(CellRef* root)
+{ roots.push_back(root); }
+
+void Heap::remove_root(CellRef* root)
+{ roots.erase(std::find(roots.begin(), roots.end(), root)); }
+
+void Heap::add_roots(std::vector<CellRef>* refs)
+{ root_vectors.push_back(refs); }
+
+void Heap::remove_roots(std::vector<CellRef>* refs)
+{ root_vectors.erase(std::find(root_vectors.begin(), root_vectors.end(), refs)); }
+
+bool Heap::should_collect() const
+{ return kinds.size() >= threshold; }
+
+void Heap::collect()
+{
+  heap_stats.peak = std::max(heap_stats.peak, kinds.size());
+
+  // Cheney's algorithm, the to-space doubles as the queue of cells whose children still need copying
+  spare_kinds.clear();
+  spare_firsts.clear();
+  spare_seconds.clear();
+  spare_locs.clear();
+  for(CellRef* root : roots)
+    *root = evacuate(*root);
+  for(auto refs : root_vectors)
+    for(CellRef& root : *refs)
+      root = evacuate(root);
+  for(std::size_t scan = 0; scan < spare_kinds.size(); ++scan)
+  {
+    switch(spare_kinds[scan])
+    {
+    default: break;
+
+    case CellKind::App:
+      {
+        const CellRef arg = evacuate(spare_seconds[scan]);
+        spare_seconds[scan] = arg;
+      } [[fallthrough]];
+    case CellKind::Lam:
+    case CellKind::Ind:
+      {
+        const CellRef first = evacuate(spare_firsts[scan]);
+        spare_firsts[scan] = first;
+      } break;
+    }
+  }
+  ++heap_stats.collections;
+  heap_stats.copied += spare_kinds.size();
+
+  std::swap(kinds, spare_kinds);
+  std::swap(firsts, spare_firsts);
+  std::swap(seconds, spare_seconds);
+  std::swap(locs, spare_locs);
+  threshold = std::max(min_threshold, 2 * kinds.size());
+}
+
+CellRef Heap::evacuate(CellRef ref)
+{
+  if(kinds[ref] == CellKind::Moved)
+    return firsts[ref];
+
+  const auto to = static_cast<CellRef>(spare_kinds.size());
+  spare_kinds.push_back(kinds[ref]);
+  spare_firsts.push_back(firsts[ref]);
+  spare_seconds.push_back(seconds[ref]);
+  spare_locs.push_back(locs[ref]);
+  kinds[ref] = CellKind::Moved;
+  firsts[ref] = to;
+  return to;
+}
+
+HeapStats Heap::stats() const
+{
+  HeapStats current = heap_stats;
+  current.peak = std::max(current.peak, kinds.size());
+  return current;
+}
+
+bool load(Heap& heap, const Expression& root, CellRef& out)
+{
+  struct Item
+  {
+    const Expression* node;
+    CellRef parent;
+    bool second;
+    std::size_t depth;
+  };
+  // binders enclosing the current node, innermost last
+  std::vector<Symbol> scope;
+  std::vector<Item> work { { &root, no_cell, false, 0 } };
+  while(!work.empty())
+  {
+    const Item item = work.back();
+    work.pop_back();
+    scope.resize(item.depth, Symbol(""));
+
+    const std::uint32_t loc = heap.add_location(item.node->source_range());
+    CellRef made = no_cell;
+    switch(item.node->kind())
+    {
+    default:
+      return false;
+
+    case ExpressionKind::Identifier:
+      {
+        const Symbol sym = static_cast<const Identifier*>(item.node)->id();
+        auto it = std::find(scope.rbegin(), scope.rend(), sym);
+        if(it == scope.rend())
+          made = heap.alloc({ CellKind::Free, heap.intern(sym), 0, loc });
+        else
+          made = heap.alloc({ CellKind::Var, static_cast<std::uint32_t>(it - scope.rbegin()), 0, loc });
+      } break;
+
+    case ExpressionKind::Integer:
+      made = heap.alloc(int_cell(static_cast<const Integer*>(item.node)->value(), loc));
+      break;
+
+    case ExpressionKind::Primitive:
+      {
+        const auto op = static_cast<const Primitive*>(item.node)->op();
+        made = heap.alloc({ CellKind::Prim, static_cast<std::uint32_t>(op), 0, loc });
+      } break;
+
+    case ExpressionKind::FunctionCall:
+      {
+        auto call = static_cast<const FunctionCall*>(item.node);
+        made = heap.alloc({ CellKind::App, 0, 0, loc });
+        work.push_back({ call->arg_expr().get(), made, true, item.depth });
+        work.push_back({ call->fn_expr().get(), made, false, item.depth });
+      } break;
+
+    case ExpressionKind::Lambda:
+      {
+        auto fn = static_cast<const Lambda*>(item.node);
+        const Symbol binding = fn->fn_binding()->id();
+        made = heap.alloc({ CellKind::Lam, 0, heap.intern(binding), loc });
+        scope.push_back(binding);
+        work.push_back({ fn->fn_body().get(), made, false, item.depth + 1 });
+      } break;
+    }
+    link(heap, item.parent, item.second, made, out);
+  }
+  return true;
+}
+
+NamedTerm name_binders(const Heap& heap, CellRef root)
+{
+  return name_binders(heap, root, {});
+}
+
+NamedTerm name_binders(const Heap& heap, CellRef root, const tsl::hopscotch_set<CellRef>& leaves)
+{
+  // Every λ met on the way down gets a name, taken from the cell. Walks are repeated until no
+  // variable is captured, each time priming the binders that captured one.
+  NamedTerm term;
+  auto& binders = term.binders;
+  std::vector<bool> captures;
+  std::vector<std::size_t> scope;
+  for(bool renamed = true; renamed; )
+  {
+    term.nodes.clear();
+    captures.assign(binders.size(), false);
+    std::size_t next_binder = 0;
+
+    std::vector<std::pair<CellRef, std::size_t>> work { { root, 0 } };
+    while(!work.empty())
+    {
+      auto [ref, depth] = work.back();
+      work.pop_back();
+      scope.resize(depth);
+
+      std::size_t binder = 0;
+      if(ref != root && leaves.count(ref))
+      {
+        term.nodes.push_back({ ref, binder });
+        continue;
+      }
+      switch(heap.kind(ref))
+      {
+      default: break;
+
+      case CellKind::Var:
+        binder = scope[depth - 1 - heap.first(ref)];
+        // λs between the variable and its binder must not reuse the name
+        for(std::size_t i = depth - heap.first(ref); i < depth; ++i)
+          if(binders[scope[i]] == binders[binder])
+            captures[scope[i]] = true;
+        break;
+
+      case CellKind::Free:
+        for(std::size_t i = 0; i < depth; ++i)
+          if(binders[scope[i]] == heap.name(heap.first(ref)))
+            captures[scope[i]] = true;
+        break;
+
+      case CellKind::App:
+        work.push_back({ heap.second(ref), depth });
+        work.push_back({ heap.first(ref), depth });
+        break;
+
+      case CellKind::Lam:
+        binder = next_binder++;
+        if(binder == binders.size())
+        {
+          binders.push_back(heap.name(heap.second(ref)));
+          captures.push_back(false);
+        }
+        scope.push_back(binder);
+        work.push_back({ heap.first(ref), depth + 1 });
+        break;
+      }
+      term.nodes.push_back({ ref, binder });
+    }
+
+    renamed = false;
+    for(std::size_t i = 0; i < binders.size(); ++i)
+    {
+      if(!captures[i])
+        continue;
+      binders[i] = Symbol(binders[i].get_string() + "'");
+      renamed = true;
+    }
+  }
+  return term;
+}
+
+Expression::Ptr read_back(const Heap& heap, CellRef root)
+{
+  const NamedTerm term = name_binders(heap, root);
+
+  // the nodes are in prefix order, so building back to front finds all children on the stack
+  std::vector<Expression::Ptr> built;
+  for(auto it = term.nodes.rbegin(); it != term.nodes.rend(); ++it)
+  {
+    const Cell cell = heap.get(it->cell);
+    const SourceRange& loc = heap.location(cell.loc);
+    switch(cell.kind)
+    {
+    default: break;
+
+    case CellKind::Var:
+      built.push_back(std::make_shared<Identifier>(loc, term.binders[it->binder]));
+      break;
+
+    case CellKind::Free:
+      built.push_back(std::make_shared<Identifier>(loc, heap.name(cell.a)));
+      break;
+
+    case CellKind::Int:
+      built.push_back(std::make_shared<Integer>(loc, int_value(cell)));
+      break;
+
+    case CellKind::Prim:
+      built.push_back(std::make_shared<Primitive>(loc, static_cast<PrimitiveOp>(cell.a)));
+      break;
+
+    case CellKind::App:
+      {
+        Expression::Ptr fn = std::move(built.back());
+        built.pop_back();
+        built.back() = std::make_shared<FunctionCall>(loc, fn, built.back());
+      } break;
+
+    case CellKind::Lam:
+      built.back() = std::make_shared<Lambda>(loc, std::make_shared<Identifier>(loc, term.binders[it->binder]),
+                                              built.back());
+      break;
+    }
+  }
+  return built.back();
+}
+
+HeapReducer::HeapReducer(Heap& heap, const CellRef& root, EvaluationStrategy strat)
+  : heap(heap), root(root), strat(reduction_order(strat)), work(), path()
+{ reset(); }
+
+void HeapReducer::reset()
+{
+  work.assign(1, { root, Phase::Enter, 0 });
+  path.clear();
+}
+
+bool HeapReducer::step()
+{
+  // the same search as Focus::step, see there
+  while(!work.empty())
+  {
+    const Item item = work.back();
+    work.pop_back();
+    path.resize(item.depth);
+    path.push_back({ item.cell, work.size() });
+    const std::size_t below = path.size();
+
+    const CellKind kind = heap.kind(item.cell);
+    if(kind == CellKind::Lam)
+    {
+      if(strat == EvaluationStrategy::Normal)
+        work.push_back({ heap.first(item.cell), Phase::Enter, below });
+      continue;
+    }
+    if(kind != CellKind::App)
+      continue;
+
+    if(item.phase == Phase::Enter && strat == EvaluationStrategy::CallByValue && !is_lazy_operand(item.cell))
+    {
+      work.push_back({ item.cell, Phase::Head, item.depth });
+      work.push_back({ heap.second(item.cell), Phase::Enter, below });
+      continue;
+    }
+    if(item.phase != Phase::DeltaOperand)
+    {
+      if(heap.kind(heap.first(item.cell)) == CellKind::Lam)
+      {
+        contract(item.cell);
+        refocus();
+        return true;
+      }
+
+      CellRef operand = no_cell;
+      if(delta(item.cell, operand))
+      {
+        refocus();
+        return true;
+      }
+      if(operand != no_cell)
+      {
+        work.push_back({ item.cell, Phase::DeltaOperand, item.depth });
+        work.push_back({ operand, Phase::Enter, below });
+        continue;
+      }
+    }
+
+    if(strat == EvaluationStrategy::Normal)
+      work.push_back({ heap.second(item.cell), Phase::Enter, below });
+    work.push_back({ heap.first(item.cell), Phase::Enter, below });
+  }
+  path.clear();
+  return false;
+}
+
+void HeapReducer::refocus()
+{
+  constexpr std::size_t reach = 3;
+  const std::size_t at = path.size() > reach ? path.size() - 1 - reach : 0;
+  const Frame frame = path[at];
+
+  work.resize(frame.pending);
+  path.resize(at);
+  work.push_back({ frame.cell, Phase::Enter, at });
+}
+
+CellRef HeapReducer::spine(CellRef call, std::array<CellRef, Primitive::max_arity>& args, std::size_t& count) const
+{
+  for(count = 1; ; ++count)
+  {
+    args[Primitive::max_arity - count] = heap.second(call);
+    if(count == Primitive::max_arity || heap.kind(heap.first(call)) != CellKind::App)
+      break;
+    call = heap.first(call);
+  }
+  std::rotate(args.begin(), args.begin() + (Primitive::max_arity - count), args.end());
+  return heap.first(call);
+}
+
+bool HeapReducer::is_lazy_operand(CellRef call) const
+{
+  std::array<CellRef, Primitive::max_arity> args;
+  std::size_t count;
+  const CellRef head = spine(call, args, count);
+  if(heap.kind(head) != CellKind::Prim)
+    return false;
+  const auto op = static_cast<PrimitiveOp>(heap.first(head));
+  return count <= Primitive::arity(op) && count > Primitive::strict_arity(op);
+}
+
+bool HeapReducer::delta(CellRef call, CellRef& operand)
+{
+  std::array<CellRef, Primitive::max_arity> args;
+  std::size_t count;
+  const CellRef head = spine(call, args, count);
+  if(heap.kind(head) != CellKind::Prim)
+    return false;
+  const auto op = static_cast<PrimitiveOp>(heap.first(head));
+  if(count != Primitive::arity(op))
+    return false;
+
+  for(std::size_t i = 0; i < Primitive::strict_arity(op); ++i)
+  {
+    if(heap.kind(args[i]) != CellKind::Int)
+    {
+      operand = args[i];
+      return false;
+    }
+  }
+
+  const std::int64_t lhs = heap.value(args[0]);
+  if(op == PrimitiveOp::IfZero)
+  {
+    heap.set(call, heap.get(lhs == 0 ? args[1] : args[2]));
+    return true;
+  }
+  std::int64_t result = 0;
+  if(!Primitive::compute(op, lhs, heap.value(args[1]), result))
+    return false;
+  heap.set(call, int_cell(result, heap.get(call).loc));
+  return true;
+}
+
+void HeapReducer::contract(CellRef call)
+{
+  const CellRef result = substitute(heap, heap.first(heap.first(call)), heap.second(call));
+  // the redex is overwritten, so every parent sharing it sees the contractum
+  heap.set(call, heap.get(result));
+}
+
+CellRef substitute(Heap& heap, CellRef body, CellRef arg)
+{
+  // the argument itself is shared by all occurrences at the same depth
+  std::vector<std::pair<std::uint32_t, CellRef>> shifted;
+  struct Item
+  {
+    CellRef source;
+    CellRef parent;
+    bool second;
+    std::uint32_t depth;
+  };
+  CellRef result = no_cell;
+  std::vector<Item> todo { { body, no_cell, false, 0 } };
+  while(!todo.empty())
+  {
+    const Item item = todo.back();
+    todo.pop_back();
+
+    // copied since allocating may move the cells
+    const Cell cell = heap.get(item.source);
+    CellRef made = item.source;
+    switch(cell.kind)
+    {
+    default: break;
+
+    case CellKind::Var:
+      if(cell.a == item.depth)
+      {
+        auto it = std::find_if(shifted.begin(), shifted.end(),
+                               [&item](const auto& entry) { return entry.first == item.depth; });
+        if(it == shifted.end())
+          it = shifted.insert(shifted.end(), { item.depth, shift(heap, arg, item.depth) });
+        made = it->second;
+      }
+      else if(cell.a > item.depth)
+        made = heap.alloc({ CellKind::Var, cell.a - 1, 0, cell.loc });
+      break;
+
+    case CellKind::App:
+      made = heap.alloc({ CellKind::App, 0, 0, cell.loc });
+      todo.push_back({ cell.b, made, true, item.depth });
+      todo.push_back({ cell.a, made, false, item.depth });
+      break;
+
+    case CellKind::Lam:
+      made = heap.alloc({ CellKind::Lam, 0, cell.b, cell.loc });
+      todo.push_back({ cell.a, made, false, item.depth + 1 });
+      break;
+    }
+    link(heap, item.parent, item.second, made, result);
+  }
+  return result;
+}
+
+CellRef shift(Heap& heap, CellRef term, std::uint32_t by)
+{
+  if(by == 0 || is_closed(heap, term))
+    return term;
+
+  CellRef result = no_cell;
+  std::vector<std::tuple<CellRef, CellRef, bool, std::uint32_t>> todo { { term, no_cell, false, 0 } };
+  while(!todo.empty())
+  {
+    auto [source, parent, second, depth] = todo.back();
+    todo.pop_back();
+
+    const Cell cell = heap.get(source);
+    CellRef made = source;
+    switch(cell.kind)
+    {
+    default: break;
+
+    case CellKind::Var:
+      if(cell.a >= depth)
+        made = heap.alloc({ CellKind::Var, cell.a + by, 0, cell.loc });
+      break;
+
+    case CellKind::App:
+      made = heap.alloc({ CellKind::App, 0, 0, cell.loc });
+      todo.push_back({ cell.b, made, true, depth });
+      todo.push_back({ cell.a, made, false, depth });
+      break;
+
+    case CellKind::Lam:
+      made = heap.alloc({ CellKind::Lam, 0, cell.b, cell.loc });
+      todo.push_back({ cell.a, made, false, depth + 1 });
+      break;
+    }
+    link(heap, parent, second, made, result);
+  }
+  return result;
+}
+
+bool is_closed(const Heap& heap, CellRef term)
+{
+  std::vector<std::pair<CellRef, std::uint32_t>> todo { { term, 0 } };
+  while(!todo.empty())
+  {
+    auto [ref, depth] = todo.back();
+    todo.pop_back();
+
+    switch(heap.kind(ref))
+    {
+    default: break;
+
+    case CellKind::Var:
+      if(heap.first(ref) >= depth)
+        return false;
+      break;
+
+    case CellKind::App:
+      todo.push_back({ heap.second(ref), depth });
+      todo.push_back({ heap.first(ref), depth });
+      break;
+
+    case CellKind::Lam:
+      todo.push_back({ heap.first(ref), depth + 1 });
+      break;
+    }
+  }
+  return true;
+}
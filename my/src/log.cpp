@@ -1,107 +1,220 @@
 #include <log.hpp>
 #include <util.hpp>
 
-#include <fmt/ostream.h>
+#include <fmt/format.h>
 #include <fmt/color.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <vector>
 
-enum class LoggerMessageType
-{
-  Error,
-  Warning,
-  Info
-};
-
-class Logger
+class DiagnosticsSink
 {
 public:
-  void update(LoggerMessageType type, const std::string& module, std::uint_fast32_t column, std::uint_fast32_t row)
+  ~DiagnosticsSink()
+  {
+    flush();
+  }
+
+  void configure(DiagnosticsOptions opts)
   {
-    this->type = type;
-    this->module = module;
-    this->column = column;
-    this->row = row;
+    std::lock_guard<std::mutex> lock(writer);
+    this->opts = opts;
   }
 
-  MessageCollector collect()
+  // lock-free, may be called from any thread
+  void push(Diagnostic* entry)
   {
-    return MessageCollector(*this);
+    entry->sequence = sequence.fetch_add(1, std::memory_order_relaxed);
+    entry->next = pending.load(std::memory_order_relaxed);
+    while(!pending.compare_exchange_weak(entry->next, entry, std::memory_order_release, std::memory_order_relaxed))
+      ;
+  }
+
+  void flush()
+  {
+    std::lock_guard<std::mutex> lock(writer);
+
+    std::vector<std::unique_ptr<Diagnostic>> entries;
+    for(Diagnostic* it = pending.exchange(nullptr, std::memory_order_acquire); it; )
+    {
+      Diagnostic* next = it->next;
+      entries.emplace_back(it);
+      it = next;
+    }
+    if(entries.empty())
+      return;
+    std::sort(entries.begin(), entries.end(), [](const auto& a, const auto& b)
+              { return std::tie(a->module, a->row, a->column, a->sequence)
+                     < std::tie(b->module, b->row, b->column, b->sequence); });
+
+    buffer.clear();
+    std::map<std::string, std::uint_fast32_t> suppressed;
+    for(auto& entry : entries)
+    {
+      if(entry->severity == Severity::Error && opts.max_errors_per_module)
+      {
+        if(errors[entry->module]++ >= opts.max_errors_per_module)
+        {
+          suppressed[entry->module]++;
+          continue;
+        }
+      }
+      format(*entry);
+    }
+    for(auto& kv : suppressed)
+    {
+      Diagnostic note { kv.first, 0, 0, Severity::Info,
+                        std::to_string(kv.second) + " further error(s) suppressed.", 0, nullptr };
+      format(note);
+    }
+    std::cout.flush();
+    std::fwrite(buffer.data(), 1, buffer.size(), stdout);
+    std::fflush(stdout);
   }
-  void print(const std::string& message)
+private:
+  void format(const Diagnostic& entry)
   {
-    fmt::print(fg(fmt::terminal_color::white), "{}:{}:{}: ", module, column, row);
-    switch(type)
+    auto out = std::back_inserter(buffer);
+    if(opts.format == DiagnosticsFormat::Json)
     {
-    case LoggerMessageType::Error:
-      fmt::print(fg(fmt::terminal_color::red) | (fmt::emphasis::bold), "error: ");
+      fmt::format_to(out, "{{\"module\":\"");
+      escape(entry.module);
+      fmt::format_to(out, "\",\"row\":{},\"column\":{},\"severity\":\"{}\",\"message\":\"", entry.row, entry.column,
+                     entry.severity == Severity::Error ? "error" : entry.severity == Severity::Warning ? "warning" : "info");
+      escape(entry.message);
+      fmt::format_to(out, "\"}}\n");
+      return;
+    }
+    fmt::format_to(out, fg(fmt::terminal_color::white), "{}:{}:{}: ", entry.module, entry.column, entry.row);
+    switch(entry.severity)
+    {
+    case Severity::Error:
+      fmt::format_to(out, fg(fmt::terminal_color::red) | (fmt::emphasis::bold), "error: ");
     break;
 
-    case LoggerMessageType::Warning:
-      fmt::print(fg(fmt::terminal_color::bright_black) | (fmt::emphasis::bold), "warning: ");
+    case Severity::Warning:
+      fmt::format_to(out, fg(fmt::terminal_color::bright_black) | (fmt::emphasis::bold), "warning: ");
     break;
 
-    case LoggerMessageType::Info:
-      fmt::print(fg(fmt::terminal_color::blue) | (fmt::emphasis::bold), "info: ");
+    case Severity::Info:
+      fmt::format_to(out, fg(fmt::terminal_color::blue) | (fmt::emphasis::bold), "info: ");
     break;
     }
-    fmt::print(fg(fmt::terminal_color::white), "{}\n", message);
+    fmt::format_to(out, fg(fmt::terminal_color::white), "{}\n", entry.message);
   }
-private:
-  LoggerMessageType type;
 
-  std::string module;
-  std::uint_fast32_t column;
-  std::uint_fast32_t row;
-
-  mutable std::vector<std::string> message;
+  void escape(const std::string& str)
+  {
+    for(unsigned char ch : str)
+    {
+      switch(ch)
+      {
+      case '"':  buffer.append(std::string_view("\\\"")); break;
+      case '\\': buffer.append(std::string_view("\\\\")); break;
+      case '\n': buffer.append(std::string_view("\\n")); break;
+      case '\t': buffer.append(std::string_view("\\t")); break;
+      default:
+        if(ch < 0x20)
+          fmt::format_to(std::back_inserter(buffer), "\\u{:04x}", ch);
+        else
+          buffer.push_back(static_cast<char>(ch));
+      }
+    }
+  }
+private:
+  std::atomic<Diagnostic*> pending { nullptr };
+  std::atomic<std::uint_fast64_t> sequence { 0 };
+
+  // everything below is owned by the single writer
+  std::mutex writer;
+  DiagnosticsOptions opts;
+  fmt::memory_buffer buffer;
+  std::map<std::string, std::uint_fast32_t> errors;
 };
 
-MessageCollector::MessageCollector(Logger& log)
-  : log(log)
+static DiagnosticsSink sink;
+thread_local static DiagnosticsCapture* capture = nullptr;
+
+MessageCollector::MessageCollector(Diagnostic* entry)
+  : entry(entry)
 {  }
 MessageCollector::~MessageCollector()
-try
 {
-  log.print(message);
+  if(capture)
+  {
+    capture->captured.push_back(std::move(*entry));
+    delete entry;
+  }
+  else
+    sink.push(entry);
 }
-catch(...)
+
+DiagnosticsCapture::DiagnosticsCapture()
+  : captured(), outer(capture)
+{ capture = this; }
+
+DiagnosticsCapture::~DiagnosticsCapture()
+{ capture = outer; }
+
+const std::vector<Diagnostic>& DiagnosticsCapture::diagnostics() const
+{ return captured; }
+
+MessageCollector emit(Severity severity, const std::string& module, std::uint_fast32_t column, std::uint_fast32_t row)
 {
-  std::abort();
+  return MessageCollector(new Diagnostic { module, column, row, severity, "", 0, nullptr });
 }
 
-thread_local static Logger logger;
-
 MessageCollector emit_error(const std::string& module, std::uint_fast32_t column, std::uint_fast32_t row)
 {
-  logger.update(LoggerMessageType::Error, module, column, row);
-  
-  return logger.collect();
+  return emit(Severity::Error, module, column, row);
 }
 
 MessageCollector emit_info(const std::string& module, std::uint_fast32_t column, std::uint_fast32_t row)
 {
-  logger.update(LoggerMessageType::Info, module, column, row);
-  
-  return logger.collect();
+  return emit(Severity::Info, module, column, row);
 }
 
 MessageCollector emit_warn(const std::string& module, std::uint_fast32_t column, std::uint_fast32_t row)
 {
-  logger.update(LoggerMessageType::Warning, module, column, row);
-  
-  return logger.collect();
+  return emit(Severity::Warning, module, column, row);
+}
+
+bool parse_diagnostics_format(const std::string& name, DiagnosticsFormat& format)
+{
+  if(name == "text")
+    format = DiagnosticsFormat::Text;
+  else if(name == "json")
+    format = DiagnosticsFormat::Json;
+  else
+    return false;
+  return true;
+}
+
+void configure_diagnostics(DiagnosticsOptions opts)
+{
+  sink.configure(opts);
+}
+
+void flush_diagnostics()
+{
+  sink.flush();
 }
 
 const MessageCollector& operator<<(const MessageCollector& mc, const char* message)
 {
-  mc.message += message;
+  mc.entry->message += message;
   return mc;
 }
 
 const MessageCollector& operator<<(const MessageCollector& mc, const std::string& message)
 {
-  mc.message += message;
+  mc.entry->message += message;
   return mc;
 }
-
@@ -2,11 +2,22 @@
 #include <tokenizer.hpp>
 #include <parser.hpp>
 #include <REPL.hpp>
+#include <server.hpp>
 
+#include <evaluator.hpp>
+#include <church.hpp>
+#include <emit_c.hpp>
+#include <optimizer.hpp>
+#include <strictness.hpp>
+#include <thread_pool.hpp>
+#include <profiler.hpp>
 #include <myopts.hpp>
+#include <log.hpp>
 
 #include <iostream>
 #include <fstream>
+#include <deque>
+#include <algorithm>
 
 #ifndef NDEBUG
 #include <csignal>
@@ -15,6 +26,100 @@ void do_nothing_on_sigint(int)
 {  }
 #endif
 
+struct Optimization
+{
+  std::string name;
+  OptimizationReport report;
+};
+
+Expression::Ptr optimize_definition(Symbol name, const Expression::Ptr& body, std::size_t inline_budget,
+                                    std::vector<Optimization>& log)
+{
+  log.push_back({ name.get_string(), {} });
+  return optimize(body, inline_budget, log.back().report);
+}
+
+void optimize_all(std::vector<Statement::Ptr>& stmts, std::size_t inline_budget, std::vector<Optimization>& log)
+{
+  for(auto& stmt : stmts)
+  {
+    auto def = std::dynamic_pointer_cast<Definition>(stmt);
+    if(!def || !def->expression())
+      continue;
+    const Symbol name = def->identifier() ? def->identifier()->id() : Symbol("<anonymous>");
+    stmt = std::make_shared<Definition>(def->source_range(), def->identifier(),
+                                        optimize_definition(name, def->expression(), inline_budget, log));
+  }
+}
+
+void optimize_all(DefinitionTable& trees, std::size_t inline_budget, std::vector<Optimization>& log)
+{
+  // the table's iterators don't hand out mutable values
+  std::vector<Symbol> names;
+  for(auto& entry : trees)
+    names.push_back(entry.first);
+  for(Symbol name : names)
+    trees[name] = optimize_definition(name, trees[name], inline_budget, log);
+}
+
+void print_optimizations(const std::vector<Optimization>& log, std::ostream& os)
+{
+  for(auto& entry : log)
+  {
+    const OptimizationReport& report = entry.report;
+    // terms the heap can't hold are left as they are
+    if(report.before == 0)
+      continue;
+    os << "optimized " << entry.name << ": " << report.before << " -> " << report.after << " nodes ("
+       << report.beta << " beta, " << report.eta << " eta, " << report.delta << " delta)\n";
+  }
+}
+
+void mark_strictness(const std::vector<Statement::Ptr>& stmts)
+{
+  for(auto& stmt : stmts)
+    if(auto def = std::dynamic_pointer_cast<Definition>(stmt))
+      analyze_strictness(def->expression());
+}
+
+void mark_strictness(const DefinitionTable& trees)
+{
+  for(auto& entry : trees)
+    analyze_strictness(entry.second);
+}
+
+// one line per definition, the parameters its value certainly evaluates marked with !
+void print_strictness(const std::vector<Statement::Ptr>& stmts, std::ostream& os)
+{
+  for(auto& stmt : stmts)
+  {
+    auto def = std::dynamic_pointer_cast<Definition>(stmt);
+    if(!def || !def->identifier())
+      continue;
+    const Strictness strictness = analyze_strictness(def->expression());
+    os << def->identifier()->id().get_string() << ":";
+    if(strictness.arity == 0)
+    {
+      os << " not a function\n";
+      continue;
+    }
+    os << " λ";
+    const Expression* fn = strictness.fn;
+    for(std::uint32_t i = 0; i < strictness.arity; ++i)
+    {
+      os << " " << (i < 64 && (strictness.params >> i) & 1 ? "!" : "");
+      if(fn && fn->kind() == ExpressionKind::Lambda)
+      {
+        os << static_cast<const Lambda*>(fn)->fn_binding()->id().get_string();
+        fn = static_cast<const Lambda*>(fn)->fn_body().get();
+      }
+      else
+        os << "_";
+    }
+    os << "\n";
+  }
+}
+
 int main(int argc, const char* argv[])
 {
   CmdOptions opt("mf", "This is the compiler for the mf language.");
@@ -22,6 +127,52 @@ int main(int argc, const char* argv[])
     ("t,just-tokenize", "Emit tokens of given modules.")
     ("p,just-parse", "Emit abstract syntax tree of given modules.")
     ("repl", "Read-Eval-Print loop.")
+    ("serve", "Keep the given modules loaded and evaluate JSON requests arriving on this Unix domain socket.",
+              CmdOptions::TaggedValue<std::string>::create(), "")
+    ("connect", "Send the JSON requests read from STDIN, one per line, to the server on this socket.",
+                CmdOptions::TaggedValue<std::string>::create(), "")
+    ("eval", "Reduce every top-level definition of the given modules and print the results in source order.")
+    ("strategy", "Evaluation strategy, one of \"cbv\", \"cbn\", \"normal\", \"applicative\", \"hnf\" (head normal "
+                 "form) or \"whnf\" (weak head normal form, another name for \"cbn\", which stops there). The "
+                 "heap and combinator engines leave \"applicative\" and \"hnf\" to the tree.",
+                 CmdOptions::TaggedValue<std::string>::create(), "cbv")
+    ("engine", "Term representation used for reducing, one of \"tree\", \"heap\" (cells with a copying collector) "
+               "or \"combinator\" (lambda-lifted supercombinators reduced by graph instantiation). Both engines on "
+               "cells share arguments, so under \"cbn\" an argument that was reduced once is printed reduced "
+               "everywhere it occurs.",
+               CmdOptions::TaggedValue<std::string>::create(), "tree")
+    ("emit-c", "Compile the given modules to a self-contained C program printing their normal forms, written to this file.",
+               CmdOptions::TaggedValue<std::string>::create(), "")
+    ("entry", "Keep only this definition and the ones it refers to; --eval and --emit-c print just this one.",
+              CmdOptions::TaggedValue<std::string>::create(), "")
+    ("optimize", "Partially evaluate the definitions after parsing: contract cheap redexes, eta-contract and fold "
+                 "primitives on literals.")
+    ("inline-budget", "With --optimize, the number of nodes a λ argument may grow to when copied into each use.",
+                      CmdOptions::TaggedValue<std::size_t>::create(), "16")
+    ("optimize-report", "With --optimize, report how much each definition shrank.")
+    ("strictness", "Reduce the arguments a function certainly evaluates before calling it, under \"cbn\" and "
+                   "\"normal\". The parameters are found by a strictness analysis of the definitions.")
+    ("dump-strictness", "Print the parameters the strictness analysis finds each definition to evaluate, marked with !.")
+    ("gc-stats", "After --eval, report allocations and collections of the heap engine.")
+    ("church", "Reduce Church numerals, booleans and succ/plus/mult/exp natively and print numerals as #n.")
+    ("max-steps", "Stop reducing a term after this many contractions, 0 for no limit.",
+                  CmdOptions::TaggedValue<std::uint_fast64_t>::create(), "0")
+    ("jobs", "Number of worker threads evaluating definitions, 0 for one per hardware thread.",
+             CmdOptions::TaggedValue<std::size_t>::create(), "0")
+    ("max-connections", "Number of clients --serve reads requests from at once, further clients wait.",
+                        CmdOptions::TaggedValue<std::size_t>::create(), "64")
+    ("print-limit", "Maximum number of bytes printed per result, 0 for no limit.",
+                    CmdOptions::TaggedValue<std::size_t>::create(), "65536")
+    ("print-sharing", "Print closed subterms shared in the result once, using let notation. Only the heap engine "
+                      "keeps shared subterms, the other engines copy them.")
+    ("diagnostics-format", "Format of error messages, either \"text\" or \"json\" (one object per line).",
+                           CmdOptions::TaggedValue<std::string>::create(), "text")
+    ("max-errors", "Maximum number of errors reported per module, 0 for no limit.",
+                   CmdOptions::TaggedValue<std::uint_fast32_t>::create(), "0")
+    ("profile", "Attribute reduction steps, allocations and time to the definitions they originate from. "
+                "Only the tree engine can be profiled.")
+    ("profile-folded", "Write the profile as folded stacks (for flamegraph tools) to the given file.",
+                       CmdOptions::TaggedValue<std::string>::create(), "")
     (",-,f,files", "List of files to compile.", CmdOptions::TaggedValue<std::vector<std::string>>::create(), "")
 
 #ifndef NDEBUG
@@ -38,7 +189,51 @@ int main(int argc, const char* argv[])
   }
 #endif
 
-  std::vector<std::ifstream> input_files;
+  DiagnosticsOptions diag_opts;
+  if(!parse_diagnostics_format(map["diagnostics-format"]->get<std::string>(), diag_opts.format))
+  {
+    std::cout << "Unknown diagnostics format \"" << map["diagnostics-format"]->get<std::string>()
+              << "\", expected either \"text\" or \"json\".\n";
+    return 1;
+  }
+  diag_opts.max_errors_per_module = map["max-errors"]->get<std::uint_fast32_t>();
+  configure_diagnostics(diag_opts);
+
+  const std::string& folded_profile = map["profile-folded"]->get<std::string>();
+  if(map["profile"]->get<bool>() || !folded_profile.empty())
+    Profiler::enable();
+
+  EvaluationStrategy strat;
+  if(!parse_strategy(map["strategy"]->get<std::string>(), strat))
+  {
+    std::cout << "Unknown evaluation strategy \"" << map["strategy"]->get<std::string>()
+              << "\", expected one of \"cbv\", \"cbn\", \"normal\", \"applicative\", \"hnf\" or \"whnf\".\n";
+    return 1;
+  }
+  Engine engine;
+  if(!parse_engine(map["engine"]->get<std::string>(), engine))
+  {
+    std::cout << "Unknown engine \"" << map["engine"]->get<std::string>()
+              << "\", expected one of \"tree\", \"heap\" or \"combinator\".\n";
+    return 1;
+  }
+  // cells don't remember the definitions they come from
+  if(Profiler::enabled() && engine != Engine::Tree)
+  {
+    std::cout << "Profiling needs the tree engine, the \"" << map["engine"]->get<std::string>()
+              << "\" engine can't attribute its steps to definitions.\n";
+    return 1;
+  }
+  if(map["church"]->get<bool>())
+    ChurchEncoding::enable();
+  const std::uint_fast64_t budget = map["max-steps"]->get<std::uint_fast64_t>();
+
+  PrintOptions print_opts;
+  print_opts.share = map["print-sharing"]->get<bool>();
+  print_opts.max_size = map["print-limit"]->get<std::size_t>();
+
+  // tokenizers keep a reference to their stream, so the streams must not move
+  std::deque<std::ifstream> input_files;
   std::vector<Tokenizer> tokenizers;
   if(auto vec = map["f"]->get<std::vector<std::string>>(); !vec.empty())
   {
@@ -57,11 +252,70 @@ int main(int argc, const char* argv[])
                    });
   }
 
+  // every mode parses all modules, then drops what the entry doesn't need and optimizes the rest
+  DependencyTable deps;
+  const auto parse_modules = [&tokenizers, &deps](DefinitionTable& trees)
+  {
+    std::vector<Statement::Ptr> stmts;
+    for(auto& tokenizer : tokenizers)
+    {
+      auto astnodes = parse(tokenizer, trees, deps);
+      stmts.insert(stmts.end(), astnodes.begin(), astnodes.end());
+    }
+    flush_diagnostics();
+    return stmts;
+  };
+  const std::string& entry = map["entry"]->get<std::string>();
+  const auto select_entry = [&entry, &deps](DefinitionTable& trees, std::vector<Statement::Ptr>& stmts)
+  {
+    if(entry.empty())
+      return true;
+    const Symbol name(entry);
+    if(trees.find(name) == trees.end())
+    {
+      std::cout << "No definition named \"" << entry << "\".\n";
+      return false;
+    }
+    const SymbolSet needed = reachable(deps, name);
+    std::vector<Symbol> dead;
+    for(auto& def : trees)
+      if(needed.find(def.first) == needed.end())
+        dead.push_back(def.first);
+    for(Symbol unused : dead)
+      trees.erase(unused);
+
+    // references are inlined by the parser, so the entry alone is a complete program
+    auto it = std::find_if(stmts.begin(), stmts.end(), [name](const Statement::Ptr& stmt)
+                           {
+                             auto def = std::dynamic_pointer_cast<Definition>(stmt);
+                             return def && def->identifier() && def->identifier()->id() == name;
+                           });
+    stmts = { *it };
+    return true;
+  };
+
+  std::vector<Optimization> optimizations;
+  const auto optimize_parsed = [&map, &optimizations](auto& parsed)
+  {
+    if(!map["optimize"]->get<bool>())
+      return;
+    optimize_all(parsed, map["inline-budget"]->get<std::size_t>(), optimizations);
+    if(map["optimize-report"]->get<bool>())
+      print_optimizations(optimizations, std::cout);
+  };
+  // after optimizing, which builds new λs
+  const auto analyze_parsed = [&map](const auto& parsed)
+  {
+    if(map["strictness"]->get<bool>())
+      mark_strictness(parsed);
+  };
+
   if(map["p"]->get<bool>())
   {
     for(auto& tokenizer : tokenizers)
     {
       auto astnodes = parse(tokenizer);
+      flush_diagnostics();
 
       std::cout << "Abstract syntax tree of module \"" << tokenizer.module_name() << "\": \n";
       for(auto& astnode : astnodes)
@@ -85,15 +339,110 @@ int main(int argc, const char* argv[])
         std::cout << "\n";
     }
   }
+  else if(map["dump-strictness"]->get<bool>())
+  {
+    DefinitionTable trees;
+    std::vector<Statement::Ptr> stmts = parse_modules(trees);
+    if(!select_entry(trees, stmts))
+      return 1;
+    optimize_parsed(stmts);
+
+    print_strictness(stmts, std::cout);
+  }
+  else if(map["eval"]->get<bool>())
+  {
+    DefinitionTable trees;
+    std::vector<Statement::Ptr> stmts = parse_modules(trees);
+    if(!select_entry(trees, stmts))
+      return 1;
+    optimize_parsed(stmts);
+    analyze_parsed(stmts);
+
+    ThreadPool pool(map["jobs"]->get<std::size_t>());
+    auto results = evaluate_all(stmts, strat, engine, budget, print_opts, pool);
+
+    for(auto& res : results)
+    {
+      std::cout << res.text << "\n";
+      if(res.stats.exhausted)
+        std::cout << "(stopped after " << res.stats.steps << " steps)\n";
+    }
+    if(map["gc-stats"]->get<bool>())
+    {
+      HeapStats total;
+      for(auto& res : results)
+        total += res.stats.heap;
+      std::cout << "heap: " << total.allocated << " cells allocated, " << total.collections << " collections, "
+                << total.copied << " cells copied, peak " << total.peak << " cells ("
+                << total.peak * Heap::bytes_per_cell << " bytes at " << Heap::bytes_per_cell << " bytes per cell)\n";
+    }
+  }
+  else if(const std::string& c_file = map["emit-c"]->get<std::string>(); !c_file.empty())
+  {
+    DefinitionTable trees;
+    std::vector<Statement::Ptr> stmts = parse_modules(trees);
+    if(!select_entry(trees, stmts))
+      return 1;
+    optimize_parsed(stmts);
+
+    std::ofstream out(c_file);
+    if(auto failed = emit_c(stmts, out))
+    {
+      std::cout << "Can't compile \"";
+      failed->print(std::cout);
+      std::cout << "\" to C.\n";
+      return 1;
+    }
+  }
+  else if(const std::string& socket = map["serve"]->get<std::string>(); !socket.empty())
+  {
+    DefinitionTable trees;
+    std::vector<Statement::Ptr> stmts = parse_modules(trees);
+    if(!select_entry(trees, stmts))
+      return 1;
+    optimize_parsed(trees);
+    analyze_parsed(trees);
+
+    ServerOptions server_opts;
+    server_opts.socket_path = socket;
+    server_opts.jobs = map["jobs"]->get<std::size_t>();
+    server_opts.max_connections = std::max<std::size_t>(map["max-connections"]->get<std::size_t>(), 1);
+    server_opts.strategy = strat;
+    server_opts.engine = engine;
+    server_opts.budget = budget;
+    server_opts.print_opts = print_opts;
+    return run_server(std::move(trees), server_opts);
+  }
+  else if(const std::string& socket = map["connect"]->get<std::string>(); !socket.empty())
+  {
+    return run_client(socket, std::cin, std::cout);
+  }
   else if(map["repl"]->get<bool>())
   {
-    //TODO: Load modules passed by -f
-    REPL repl;
+    DefinitionTable trees;
+    std::vector<Statement::Ptr> stmts = parse_modules(trees);
+    if(!select_entry(trees, stmts))
+      return 1;
+    optimize_parsed(trees);
+    analyze_parsed(trees);
+
+    REPL repl(std::move(trees), strat, engine, budget, print_opts);
     repl.loop();
   }
   else
   {
     std::cout << "Nothing selected, so will do nothing.\n";
   }
+
+  flush_diagnostics();
+  if(Profiler::enabled())
+  {
+    Profiler::report(std::cout);
+    if(!folded_profile.empty())
+    {
+      std::ofstream folded(folded_profile);
+      Profiler::write_folded(folded);
+    }
+  }
   return 0;
 }
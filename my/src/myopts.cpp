@@ -23,6 +23,7 @@ void CmdOptions::add(std::string option, std::string description, CmdOptions::Va
   }
   auto value = val->clone();
   value->default_value = default_value;
+  value->apply_default();
 
   opts.push_back({long_names, short_names, description, value});
 }
@@ -0,0 +1,250 @@
+#include <optimizer.hpp>
+#include <heap.hpp>
+
+#include <algorithm>
+#include <array>
+#include <vector>
+
+namespace
+{
+// occurrences of the variable bound by a λ in its body
+struct Uses
+{
+  std::size_t count = 0;
+  bool under_lambda = false;
+};
+
+class Optimizer
+{
+public:
+  Optimizer(Heap& heap, std::size_t inline_budget, OptimizationReport& report)
+    : heap(heap), inline_budget(inline_budget), report(report), fuel(0), visited(), pass_number(0)
+  {  }
+
+  // sweeps the term until nothing is rewritten, at most a few rewrites per node of the input
+  void run(CellRef root)
+  {
+    fuel = 4 * size(root) + 64;
+    while(pass(root) && fuel > 0)
+    {  }
+  }
+
+  std::size_t size(CellRef term) const
+  {
+    std::size_t count = 0;
+    std::vector<CellRef> todo { term };
+    while(!todo.empty())
+    {
+      const CellRef ref = todo.back();
+      todo.pop_back();
+      ++count;
+      if(heap.kind(ref) == CellKind::App)
+        todo.push_back(heap.second(ref));
+      if(heap.kind(ref) == CellKind::App || heap.kind(ref) == CellKind::Lam)
+        todo.push_back(heap.first(ref));
+    }
+    return count;
+  }
+private:
+  // Rewrites top-down, retrying a cell until no rule applies before going into its children.
+  // Cells shared by substitutions are visited once, a rewrite is valid in every place they occur.
+  bool pass(CellRef root)
+  {
+    ++pass_number;
+    bool changed = false;
+    std::vector<CellRef> todo { root };
+    while(!todo.empty() && fuel > 0)
+    {
+      const CellRef ref = todo.back();
+      todo.pop_back();
+      if(ref >= visited.size())
+        visited.resize(ref + 1, 0);
+      if(visited[ref] == pass_number)
+        continue;
+
+      while(fuel > 0 && rewrite(ref))
+      {
+        --fuel;
+        changed = true;
+      }
+      // cells allocated by the rewrites are past the end of visited
+      if(ref < visited.size())
+        visited[ref] = pass_number;
+      if(heap.kind(ref) == CellKind::App)
+        todo.push_back(heap.second(ref));
+      if(heap.kind(ref) == CellKind::App || heap.kind(ref) == CellKind::Lam)
+        todo.push_back(heap.first(ref));
+    }
+    return changed;
+  }
+
+  bool rewrite(CellRef ref)
+  {
+    switch(heap.kind(ref))
+    {
+    default: return false;
+
+    case CellKind::App: return delta(ref) || beta(ref);
+    case CellKind::Lam: return eta(ref);
+    }
+  }
+
+  bool beta(CellRef call)
+  {
+    const CellRef fn = heap.first(call);
+    const CellRef arg = heap.second(call);
+    if(heap.kind(fn) != CellKind::Lam)
+      return false;
+
+    if(!is_atom(arg))
+    {
+      // a λ is a value, so copying it duplicates code but no work
+      const Uses uses = count_uses(heap.first(fn));
+      const bool once = uses.count == 0 || (uses.count == 1 && !uses.under_lambda);
+      if(!once && (heap.kind(arg) != CellKind::Lam || uses.count * size(arg) > inline_budget))
+        return false;
+    }
+    heap.set(call, heap.get(substitute(heap, heap.first(fn), arg)));
+    ++report.beta;
+    return true;
+  }
+
+  bool eta(CellRef lam)
+  {
+    const CellRef body = heap.first(lam);
+    if(heap.kind(body) != CellKind::App)
+      return false;
+    const CellRef arg = heap.second(body);
+    const CellRef fn = heap.first(body);
+    if(heap.kind(arg) != CellKind::Var || heap.first(arg) != 0 || !is_inert(fn) || count_uses(fn).count != 0)
+      return false;
+
+    // the variable doesn't occur in fn, substituting just moves the outer indices down
+    heap.set(lam, heap.get(substitute(heap, fn, lam)));
+    ++report.eta;
+    return true;
+  }
+
+  bool delta(CellRef call)
+  {
+    std::array<CellRef, Primitive::max_arity> args;
+    std::size_t count = 0;
+    CellRef head = call;
+    for(; heap.kind(head) == CellKind::App && count < Primitive::max_arity; head = heap.first(head))
+      args[count++] = heap.second(head);
+    if(heap.kind(head) != CellKind::Prim)
+      return false;
+    const auto op = static_cast<PrimitiveOp>(heap.first(head));
+    if(count != Primitive::arity(op))
+      return false;
+    std::reverse(args.begin(), args.begin() + count);
+    for(std::size_t i = 0; i < Primitive::strict_arity(op); ++i)
+      if(heap.kind(args[i]) != CellKind::Int)
+        return false;
+
+    const std::int64_t lhs = heap.value(args[0]);
+    if(op == PrimitiveOp::IfZero)
+      heap.set(call, heap.get(lhs == 0 ? args[1] : args[2]));
+    else
+    {
+      std::int64_t result = 0;
+      if(!Primitive::compute(op, lhs, heap.value(args[1]), result))
+        return false;
+      heap.set(call, int_cell(result, heap.get(call).loc));
+    }
+    ++report.delta;
+    return true;
+  }
+
+  bool is_atom(CellRef ref) const
+  {
+    const CellKind kind = heap.kind(ref);
+    return kind == CellKind::Var || kind == CellKind::Free || kind == CellKind::Int || kind == CellKind::Prim;
+  }
+
+  // evaluating the term can't diverge: an atom or a variable, name or unsaturated primitive
+  // applied to atoms
+  bool is_inert(CellRef ref) const
+  {
+    std::size_t count = 0;
+    for(; heap.kind(ref) == CellKind::App; ref = heap.first(ref), ++count)
+      if(!is_atom(heap.second(ref)))
+        return false;
+    if(heap.kind(ref) == CellKind::Prim)
+      return count + 1 <= Primitive::arity(static_cast<PrimitiveOp>(heap.first(ref)));
+    return heap.kind(ref) == CellKind::Var || heap.kind(ref) == CellKind::Free;
+  }
+
+  // occurrences of index 0 in the body of a λ
+  Uses count_uses(CellRef body) const
+  {
+    Uses uses;
+    std::vector<std::pair<CellRef, std::uint32_t>> todo { { body, 0 } };
+    while(!todo.empty())
+    {
+      auto [ref, depth] = todo.back();
+      todo.pop_back();
+
+      switch(heap.kind(ref))
+      {
+      default: break;
+
+      case CellKind::Var:
+        if(heap.first(ref) == depth)
+        {
+          ++uses.count;
+          uses.under_lambda |= depth > 0;
+        }
+        break;
+
+      case CellKind::App:
+        todo.push_back({ heap.second(ref), depth });
+        todo.push_back({ heap.first(ref), depth });
+        break;
+
+      case CellKind::Lam:
+        todo.push_back({ heap.first(ref), depth + 1 });
+        break;
+      }
+    }
+    return uses;
+  }
+private:
+  Heap& heap;
+  std::size_t inline_budget;
+  OptimizationReport& report;
+  std::size_t fuel;
+
+  // number of the pass that last visited a cell
+  std::vector<std::uint32_t> visited;
+  std::uint32_t pass_number;
+};
+}
+
+Expression::Ptr optimize(const Expression::Ptr& term, std::size_t inline_budget, OptimizationReport& report)
+{
+  Heap heap;
+  CellRef root;
+  // a term that outgrows the heap is left as it is
+  try
+  {
+    if(!term || !load(heap, *term, root))
+      return term;
+
+    Optimizer optimizer(heap, inline_budget, report);
+    report.before = optimizer.size(root);
+    optimizer.run(root);
+    report.after = optimizer.size(root);
+  }
+  catch(const HeapExhausted&)
+  {
+    report.after = report.before;
+    report.beta = report.eta = report.delta = 0;
+    return term;
+  }
+
+  auto result = read_back(heap, root);
+  if(auto origin = term->origin())
+    result->attribute_to(origin);
+  return result;
+}
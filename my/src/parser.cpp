@@ -1,39 +1,43 @@
 #include <parser.hpp>
 #include <tokenizer.hpp>
+#include <profiler.hpp>
 #include <log.hpp>
 
 #include <tsl/bhopscotch_set.h>
 
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+
 struct Parser
 {
 public:
-  Parser(Tokenizer& tokenizer)
-    : tokenizer(tokenizer), ast()
-  {
-    next_token(); next_token(); next_token();
-  }
+  Parser(Tokenizer& tokenizer, DefinitionTable& trees, const DefinitionTable* resident = nullptr,
+         DependencyTable* deps = nullptr)
+    : tokenizer(tokenizer), tokens(tokenizer.tokens()), ast(), pos(tokenizer.position()), name_classes(),
+      trees(trees), resident(resident), deps(deps), refs()
+  {  }
 
   std::vector<Statement::Ptr> parse() &&
   {
-    if(peek(TokenKind::EndOfFile))
-      return {};
-
     while(!peek(TokenKind::EndOfFile))
     {
       ast.emplace_back(parse_root());
     }
+    tokenizer.seek(at());
     return std::move(ast);
   }
 
   MessageCollector emit_error()
   {
     breakpoint();
-    return ::emit_error(tokenizer.module_name(), current_token.loc().column_beg, current_token.loc().row_beg);
+    const SourcePosition position = loc().position();
+    return ::emit_error(tokenizer.module_name(), position.column, position.row);
   }
 
   void skip_to_next_toplevel()
   {
-    bool another_fn = (peek(TokenKind::Id)     && n1_peek(TokenKind::Equal))
+    bool another_fn = (peek(TokenKind::Id)     && peek(TokenKind::Equal, 1))
                    || (peek(TokenKind::Equal));
     while(!another_fn && !peek(TokenKind::EndOfFile))
     {
@@ -43,7 +47,7 @@ public:
       }
       next_token();
 
-      another_fn = (peek(TokenKind::Id)     && n1_peek(TokenKind::Equal))
+      another_fn = (peek(TokenKind::Id)     && peek(TokenKind::Equal, 1))
                 || (peek(TokenKind::Equal));
     }
   }
@@ -51,53 +55,51 @@ public:
   ErrorExpression::Ptr error_expr(SourceRange range)
   { return std::make_shared<ErrorExpression>(range); } // TODO: Add more error context info
   ErrorExpression::Ptr error_expr()
-  { return std::make_shared<ErrorExpression>(current_token.loc()); } // TODO: Add more error context info
+  { return std::make_shared<ErrorExpression>(loc()); } // TODO: Add more error context info
 
   ErrorStatement::Ptr error_stmt()
-  { return std::make_shared<ErrorStatement>(current_token.loc()); } // TODO: Add more error context info
+  { return std::make_shared<ErrorStatement>(loc()); } // TODO: Add more error context info
   ErrorStatement::Ptr error_stmt(SourceRange range)
-  { range.widen(prev_tok_loc); return std::make_shared<ErrorStatement>(range); } // TODO: Add more error context info
+  { range.widen(prev_loc()); return std::make_shared<ErrorStatement>(range); } // TODO: Add more error context info
 private:
-  void next_token()
+  // index of the token `ahead` places after the current one, the end of the stream repeats
+  std::size_t at(std::size_t ahead = 0)
   {
-    prev_tok_loc = current_token.loc();
-
-    current_token = lookahead.first;
-    lookahead.first = lookahead.second;
-    lookahead.second = tokenizer.get();
-  }
-  
-  bool peek(TokenKind kind) const
-  {
-    if(kind == TokenKind::Id && current_token.tok_kind() == TokenKind::Id)
-    {
-      // see if the identifier is a already known subtree
-      const char* text = current_token.data_as_text();
-      return trees.find(Symbol(text)) == trees.end();
-    }
-    return current_token.tok_kind() == kind;
+    const std::size_t index = pos + ahead;
+    if(index >= tokens.size())
+      tokenizer.fill(std::max(Tokenizer::batch_size, index + 1 - tokens.size()));
+    return std::min(index, tokens.size() - 1);
   }
 
-  bool n1_peek(TokenKind kind) const
+  TokenKind current_kind()
+  { return tokens.kinds[at()]; }
+
+  SourceRange loc()
+  { return tokens.loc(at()); }
+
+  SourceRange prev_loc() const
+  { return tokens.loc(std::min(pos > 0 ? pos - 1 : 0, tokens.size() - 1)); }
+
+  void next_token()
+  { pos = at() + 1; }
+
+  bool peek(TokenKind kind, std::size_t ahead = 0)
   {
-    if(kind == TokenKind::Id && lookahead.first.tok_kind() == TokenKind::Id)
-    {
-      // see if the identifier is a already known subtree
-      const char* text = lookahead.first.data_as_text();
-      return trees.find(Symbol(text)) == trees.end();
-    }
-    return lookahead.first.tok_kind() == kind;
+    const std::size_t index = at(ahead);
+    if(kind == TokenKind::Id && tokens.kinds[index] == TokenKind::Id)
+      return !is_tree(tokens.symbols[index]);
+    return tokens.kinds[index] == kind;
   }
 
-  bool n2_peek(TokenKind kind) const
+  // see if the identifier is an already known subtree, each name is only looked up once
+  bool is_tree(std::uint32_t name)
   {
-    if(kind == TokenKind::Id && lookahead.second.tok_kind() == TokenKind::Id)
-    {
-      // see if the identifier is a already known subtree
-      const char* text = lookahead.second.data_as_text();
-      return trees.find(Symbol(text)) == trees.end();
-    }
-    return lookahead.second.tok_kind() == kind;
+    if(name >= name_classes.size())
+      name_classes.resize(tokens.names.size(), NameClass::Unknown);
+    auto& cls = name_classes[name];
+    if(cls == NameClass::Unknown)
+      cls = find_tree(tokens.names[name]) ? NameClass::Tree : NameClass::Free;
+    return cls == NameClass::Tree;
   }
 
   bool accept(TokenKind kind)
@@ -114,7 +116,7 @@ private:
   {
     if(!accept(kind))
     {
-      emit_error() << "Expected token \"" << to_string(kind) << "\" but got \"" << to_string(current_token.tok_kind()) << "\".";
+      emit_error() << "Expected token \"" << to_string(kind) << "\" but got \"" << to_string(current_kind()) << "\".";
 
       return false;
     }
@@ -126,22 +128,45 @@ private:
     if(!accept(kind0) && !accept(kind1))
     {
       emit_error() << "Expected either token \"" << to_string(kind0) << "\" or \"" << to_string(kind1) << "\" but got \""
-                   << to_string(current_token.tok_kind()) << "\".";
+                   << to_string(current_kind()) << "\".";
       return false;
     }
     return true;
   }
 private:
   Tokenizer& tokenizer;
+  const TokenBuffer& tokens;
   std::vector<Statement::Ptr> ast;
 
-  Token current_token;
-  std::pair<Token, Token> lookahead;
-
-  SourceRange prev_tok_loc;
+  // index of the current token
+  std::size_t pos;
 
-  SymbolMap<Expression::Ptr> trees;
+  enum class NameClass : std::uint8_t
+  {
+    Unknown,
+    Free,
+    Tree
+  };
+  // indexed by the name ids of the buffer
+  std::vector<NameClass> name_classes;
+
+  DefinitionTable& trees;
+  const DefinitionTable* resident;
+
+  // definitions referred to by the one being parsed, only collected if deps is given
+  DependencyTable* deps;
+  SymbolSet refs;
 private:
+  const Expression::Ptr* find_tree(Symbol name) const
+  {
+    if(auto it = trees.find(name); it != trees.end())
+      return &it->second;
+    if(resident)
+      if(auto it = resident->find(name); it != resident->end())
+        return &it->second;
+    return nullptr;
+  }
+
   // parsers
   
   Statement::Ptr parse_root()
@@ -149,47 +174,161 @@ private:
 
   Statement::Ptr parse_definition()
   {
-    auto range = current_token.loc();
+    auto range = loc();
 
     Expression::Ptr name;
     if(peek(TokenKind::Id))
       name = parse_identifier();
     accept(TokenKind::Equal);
+    refs.clear();
     auto body = parse_expression();
 
     expect_or(TokenKind::Semicolon, TokenKind::EndOfFile);
+    range.widen(prev_loc());
 
-    if(auto is_id = std::dynamic_pointer_cast<Identifier>(name))
+    auto is_id = std::dynamic_pointer_cast<Identifier>(name);
+    if(body && Profiler::enabled())
+      body->attribute_to(Profiler::root(is_id ? is_id->id() : Symbol("<anonymous>"), range));
+    if(is_id)
+    {
+      if(deps)
+        (*deps)[is_id->id()] = std::move(refs);
       trees[is_id->id()] = body->clone();
-    range.widen(prev_tok_loc);
+      if(auto it = tokens.name_ids.find(is_id->id()); it != tokens.name_ids.end() && it->second < name_classes.size())
+        name_classes[it->second] = NameClass::Tree;
+    }
     return std::make_shared<Definition>(range, name, body);
   }
 
   Expression::Ptr parse_identifier()
   {
-    auto range = current_token.loc();
-    const char* data = current_token.data_as_text();
+    const std::size_t tok = at();
 
     if(!expect(TokenKind::Id))
       return error_expr();
-    return std::make_shared<Identifier>(range, Symbol(data));
+    return std::make_shared<Identifier>(tokens.loc(tok), tokens.names[tokens.symbols[tok]]);
+  }
+
+  Expression::Ptr parse_number(std::size_t tok)
+  {
+    std::int64_t value = 0;
+    for(const char* p = tokens.text(tok); *p != '\0'; ++p)
+    {
+      if(value > (INT64_MAX - (*p - '0')) / 10)
+      {
+        const SourcePosition position = tokens.loc(tok).position();
+        ::emit_error(tokenizer.module_name(), position.column, position.row)
+          << "Integer literal \"" << tokens.text(tok) << "\" does not fit into 64 bits.";
+        return error_expr(tokens.loc(tok));
+      }
+      value = value * 10 + (*p - '0');
+    }
+    return std::make_shared<Integer>(tokens.loc(tok), value);
   }
 
   Expression::Ptr parse_fn(bool require_lambda = true)
   {
-    SourceRange range = current_token.loc();
+    SourceRange range = loc();
     if(require_lambda) expect(TokenKind::Lambda);
     auto var = parse_identifier();
     expect(TokenKind::Dot);
 
     auto body = parse_expression();
 
-    range.widen(prev_tok_loc);
+    range.widen(prev_loc());
     if(auto is_id = std::dynamic_pointer_cast<Identifier>(var))
       return std::make_shared<Lambda>(range, is_id, body);
     return error_expr(range);
   }
 
+  // let name = bound in body and letrec name = bound in body, the latter binds the name in both
+  Expression::Ptr parse_let(SourceRange range, bool recursive)
+  {
+    auto var = parse_identifier();
+    expect(TokenKind::Equal);
+    auto bound = parse_expression();
+    expect(TokenKind::In);
+    auto body = parse_expression();
+
+    range.widen(prev_loc());
+    auto is_id = std::dynamic_pointer_cast<Identifier>(var);
+    if(!is_id)
+      return error_expr(range);
+    if(recursive)
+      return std::make_shared<LetRec>(range, is_id, bound, body);
+    return std::make_shared<Let>(range, is_id, bound, body);
+  }
+
+  // a tag or arity of a constructor, nullopt if there is none or it is too large
+  std::optional<std::uint32_t> parse_small(std::uint32_t max)
+  {
+    const std::size_t tok = at();
+    if(!expect(TokenKind::Number))
+      return std::nullopt;
+    std::uint32_t value = 0;
+    for(const char* p = tokens.text(tok); *p != '\0'; ++p)
+    {
+      value = value * 10 + (*p - '0');
+      if(value > max)
+      {
+        emit_error() << "Constructor tags and arities must not exceed " << std::to_string(max) << ".";
+        return std::nullopt;
+      }
+    }
+    return value;
+  }
+
+  // pack tag arity
+  Expression::Ptr parse_pack(SourceRange range)
+  {
+    auto tag = parse_small(Constructor::max_tag);
+    auto arity = tag ? parse_small(Constructor::max_arity) : std::nullopt;
+
+    range.widen(prev_loc());
+    if(!tag || !arity)
+      return error_expr(range);
+    return std::make_shared<Constructor>(range, *tag, *arity);
+  }
+
+  // case scrutinee of tag x y. body | tag. body, the last alternative extends to the right
+  Expression::Ptr parse_case(SourceRange range)
+  {
+    auto scrutinee = parse_expression();
+    expect(TokenKind::Of);
+
+    bool valid = true;
+    std::vector<Alternative> alts;
+    do
+    {
+      auto tag = parse_small(Constructor::max_tag);
+      valid = valid && tag;
+      std::vector<Identifier::Ptr> binders;
+      while(tokens.kinds[at()] == TokenKind::Id)
+      {
+        auto is_id = std::dynamic_pointer_cast<Identifier>(parse_identifier());
+        if(!is_id)
+        {
+          valid = false;
+          continue;
+        }
+        if(std::any_of(binders.begin(), binders.end(), [&is_id](const Identifier::Ptr& other) { return other->id() == is_id->id(); }))
+        {
+          emit_error() << "The name \"" << is_id->id().get_string() << "\" is bound twice by the same alternative.";
+          valid = false;
+        }
+        binders.push_back(is_id);
+      }
+      expect(TokenKind::Dot);
+      auto body = parse_expression();
+      alts.push_back({ tag.value_or(0), std::move(binders), std::move(body) });
+    } while(accept(TokenKind::Bar));
+
+    range.widen(prev_loc());
+    if(!valid)
+      return error_expr(range);
+    return std::make_shared<Case>(range, scrutinee, std::move(alts));
+  }
+
   std::int_fast32_t lbp(TokenKind kind)
   {
     switch(kind)
@@ -197,13 +336,21 @@ private:
     default: return 0;
 
     case TokenKind::LParen: return 50;
-    case TokenKind::Id: return 100;
+    case TokenKind::Id:
+    case TokenKind::Number:
+    case TokenKind::Plus:
+    case TokenKind::Minus:
+    case TokenKind::Star:
+    case TokenKind::Slash:
+    case TokenKind::Less:
+    case TokenKind::IfZero:
+    case TokenKind::Pack: return 100;
     }
   }
 
-  Expression::Ptr nud(Token tok)
+  Expression::Ptr nud(std::size_t tok)
   {
-    switch(tok.tok_kind())
+    switch(tokens.kinds[tok])
     {
     default: return nullptr;
 
@@ -213,18 +360,34 @@ private:
                               return body;
                             };
     case TokenKind::Lambda: return parse_fn(false);
+    case TokenKind::Let:    return parse_let(tokens.loc(tok), false);
+    case TokenKind::LetRec: return parse_let(tokens.loc(tok), true);
+    case TokenKind::Case:   return parse_case(tokens.loc(tok));
+    case TokenKind::Pack:   return parse_pack(tokens.loc(tok));
     case TokenKind::Id:     {
-                              auto it = trees.find(Symbol(tok.data_as_text()));
-                              if(it != trees.end())
-                                return it->second->clone();
-                              return std::make_shared<Identifier>(tok.loc(), tok.data_as_text());
+                              const std::uint32_t name = tokens.symbols[tok];
+                              if(is_tree(name))
+                              {
+                                if(deps)
+                                  refs.insert(tokens.names[name]);
+                                return (*find_tree(tokens.names[name]))->clone();
+                              }
+                              return std::make_shared<Identifier>(tokens.loc(tok), tokens.names[name]);
                             }
+    case TokenKind::Number: return parse_number(tok);
+
+    case TokenKind::Plus:   return std::make_shared<Primitive>(tokens.loc(tok), PrimitiveOp::Add);
+    case TokenKind::Minus:  return std::make_shared<Primitive>(tokens.loc(tok), PrimitiveOp::Sub);
+    case TokenKind::Star:   return std::make_shared<Primitive>(tokens.loc(tok), PrimitiveOp::Mul);
+    case TokenKind::Slash:  return std::make_shared<Primitive>(tokens.loc(tok), PrimitiveOp::Div);
+    case TokenKind::Less:   return std::make_shared<Primitive>(tokens.loc(tok), PrimitiveOp::Less);
+    case TokenKind::IfZero: return std::make_shared<Primitive>(tokens.loc(tok), PrimitiveOp::IfZero);
     }
   }
 
-  Expression::Ptr led(Token tok, Expression::Ptr left)
+  Expression::Ptr led(std::size_t tok, Expression::Ptr left)
   {
-    switch(tok.tok_kind())
+    switch(tokens.kinds[tok])
     {
     default: return nullptr;
 
@@ -233,14 +396,21 @@ private:
          auto range = left->source_range();
          auto right = parse_expression();
          expect(TokenKind::RParen);
-         range.widen(prev_tok_loc);
+         range.widen(prev_loc());
          return std::make_shared<FunctionCall>(range, left, right);
        }
 
     case TokenKind::Id:
+    case TokenKind::Number:
+    case TokenKind::Plus:
+    case TokenKind::Minus:
+    case TokenKind::Star:
+    case TokenKind::Slash:
+    case TokenKind::Less:
+    case TokenKind::IfZero:
+    case TokenKind::Pack:
        {
-         auto it = trees.find(Symbol(tok.data_as_text()));
-         auto right = it != trees.end() ? it->second->clone() : std::make_shared<Identifier>(tok.loc(), tok.data_as_text());
+         auto right = nud(tok);
          auto range = left->source_range();
          range.widen(right->source_range());
          return std::make_shared<FunctionCall>(range, left, right);
@@ -250,12 +420,17 @@ private:
 
   Expression::Ptr parse_expression(std::int_fast32_t prec = 0)
   {
-    auto t = current_token;
+    std::size_t t = at();
     next_token();
     Expression::Ptr left = nud(t);
-    while(prec < lbp(current_token.tok_kind()))
+    if(!left)
     {
-      t = current_token;
+      emit_error() << "Unexpected token \"" << to_string(tokens.kinds[t]) << "\".";
+      return error_expr(tokens.loc(t));
+    }
+    while(prec < lbp(current_kind()))
+    {
+      t = at();
       next_token();
       left = led(t, left);
     }
@@ -265,6 +440,40 @@ private:
 
 std::vector<Statement::Ptr> parse(Tokenizer& tokenizer)
 {
-  return Parser(tokenizer).parse();
+  DefinitionTable trees;
+  return Parser(tokenizer, trees).parse();
+}
+
+std::vector<Statement::Ptr> parse(Tokenizer& tokenizer, DefinitionTable& trees)
+{
+  return Parser(tokenizer, trees).parse();
+}
+
+std::vector<Statement::Ptr> parse(Tokenizer& tokenizer, DefinitionTable& trees, const DefinitionTable& resident)
+{
+  return Parser(tokenizer, trees, &resident).parse();
+}
+
+std::vector<Statement::Ptr> parse(Tokenizer& tokenizer, DefinitionTable& trees, DependencyTable& deps)
+{
+  return Parser(tokenizer, trees, nullptr, &deps).parse();
+}
+
+SymbolSet reachable(const DependencyTable& deps, Symbol entry)
+{
+  SymbolSet seen { entry };
+  std::vector<Symbol> work { entry };
+  while(!work.empty())
+  {
+    const Symbol name = work.back();
+    work.pop_back();
+    auto it = deps.find(name);
+    if(it == deps.end())
+      continue;
+    for(Symbol ref : it->second)
+      if(seen.insert(ref).second)
+        work.push_back(ref);
+  }
+  return seen;
 }
 
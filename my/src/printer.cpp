@@ -0,0 +1,595 @@
+#include <printer.hpp>
+#include <church.hpp>
+
+#include <algorithm>
+#include <string>
+
+namespace
+{
+// extends as far to the right as possible
+bool is_lambda(const Expression* node)
+{
+  switch(node->kind())
+  {
+  default: return false;
+
+  case ExpressionKind::Lambda:
+  case ExpressionKind::LetRec:
+  case ExpressionKind::Recursive:
+  case ExpressionKind::Let:
+  case ExpressionKind::Shared:
+  case ExpressionKind::Case: return true;
+  }
+}
+}
+
+Printer::Printer(PrintOptions opts)
+  : opts(opts), buffer(), was_truncated(false), work(), shared(), shared_names(), unfolded(), thunk_terms(), texts(),
+    cell_names(), named_cells()
+{  }
+
+bool Printer::truncated() const
+{ return was_truncated; }
+
+std::string_view Printer::print(const Expression& expr)
+{
+  buffer.clear();
+  was_truncated = false;
+
+  emit(expr);
+  return std::string_view(buffer.data(), buffer.size());
+}
+
+std::string_view Printer::print(const Statement& stmt)
+{
+  buffer.clear();
+  was_truncated = false;
+
+  if(auto def = dynamic_cast<const Definition*>(&stmt))
+  {
+    if(auto id = def->identifier())
+    {
+      append(id->id().get_string());
+      append(" ");
+    }
+    append("= ");
+    if(def->expression())
+      emit(*def->expression());
+  }
+  else
+    append("?ERR?");
+  return std::string_view(buffer.data(), buffer.size());
+}
+
+std::string_view Printer::print(const Heap& heap, CellRef root)
+{
+  buffer.clear();
+  was_truncated = false;
+
+  cell_names.clear();
+  named_cells.clear();
+  if(opts.share)
+  {
+    for(CellRef cell : collect_shared(heap, root))
+    {
+      append("let ");
+      append(cell_names[cell]);
+      append(" = ");
+      emit(heap, cell);
+      append(" in ");
+    }
+  }
+  emit(heap, root);
+  return std::string_view(buffer.data(), buffer.size());
+}
+
+void Printer::emit(const Heap& heap, CellRef root)
+{
+  // cells are visited in the same order as by name_binders, so the n-th one is term.nodes[n]
+  const NamedTerm term = name_binders(heap, root, named_cells);
+  std::size_t next = 0;
+  std::vector<std::pair<CellRef, const char*>> pieces { { root, nullptr } };
+  const auto push_child = [this, &pieces, &heap](CellRef child)
+  {
+    const bool parens = heap.kind(child) == CellKind::Lam && !named_cells.count(child);
+    if(parens)
+      pieces.push_back({ 0, ")" });
+    pieces.push_back({ child, nullptr });
+    if(parens)
+      pieces.push_back({ 0, "(" });
+  };
+  while(!pieces.empty() && !was_truncated)
+  {
+    auto [ref, text] = pieces.back();
+    pieces.pop_back();
+    if(text)
+    {
+      append(text);
+      continue;
+    }
+
+    const auto& node = term.nodes[next++];
+    if(ref != root && named_cells.count(ref))
+    {
+      append(cell_names[ref]);
+      continue;
+    }
+    switch(heap.kind(ref))
+    {
+    default: break;
+
+    case CellKind::Var:
+      append(term.binders[node.binder].get_string());
+      break;
+
+    case CellKind::Free:
+      append(heap.name(heap.first(ref)).get_string());
+      break;
+
+    case CellKind::Int:
+      append(std::to_string(heap.value(ref)));
+      break;
+
+    case CellKind::Prim:
+      append(Primitive::name(static_cast<PrimitiveOp>(heap.first(ref))));
+      break;
+
+    case CellKind::App:
+      pieces.push_back({ 0, ")" });
+      push_child(heap.second(ref));
+      pieces.push_back({ 0, " " });
+      push_child(heap.first(ref));
+      pieces.push_back({ 0, "(" });
+      break;
+
+    case CellKind::Lam:
+      append("λ ");
+      append(term.binders[node.binder].get_string());
+      append(". ");
+      push_child(heap.first(ref));
+      break;
+    }
+  }
+}
+
+void Printer::emit(const Expression& root)
+{
+  unfolded.clear();
+  thunk_terms.clear();
+  texts.clear();
+  shared.clear();
+  shared_names.clear();
+  collect_thunks(root);
+
+  for(auto* node : shared)
+  {
+    append("let ");
+    append(shared_names[node]);
+    append(" = ");
+    // the bound term itself is expanded, only nested shared terms are abbreviated
+    append_node(node);
+    drain();
+    append(" in ");
+  }
+  work.push_back({ &root, nullptr });
+  drain();
+}
+
+void Printer::drain()
+{
+  while(!work.empty() && !was_truncated)
+  {
+    auto item = work.back();
+    work.pop_back();
+
+    if(item.text)
+      append(item.text);
+    else if(auto it = shared_names.find(item.node); it != shared_names.end())
+      append(it->second);
+    else
+      append_node(item.node);
+  }
+  work.clear();
+}
+
+void Printer::append_node(const Expression* node)
+{
+  // pieces are pushed in reverse, the work list is a stack
+  const auto parens = [this](const Expression* child)
+  { return is_lambda(child) && shared_names.find(child) == shared_names.end(); };
+
+  switch(node->kind())
+  {
+  case ExpressionKind::Error:
+    append("?ERR?");
+    break;
+
+  case ExpressionKind::Identifier:
+    append(static_cast<const Identifier*>(node)->id().get_string());
+    break;
+
+  case ExpressionKind::Integer:
+    append(std::to_string(static_cast<const Integer*>(node)->value()));
+    break;
+
+  case ExpressionKind::Primitive:
+    append(static_cast<const Primitive*>(node)->name());
+    break;
+
+  case ExpressionKind::Church:
+    append(static_cast<const Church*>(node)->name());
+    break;
+
+  case ExpressionKind::FunctionCall:
+    {
+      auto call = static_cast<const FunctionCall*>(node);
+      const Expression* fn = call->fn_expr().get();
+      const Expression* arg = call->arg_expr().get();
+
+      work.push_back({ nullptr, ")" });
+      if(parens(arg))
+        work.push_back({ nullptr, ")" });
+      work.push_back({ arg, nullptr });
+      if(parens(arg))
+        work.push_back({ nullptr, "(" });
+      work.push_back({ nullptr, " " });
+      if(parens(fn))
+        work.push_back({ nullptr, ")" });
+      work.push_back({ fn, nullptr });
+      if(parens(fn))
+        work.push_back({ nullptr, "(" });
+      work.push_back({ nullptr, "(" });
+    } break;
+
+  case ExpressionKind::Lambda:
+    {
+      auto fn = static_cast<const Lambda*>(node);
+      const Expression* body = fn->fn_body().get();
+
+      append("λ ");
+      append(fn->fn_binding()->id().get_string());
+      append(". ");
+      if(parens(body))
+        work.push_back({ nullptr, ")" });
+      work.push_back({ body, nullptr });
+      if(parens(body))
+        work.push_back({ nullptr, "(" });
+    } break;
+
+  case ExpressionKind::LetRec:
+    {
+      auto rec = static_cast<const LetRec*>(node);
+
+      append("letrec ");
+      append(rec->rec_binding()->id().get_string());
+      append(" = ");
+      work.push_back({ rec->rec_body().get(), nullptr });
+      work.push_back({ nullptr, " in " });
+      work.push_back({ rec->rec_bound().get(), nullptr });
+    } break;
+
+  case ExpressionKind::Let:
+    {
+      auto let = static_cast<const Let*>(node);
+
+      append("let ");
+      append(let->let_binding()->id().get_string());
+      append(" = ");
+      work.push_back({ let->let_body().get(), nullptr });
+      work.push_back({ nullptr, " in " });
+      work.push_back({ let->let_bound().get(), nullptr });
+    } break;
+
+  case ExpressionKind::Shared:
+    {
+      // a use that can't refer to a binding in front of the term
+      auto ref = static_cast<const Shared*>(node);
+
+      append("let ");
+      append(ref->name().get_string());
+      append(" = ");
+      work.push_back({ nullptr, ref->name().get_string().c_str() });
+      work.push_back({ nullptr, " in " });
+      work.push_back({ thunk_term(*ref), nullptr });
+    } break;
+
+  case ExpressionKind::Constructor:
+    {
+      auto con = static_cast<const Constructor*>(node);
+      const auto& fields = con->fields();
+
+      if(!fields.empty())
+      {
+        append("(");
+        work.push_back({ nullptr, ")" });
+      }
+      append("pack ");
+      append(std::to_string(con->tag()));
+      append(" ");
+      append(std::to_string(con->arity()));
+      for(auto it = fields.rbegin(); it != fields.rend(); ++it)
+      {
+        if(parens(it->get()))
+          work.push_back({ nullptr, ")" });
+        work.push_back({ it->get(), nullptr });
+        work.push_back({ nullptr, parens(it->get()) ? " (" : " " });
+      }
+    } break;
+
+  case ExpressionKind::Case:
+    {
+      auto match = static_cast<const Case*>(node);
+      const auto& alts = match->alternatives();
+
+      append("case ");
+      for(std::size_t i = alts.size(); i-- > 0;)
+      {
+        // only the last alternative may extend to the right
+        const bool last = i + 1 == alts.size();
+        const Expression* body = alts[i].body.get();
+        if(!last && parens(body))
+          work.push_back({ nullptr, ")" });
+        work.push_back({ body, nullptr });
+        work.push_back({ nullptr, !last && parens(body) ? ". (" : ". " });
+        for(auto it = alts[i].binders.rbegin(); it != alts[i].binders.rend(); ++it)
+        {
+          work.push_back({ nullptr, (*it)->id().get_string().c_str() });
+          work.push_back({ nullptr, " " });
+        }
+        work.push_back({ nullptr, keep(std::to_string(alts[i].tag)) });
+        work.push_back({ nullptr, i == 0 ? " of " : " | " });
+      }
+      work.push_back({ match->case_scrutinee().get(), nullptr });
+    } break;
+
+  case ExpressionKind::Recursive:
+    {
+      // printed as the letrec it came from, with the substitutions pending in its term carried out
+      auto ref = static_cast<const Recursive*>(node);
+      Expression::Ptr term = ref->term()->clone();
+      Substitution::settle(term);
+      unfolded.push_back(term);
+
+      append("letrec ");
+      append(ref->name().get_string());
+      append(" = ");
+      work.push_back({ nullptr, ref->name().get_string().c_str() });
+      work.push_back({ nullptr, " in " });
+      work.push_back({ term.get(), nullptr });
+    } break;
+
+  case ExpressionKind::Substitution:
+    {
+      // only seen when printing in the middle of a reduction
+      auto sub = static_cast<const Substitution*>(node);
+
+      work.push_back({ nullptr, "]" });
+      work.push_back({ sub->value().get(), nullptr });
+      work.push_back({ nullptr, " := " });
+      work.push_back({ nullptr, sub->variable().get_string().c_str() });
+      work.push_back({ nullptr, ")[" });
+      work.push_back({ sub->sub_body().get(), nullptr });
+      work.push_back({ nullptr, "(" });
+    } break;
+  }
+}
+
+void Printer::append(std::string_view text)
+{
+  if(was_truncated)
+    return;
+  if(opts.max_size && buffer.size() + text.size() > opts.max_size)
+  {
+    std::size_t keep = opts.max_size - buffer.size();
+    // do not cut a multibyte character in half
+    while(keep > 0 && (static_cast<unsigned char>(text[keep]) & 0xC0) == 0x80)
+      --keep;
+    buffer.append(text.data(), text.data() + keep);
+    buffer.append(std::string_view(" …"));
+    was_truncated = true;
+    return;
+  }
+  buffer.append(text.data(), text.data() + text.size());
+}
+
+const char* Printer::keep(std::string text)
+{
+  texts.push_back(std::move(text));
+  return texts.back().c_str();
+}
+
+const Expression* Printer::thunk_term(const Shared& ref)
+{
+  if(auto it = thunk_terms.find(ref.binding()); it != thunk_terms.end())
+    return it->second;
+  Expression::Ptr term = ref.term()->clone();
+  Substitution::settle(term);
+  unfolded.push_back(term);
+  thunk_terms[ref.binding()] = term.get();
+  return term.get();
+}
+
+void Printer::collect_thunks(const Expression& root)
+{
+  SymbolSet binders, symbols;
+  // the references to each thunk, thunks used in the term of another one come first
+  std::vector<const Thunk*> order;
+  tsl::hopscotch_map<const Thunk*, std::vector<const Expression*>> uses;
+  std::vector<std::pair<const Expression*, bool>> stack { { &root, false } };
+  while(!stack.empty())
+  {
+    auto [node, leaving] = stack.back();
+    stack.pop_back();
+
+    switch(node->kind())
+    {
+    default: break;
+
+    case ExpressionKind::Identifier:
+      symbols.insert(static_cast<const Identifier*>(node)->id());
+      break;
+
+    case ExpressionKind::FunctionCall:
+      stack.push_back({ static_cast<const FunctionCall*>(node)->arg_expr().get(), false });
+      stack.push_back({ static_cast<const FunctionCall*>(node)->fn_expr().get(), false });
+      break;
+
+    case ExpressionKind::Lambda:
+      binders.insert(static_cast<const Lambda*>(node)->fn_binding()->id());
+      stack.push_back({ static_cast<const Lambda*>(node)->fn_body().get(), false });
+      break;
+
+    case ExpressionKind::Let:
+      binders.insert(static_cast<const Let*>(node)->let_binding()->id());
+      stack.push_back({ static_cast<const Let*>(node)->let_body().get(), false });
+      stack.push_back({ static_cast<const Let*>(node)->let_bound().get(), false });
+      break;
+
+    case ExpressionKind::LetRec:
+      binders.insert(static_cast<const LetRec*>(node)->rec_binding()->id());
+      stack.push_back({ static_cast<const LetRec*>(node)->rec_body().get(), false });
+      stack.push_back({ static_cast<const LetRec*>(node)->rec_bound().get(), false });
+      break;
+
+    case ExpressionKind::Constructor:
+      for(auto& field : static_cast<const Constructor*>(node)->fields())
+        stack.push_back({ field.get(), false });
+      break;
+
+    case ExpressionKind::Case:
+      for(auto& alt : static_cast<const Case*>(node)->alternatives())
+      {
+        for(auto& binder : alt.binders)
+          binders.insert(binder->id());
+        stack.push_back({ alt.body.get(), false });
+      }
+      stack.push_back({ static_cast<const Case*>(node)->case_scrutinee().get(), false });
+      break;
+
+    case ExpressionKind::Shared:
+      {
+        auto ref = static_cast<const Shared*>(node);
+        if(leaving)
+        {
+          order.push_back(ref->binding());
+          break;
+        }
+        auto& refs = uses[ref->binding()];
+        refs.push_back(node);
+        if(refs.size() == 1)
+        {
+          stack.push_back({ node, true });
+          stack.push_back({ thunk_term(*ref), false });
+        }
+      } break;
+    }
+  }
+
+  SymbolSet names;
+  for(const Thunk* thunk : order)
+  {
+    const Expression* term = thunk_terms[thunk];
+    // the binding in front is only sound if no binder of the term could capture a free variable
+    SymbolSet fv;
+    term->free_variables(fv);
+    if(std::any_of(fv.begin(), fv.end(), [&binders](const Symbol& sym) { return binders.count(sym) > 0; }))
+      continue;
+
+    std::string name = static_cast<const Shared*>(uses[thunk].front())->name().get_string();
+    while(symbols.count(Symbol(name)) || names.count(Symbol(name)))
+      name += "'";
+    names.insert(Symbol(name));
+    shared.push_back(term);
+    shared_names[term] = name;
+    for(const Expression* ref : uses[thunk])
+      shared_names[ref] = name;
+  }
+}
+
+std::vector<CellRef> Printer::collect_shared(const Heap& heap, CellRef root)
+{
+  // count incoming edges of every cell of the term graph
+  tsl::hopscotch_map<CellRef, std::uint_fast32_t> references;
+  SymbolSet symbols;
+  std::vector<CellRef> stack { root };
+  while(!stack.empty())
+  {
+    const CellRef ref = stack.back();
+    stack.pop_back();
+
+    if(references[ref]++ > 0)
+      continue;
+    switch(heap.kind(ref))
+    {
+    default: break;
+
+    case CellKind::Free:
+      symbols.insert(heap.name(heap.first(ref)));
+      break;
+
+    case CellKind::App:
+      stack.push_back(heap.second(ref));
+      stack.push_back(heap.first(ref));
+      break;
+
+    case CellKind::Lam:
+      symbols.insert(heap.name(heap.second(ref)));
+      stack.push_back(heap.first(ref));
+      break;
+    }
+  }
+
+  // how many binders above a cell its variables reach, in post order so that nested shared
+  // terms are bound first; only closed cells can be bound in front of the term
+  std::vector<CellRef> bound;
+  tsl::hopscotch_map<CellRef, std::uint32_t> reach;
+  std::vector<std::pair<CellRef, bool>> post { { root, false } };
+  while(!post.empty())
+  {
+    auto [ref, expanded] = post.back();
+    post.pop_back();
+
+    if(reach.find(ref) != reach.end())
+      continue;
+    if(!expanded)
+    {
+      post.push_back({ ref, true });
+      if(heap.kind(ref) == CellKind::App)
+      {
+        post.push_back({ heap.second(ref), false });
+        post.push_back({ heap.first(ref), false });
+      }
+      else if(heap.kind(ref) == CellKind::Lam)
+        post.push_back({ heap.first(ref), false });
+      continue;
+    }
+    std::uint32_t outside = 0;
+    switch(heap.kind(ref))
+    {
+    default: break;
+
+    case CellKind::Var:
+      outside = heap.first(ref) + 1;
+      break;
+
+    case CellKind::App:
+      outside = std::max(reach[heap.first(ref)], reach[heap.second(ref)]);
+      break;
+
+    case CellKind::Lam:
+      outside = std::max(reach[heap.first(ref)], std::uint32_t(1)) - 1;
+      break;
+    }
+    reach[ref] = outside;
+    if(references[ref] > 1 && outside == 0 && (heap.kind(ref) == CellKind::App || heap.kind(ref) == CellKind::Lam))
+    {
+      std::string name = "s" + std::to_string(bound.size());
+      while(symbols.count(Symbol(name)))
+        name += "'";
+      cell_names[ref] = name;
+      named_cells.insert(ref);
+      bound.push_back(ref);
+    }
+  }
+  return bound;
+}
@@ -0,0 +1,174 @@
+#include <profiler.hpp>
+
+#include <algorithm>
+#include <deque>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <tuple>
+#include <vector>
+
+namespace
+{
+std::mutex origins_mutex;
+std::deque<Origin> origins;
+std::map<std::pair<const Origin*, const Origin*>, const Origin*> nested_origins;
+
+std::string stack_of(const Origin* origin)
+{
+  std::vector<const Origin*> frames;
+  for(; origin; origin = origin->caller)
+    frames.push_back(origin);
+
+  std::stringstream ss;
+  for(auto it = frames.rbegin(); it != frames.rend(); ++it)
+  {
+    if(it != frames.rbegin())
+      ss << ";";
+    ss << (*it)->definition;
+  }
+  return ss.str();
+}
+}
+
+bool Profiler::is_enabled = false;
+thread_local const Origin* Profiler::active_origin = nullptr;
+
+Origin::Origin(Symbol definition, SourceRange loc, const Origin* caller)
+  : definition(definition), loc(loc), caller(caller), beta_steps(0), allocations(0), nanoseconds(0)
+{  }
+
+Profiler::Step::Step(const Origin* origin)
+  : origin(origin), outer(active_origin)
+{
+  if(!is_enabled)
+    return;
+  active_origin = origin;
+  start = std::chrono::steady_clock::now();
+}
+
+Profiler::Step::~Step()
+{
+  if(!is_enabled)
+    return;
+  active_origin = outer;
+  if(!origin)
+    return;
+  auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+
+  origin->beta_steps.fetch_add(1, std::memory_order_relaxed);
+  origin->nanoseconds.fetch_add(elapsed.count(), std::memory_order_relaxed);
+}
+
+Profiler::Charge::Charge(const Origin* origin)
+  : outer(active_origin)
+{
+  if(is_enabled)
+    active_origin = origin;
+}
+
+Profiler::Charge::~Charge()
+{
+  if(is_enabled)
+    active_origin = outer;
+}
+
+void Profiler::enable()
+{ is_enabled = true; }
+
+bool Profiler::enabled()
+{ return is_enabled; }
+
+const Origin* Profiler::root(Symbol definition, SourceRange loc)
+{
+  std::lock_guard<std::mutex> lock(origins_mutex);
+
+  origins.emplace_back(definition, loc, nullptr);
+  return &origins.back();
+}
+
+const Origin* Profiler::nest(const Origin* origin, const Origin* caller)
+{
+  if(!origin)
+    return caller;
+  if(!caller)
+    return origin;
+  const Origin* outer = nest(origin->caller, caller);
+
+  std::lock_guard<std::mutex> lock(origins_mutex);
+  auto& slot = nested_origins[{ origin, outer }];
+  if(!slot)
+  {
+    origins.emplace_back(origin->definition, origin->loc, outer);
+    slot = &origins.back();
+  }
+  return slot;
+}
+
+const Origin* Profiler::active()
+{ return active_origin; }
+
+void Profiler::charge_allocation(const Origin* origin)
+{
+  if(origin)
+    origin->allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Profiler::report(std::ostream& os)
+{
+  struct Cost
+  {
+    const Origin* origin;
+    std::uint_fast64_t beta_steps;
+    std::uint_fast64_t allocations;
+    std::uint_fast64_t nanoseconds;
+  };
+  using Key = std::tuple<std::uint_fast32_t, std::uint32_t, std::uint32_t>;
+
+  std::map<Key, Cost> per_definition;
+  {
+    std::lock_guard<std::mutex> lock(origins_mutex);
+    for(auto& origin : origins)
+    {
+      Key key { origin.definition.get_hash(), origin.loc.module, origin.loc.begin };
+      auto it = per_definition.emplace(key, Cost { &origin, 0, 0, 0 }).first;
+
+      it->second.beta_steps += origin.beta_steps.load(std::memory_order_relaxed);
+      it->second.allocations += origin.allocations.load(std::memory_order_relaxed);
+      it->second.nanoseconds += origin.nanoseconds.load(std::memory_order_relaxed);
+    }
+  }
+  std::vector<Cost> ranked;
+  for(auto& kv : per_definition)
+    if(kv.second.beta_steps || kv.second.allocations)
+      ranked.push_back(kv.second);
+  std::sort(ranked.begin(), ranked.end(), [](const Cost& a, const Cost& b)
+            { return std::tie(a.beta_steps, a.nanoseconds) > std::tie(b.beta_steps, b.nanoseconds); });
+
+  os << "Reduction profile (ranked by beta steps):\n"
+     << std::setw(12) << "steps" << std::setw(12) << "allocs" << std::setw(14) << "time [us]" << "  definition\n";
+  for(auto& cost : ranked)
+  {
+    const SourcePosition pos = cost.origin->loc.position();
+    os << std::setw(12) << cost.beta_steps
+       << std::setw(12) << cost.allocations
+       << std::setw(14) << std::fixed << std::setprecision(3) << (cost.nanoseconds / 1000.0)
+       << "  " << cost.origin->definition << " (" << cost.origin->loc.module_name() << ":" << pos.column
+                                                << ":" << pos.row << ")\n";
+  }
+}
+
+void Profiler::write_folded(std::ostream& os)
+{
+  std::map<std::string, std::uint_fast64_t> stacks;
+  {
+    std::lock_guard<std::mutex> lock(origins_mutex);
+    for(auto& origin : origins)
+      if(auto steps = origin.beta_steps.load(std::memory_order_relaxed))
+        stacks[stack_of(&origin)] += steps;
+  }
+  for(auto& kv : stacks)
+    os << kv.first << " " << kv.second << "\n";
+}
@@ -0,0 +1,595 @@
+#include <server.hpp>
+#include <evaluator.hpp>
+#include <thread_pool.hpp>
+#include <tokenizer.hpp>
+#include <log.hpp>
+
+#include <fmt/format.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cctype>
+#include <charconv>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+namespace
+{
+
+struct Request
+{
+  // kept verbatim, so numbers and strings round-trip unchanged
+  std::string id = "null";
+  std::string term;
+  std::string strategy;
+  std::uint_fast64_t budget = 0;
+  bool has_budget = false;
+};
+
+void escape(fmt::memory_buffer& buffer, std::string_view str)
+{
+  for(unsigned char ch : str)
+  {
+    switch(ch)
+    {
+    case '"':  buffer.append(std::string_view("\\\"")); break;
+    case '\\': buffer.append(std::string_view("\\\\")); break;
+    case '\n': buffer.append(std::string_view("\\n")); break;
+    case '\t': buffer.append(std::string_view("\\t")); break;
+    default:
+      if(ch < 0x20)
+        fmt::format_to(std::back_inserter(buffer), "\\u{:04x}", ch);
+      else
+        buffer.push_back(static_cast<char>(ch));
+    }
+  }
+}
+
+// Just enough JSON for flat request objects: string, number, boolean and null values.
+class RequestReader
+{
+public:
+  RequestReader(const std::string& text)
+    : text(text), pos(0)
+  {  }
+
+  bool read(Request& req, std::string& error)
+  {
+    skip_ws();
+    if(!eat('{'))
+      return fail(error, "expected an object");
+    skip_ws();
+    if(eat('}'))
+      return true;
+    for(;;)
+    {
+      std::string key;
+      skip_ws();
+      if(!read_string(key))
+        return fail(error, "expected a string key");
+      skip_ws();
+      if(!eat(':'))
+        return fail(error, "expected ':'");
+      skip_ws();
+
+      const std::size_t value_beg = pos;
+      std::string str;
+      bool is_string = false;
+      if(peek() == '"')
+      {
+        if(!read_string(str))
+          return fail(error, "malformed string");
+        is_string = true;
+      }
+      else if(!skip_scalar())
+        return fail(error, "expected a string, number, boolean or null");
+      const std::string raw = text.substr(value_beg, pos - value_beg);
+
+      if(key == "id")
+      {
+        // echoed in the response, so it has to be valid JSON on its own
+        if(is_string)
+        {
+          fmt::memory_buffer quoted;
+          quoted.push_back('"');
+          escape(quoted, str);
+          quoted.push_back('"');
+          req.id.assign(quoted.data(), quoted.size());
+        }
+        else if(is_number(raw))
+          req.id = raw;
+        else
+          return fail(error, "\"id\" must be a number or a string");
+      }
+      else if(key == "term" || key == "strategy")
+      {
+        if(!is_string)
+          return fail(error, "\"" + key + "\" must be a string");
+        (key == "term" ? req.term : req.strategy) = std::move(str);
+      }
+      else if(key == "budget")
+      {
+        if(is_string || raw.empty() || raw.find_first_not_of("0123456789") != std::string::npos)
+          return fail(error, "\"budget\" must be a non-negative integer");
+        const auto [end, ec] = std::from_chars(raw.data(), raw.data() + raw.size(), req.budget);
+        if(ec != std::errc())
+          return fail(error, "\"budget\" out of range");
+        req.has_budget = true;
+      }
+
+      skip_ws();
+      if(eat('}'))
+        break;
+      if(!eat(','))
+        return fail(error, "expected ',' or '}'");
+    }
+    skip_ws();
+    if(pos != text.size())
+      return fail(error, "trailing characters after object");
+    return true;
+  }
+private:
+  char peek() const
+  { return pos < text.size() ? text[pos] : '\0'; }
+
+  bool eat(char ch)
+  {
+    if(peek() != ch)
+      return false;
+    ++pos;
+    return true;
+  }
+
+  void skip_ws()
+  {
+    while(pos < text.size() && std::strchr(" \t\r\n", text[pos]))
+      ++pos;
+  }
+
+  static bool is_number(const std::string& raw)
+  {
+    // -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+    std::size_t at = 0;
+    const auto digits = [&raw, &at]()
+    {
+      const std::size_t beg = at;
+      while(at < raw.size() && std::isdigit(static_cast<unsigned char>(raw[at])))
+        ++at;
+      return at != beg;
+    };
+    if(at < raw.size() && raw[at] == '-')
+      ++at;
+    if(at < raw.size() && raw[at] == '0')
+      ++at;
+    else if(!digits())
+      return false;
+    if(at < raw.size() && raw[at] == '.' && (++at, !digits()))
+      return false;
+    if(at < raw.size() && (raw[at] == 'e' || raw[at] == 'E'))
+    {
+      ++at;
+      if(at < raw.size() && (raw[at] == '+' || raw[at] == '-'))
+        ++at;
+      if(!digits())
+        return false;
+    }
+    return at == raw.size();
+  }
+
+  bool skip_scalar()
+  {
+    const std::size_t beg = pos;
+    while(pos < text.size() && (std::isalnum(static_cast<unsigned char>(text[pos])) || std::strchr("+-.", text[pos])))
+      ++pos;
+    return pos != beg;
+  }
+
+  bool read_hex(std::uint_fast32_t& cp)
+  {
+    if(pos + 4 > text.size())
+      return false;
+    cp = 0;
+    for(int i = 0; i < 4; ++i)
+    {
+      const char ch = text[pos++];
+      cp <<= 4;
+      if(ch >= '0' && ch <= '9')      cp |= ch - '0';
+      else if(ch >= 'a' && ch <= 'f') cp |= ch - 'a' + 10;
+      else if(ch >= 'A' && ch <= 'F') cp |= ch - 'A' + 10;
+      else return false;
+    }
+    return true;
+  }
+
+  static void append_utf8(std::string& out, std::uint_fast32_t cp)
+  {
+    if(cp < 0x80)
+      out.push_back(static_cast<char>(cp));
+    else if(cp < 0x800)
+    {
+      out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+      out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    }
+    else if(cp < 0x10000)
+    {
+      out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+      out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+      out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    }
+    else
+    {
+      out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+      out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+      out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+      out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    }
+  }
+
+  bool read_string(std::string& out)
+  {
+    if(!eat('"'))
+      return false;
+    while(pos < text.size())
+    {
+      const char ch = text[pos++];
+      if(ch == '"')
+        return true;
+      if(ch != '\\')
+      {
+        out.push_back(ch);
+        continue;
+      }
+      if(pos >= text.size())
+        return false;
+      switch(text[pos++])
+      {
+      case '"':  out.push_back('"'); break;
+      case '\\': out.push_back('\\'); break;
+      case '/':  out.push_back('/'); break;
+      case 'b':  out.push_back('\b'); break;
+      case 'f':  out.push_back('\f'); break;
+      case 'n':  out.push_back('\n'); break;
+      case 'r':  out.push_back('\r'); break;
+      case 't':  out.push_back('\t'); break;
+      case 'u':
+        {
+          std::uint_fast32_t cp;
+          if(!read_hex(cp))
+            return false;
+          // surrogate pair, e.g. for characters outside the BMP
+          if(cp >= 0xD800 && cp < 0xDC00)
+          {
+            std::uint_fast32_t low;
+            if(!eat('\\') || !eat('u') || !read_hex(low) || low < 0xDC00 || low >= 0xE000)
+              return false;
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+          }
+          append_utf8(out, cp);
+        } break;
+      default: return false;
+      }
+    }
+    return false;
+  }
+
+  static bool fail(std::string& error, const char* what)
+  { error = what; return false; }
+  static bool fail(std::string& error, std::string what)
+  { error = std::move(what); return false; }
+private:
+  const std::string& text;
+  std::size_t pos;
+};
+
+bool write_all(int fd, const char* data, std::size_t size)
+{
+  while(size > 0)
+  {
+    const ssize_t written = ::write(fd, data, size);
+    if(written < 0 && errno == EINTR)
+      continue;
+    if(written <= 0)
+      return false;
+    data += written;
+    size -= static_cast<std::size_t>(written);
+  }
+  return true;
+}
+
+// Responses of one connection may be produced by several workers at once.
+// The socket is closed once the reader and every pending request let go of it.
+class Connection
+{
+public:
+  using Ptr = std::shared_ptr<Connection>;
+
+  Connection(int fd)
+    : fd(fd), mutex()
+  {  }
+
+  ~Connection()
+  { ::close(fd); }
+
+  void respond(const fmt::memory_buffer& response)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    write_all(fd, response.data(), response.size());
+  }
+
+  int handle() const
+  { return fd; }
+private:
+  int fd;
+  std::mutex mutex;
+};
+
+class Server
+{
+public:
+  Server(DefinitionTable resident, const ServerOptions& opts)
+    : resident(std::move(resident)), opts(opts), pool(opts.jobs)
+  {  }
+
+  void serve(int listener)
+  {
+    for(;;)
+    {
+      // further clients wait in the listen backlog until a reader is free
+      {
+        std::unique_lock<std::mutex> lock(readers_mutex);
+        readers_done.wait(lock, [this]() { return readers < opts.max_connections; });
+        ++readers;
+      }
+      const int fd = ::accept(listener, nullptr, nullptr);
+      if(fd < 0)
+      {
+        reader_finished();
+        if(errno == EINTR || errno == ECONNABORTED)
+          continue;
+        std::cerr << "accept: " << std::strerror(errno) << "\n";
+        return;
+      }
+      std::thread([this, conn = std::make_shared<Connection>(fd)]()
+      {
+        read_requests(conn);
+        reader_finished();
+      }).detach();
+    }
+  }
+private:
+  void reader_finished()
+  {
+    std::lock_guard<std::mutex> lock(readers_mutex);
+    --readers;
+    readers_done.notify_one();
+  }
+
+  void read_requests(Connection::Ptr conn)
+  {
+    std::string pending;
+    char chunk[4096];
+    for(;;)
+    {
+      const ssize_t got = ::read(conn->handle(), chunk, sizeof(chunk));
+      if(got < 0 && errno == EINTR)
+        continue;
+      if(got <= 0)
+        break;
+      pending.append(chunk, static_cast<std::size_t>(got));
+
+      std::size_t eol;
+      while((eol = pending.find('\n')) != std::string::npos)
+      {
+        std::string line = pending.substr(0, eol);
+        pending.erase(0, eol + 1);
+        if(line.find_first_not_of(" \t\r") != std::string::npos)
+          pool.submit([this, conn, line = std::move(line)]() { handle(*conn, line); });
+      }
+    }
+  }
+
+  void handle(Connection& conn, const std::string& line)
+  {
+    const auto start = std::chrono::steady_clock::now();
+
+    fmt::memory_buffer response;
+    auto out = std::back_inserter(response);
+
+    Request req;
+    std::string error;
+    if(!RequestReader(line).read(req, error))
+    {
+      // the id is still "null" unless it came before the malformed part
+      fmt::format_to(out, "{{\"id\":{},\"error\":\"malformed request: ", req.id);
+      escape(response, error);
+      fmt::format_to(out, "\"}}\n");
+      conn.respond(response);
+      return;
+    }
+
+    EvaluationStrategy strat = opts.strategy;
+    if(!req.strategy.empty() && !parse_strategy(req.strategy, strat))
+    {
+      fmt::format_to(out, "{{\"id\":{},\"error\":\"unknown evaluation strategy \\\"", req.id);
+      escape(response, req.strategy);
+      fmt::format_to(out, "\\\"\"}}\n");
+      conn.respond(response);
+      return;
+    }
+
+    // requests are read at the same time, each needs a line table of its own
+    StreamModule module("request");
+    Statement::Ptr stmt;
+    std::size_t statements = 0;
+    DiagnosticsCapture capture;
+    {
+      // the leading `=` keeps a term starting with an unknown identifier from being read as a definition name
+      std::stringstream ss("= " + req.term);
+      Tokenizer tokenizer(module.id(), ss);
+
+      DefinitionTable local;
+      auto stmts = parse(tokenizer, local, resident);
+      statements = stmts.size();
+      if(!stmts.empty())
+        stmt = stmts.front();
+    }
+    bool failed = !stmt;
+    for(auto& diag : capture.diagnostics())
+      failed = failed || diag.severity == Severity::Error;
+    if(failed)
+    {
+      fmt::format_to(out, "{{\"id\":{},\"error\":\"parse error\",\"diagnostics\":[", req.id);
+      bool first = true;
+      for(auto& diag : capture.diagnostics())
+      {
+        // columns of the first line count from the start of the term, not the `= ` prepended above
+        const auto column = diag.row > 1 ? diag.column : diag.column > 2 ? diag.column - 2 : 1;
+        fmt::format_to(out, "{}{{\"row\":{},\"column\":{},\"message\":\"", first ? "" : ",", diag.row, column);
+        escape(response, diag.message);
+        fmt::format_to(out, "\"}}");
+        first = false;
+      }
+      fmt::format_to(out, "]}}\n");
+      conn.respond(response);
+      return;
+    }
+    // the other statements would be dropped without a word
+    if(statements > 1)
+    {
+      fmt::format_to(out, "{{\"id\":{},\"error\":\"a term must be a single expression, not several statements\"}}\n",
+                     req.id);
+      conn.respond(response);
+      return;
+    }
+
+    EvaluationStats stats;
+    stmt = normalize(stmt, strat, opts.engine, req.has_budget ? req.budget : opts.budget, stats);
+
+    Printer printer(opts.print_opts);
+    auto def = std::dynamic_pointer_cast<Definition>(stmt);
+    const std::string_view result = def && def->expression() ? printer.print(*def->expression()) : printer.print(*stmt);
+
+    const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    fmt::format_to(out, "{{\"id\":{},\"result\":\"", req.id);
+    escape(response, result);
+    fmt::format_to(out, "\",\"steps\":{},\"exhausted\":{},\"time_us\":{}}}\n",
+                   stats.steps, stats.exhausted ? "true" : "false", elapsed.count());
+    conn.respond(response);
+  }
+private:
+  const DefinitionTable resident;
+  const ServerOptions& opts;
+  ThreadPool pool;
+
+  // connections currently read by a thread of their own
+  std::size_t readers = 0;
+  std::mutex readers_mutex;
+  std::condition_variable readers_done;
+};
+
+bool make_address(const std::string& path, sockaddr_un& addr)
+{
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if(path.size() >= sizeof(addr.sun_path))
+  {
+    std::cerr << "Socket path \"" << path << "\" is too long.\n";
+    return false;
+  }
+  std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+  return true;
+}
+
+}
+
+int run_server(DefinitionTable resident, const ServerOptions& opts)
+{
+  // a client going away mid-response must not take the server down
+  std::signal(SIGPIPE, SIG_IGN);
+
+  sockaddr_un addr;
+  if(!make_address(opts.socket_path, addr))
+    return 1;
+
+  const int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if(listener < 0)
+  {
+    std::cerr << "socket: " << std::strerror(errno) << "\n";
+    return 1;
+  }
+  ::unlink(opts.socket_path.c_str());
+  if(::bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0
+     || ::listen(listener, SOMAXCONN) < 0)
+  {
+    std::cerr << "Cannot listen on \"" << opts.socket_path << "\": " << std::strerror(errno) << "\n";
+    ::close(listener);
+    return 1;
+  }
+
+  Server server(std::move(resident), opts);
+  server.serve(listener);
+
+  ::close(listener);
+  ::unlink(opts.socket_path.c_str());
+  return 1;
+}
+
+int run_client(const std::string& socket_path, std::istream& in, std::ostream& out)
+{
+  std::signal(SIGPIPE, SIG_IGN);
+
+  sockaddr_un addr;
+  if(!make_address(socket_path, addr))
+    return 1;
+
+  const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if(fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0)
+  {
+    std::cerr << "Cannot connect to \"" << socket_path << "\": " << std::strerror(errno) << "\n";
+    if(fd >= 0)
+      ::close(fd);
+    return 1;
+  }
+
+  std::string line;
+  std::string pending;
+  char chunk[4096];
+  while(std::getline(in, line))
+  {
+    if(line.find_first_not_of(" \t\r") == std::string::npos)
+      continue;
+    line.push_back('\n');
+    if(!write_all(fd, line.data(), line.size()))
+      break;
+
+    // wait for the response before sending the next request
+    std::size_t eol;
+    while((eol = pending.find('\n')) == std::string::npos)
+    {
+      const ssize_t got = ::read(fd, chunk, sizeof(chunk));
+      if(got < 0 && errno == EINTR)
+        continue;
+      if(got <= 0)
+      {
+        ::close(fd);
+        return 1;
+      }
+      pending.append(chunk, static_cast<std::size_t>(got));
+    }
+    out << pending.substr(0, eol + 1);
+    out.flush();
+    pending.erase(0, eol + 1);
+  }
+  ::close(fd);
+  return 0;
+}
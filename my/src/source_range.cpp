@@ -1,24 +1,110 @@
 #include <source_range.hpp>
 
-SourceRange::SourceRange(const char* module, std::size_t column_beg, std::size_t row_beg,
-                                             std::size_t column_end, std::size_t row_end)
-  : module(module), column_beg(column_beg), row_beg(row_beg), column_end(column_end), row_end(row_end)
+#include <algorithm>
+#include <mutex>
+
+std::shared_mutex SourceModules::modules_mutex;
+std::deque<SourceModules::Module> SourceModules::modules = { { "", { 0 } } };
+tsl::hopscotch_map<std::string, std::uint32_t> SourceModules::module_index = {};
+std::vector<std::uint32_t> SourceModules::released = {};
+
+std::uint32_t SourceModules::add(const std::string& name)
+{
+  std::unique_lock<std::shared_mutex> lock(modules_mutex);
+
+  auto it = module_index.find(name);
+  if(it != module_index.end())
+    return it->second;
+
+  const auto id = static_cast<std::uint32_t>(modules.size());
+  modules.push_back({ name, { 0 } });
+  module_index.emplace(name, id);
+  return id;
+}
+
+std::uint32_t SourceModules::add_stream(const std::string& name)
+{
+  std::unique_lock<std::shared_mutex> lock(modules_mutex);
+
+  if(!released.empty())
+  {
+    const auto id = released.back();
+    released.pop_back();
+    modules[id] = { name, { 0 } };
+    return id;
+  }
+  const auto id = static_cast<std::uint32_t>(modules.size());
+  modules.push_back({ name, { 0 } });
+  return id;
+}
+
+void SourceModules::release(std::uint32_t module)
+{
+  std::unique_lock<std::shared_mutex> lock(modules_mutex);
+
+  released.push_back(module);
+}
+
+void SourceModules::add_line(std::uint32_t module, std::uint32_t offset)
+{
+  std::unique_lock<std::shared_mutex> lock(modules_mutex);
+
+  auto& line_starts = modules[module].line_starts;
+  if(offset > line_starts.back())
+    line_starts.push_back(offset);
+}
+
+std::string SourceModules::name(std::uint32_t module)
+{
+  std::shared_lock<std::shared_mutex> lock(modules_mutex);
+
+  return modules[module].name;
+}
+
+SourcePosition SourceModules::resolve(std::uint32_t module, std::uint32_t offset)
+{
+  std::shared_lock<std::shared_mutex> lock(modules_mutex);
+
+  const auto& line_starts = modules[module].line_starts;
+  // the last line starting at or before the offset
+  auto line = std::upper_bound(line_starts.begin(), line_starts.end(), offset) - 1;
+  return { offset - *line + 1, static_cast<std::uint32_t>(line - line_starts.begin()) + 1 };
+}
+
+StreamModule::StreamModule(const std::string& name)
+  : module(SourceModules::add_stream(name))
 {  }
 
-void SourceRange::widen(const SourceRange& other)
+StreamModule::~StreamModule()
 {
-  column_beg = std::min(column_beg, other.column_beg);
-  row_beg = std::min(row_beg, other.row_beg);
+  SourceModules::release(module);
+}
+
+std::uint32_t StreamModule::id() const
+{ return module; }
 
-  column_end = std::max(column_end, other.column_end);
-  row_end = std::max(row_end, other.row_end);
+SourceRange::SourceRange(std::uint32_t module, std::uint32_t begin, std::uint32_t end)
+  : module(module), begin(begin), end(end)
+{  }
+
+void SourceRange::widen(const SourceRange& other)
+{
+  begin = std::min(begin, other.begin);
+  end = std::max(end, other.end);
 }
 
+std::string SourceRange::module_name() const
+{ return SourceModules::name(module); }
+
+SourcePosition SourceRange::position() const
+{ return SourceModules::resolve(module, begin); }
+
 std::ostream& operator<<(std::ostream& os, const SourceRange& src_range)
 {
-  os << src_range.module << ":" << src_range.column_beg
-                         << ":" << src_range.row_beg
-                         << ":";
+  const SourcePosition pos = src_range.position();
+  os << src_range.module_name() << ":" << pos.column
+                                << ":" << pos.row
+                                << ":";
   return os;
 }
 
@@ -30,4 +116,3 @@ SourceRange operator+(const SourceRange& left, const SourceRange& right)
 
   return range;
 }
-
@@ -0,0 +1,395 @@
+#include <strictness.hpp>
+
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+struct Result
+{
+  // variables evaluated whenever the term is
+  SymbolSet demanded;
+  Strictness value;
+  // for a λ, the variables other than its parameters the body evaluates once applied
+  SymbolSet applied;
+};
+
+class Analysis
+{
+public:
+  Analysis()
+    : work(), results(), env()
+  {  }
+
+  Strictness run(Expression* root)
+  {
+    work.push_back({ root, Stage::Enter, 0, {}, 0 });
+    while(!work.empty())
+    {
+      const Frame frame = work.back();
+      work.pop_back();
+      switch(frame.stage)
+      {
+      case Stage::Enter: enter(frame.node); break;
+      case Stage::Lambda: leave_lambda(static_cast<Lambda*>(frame.node)); break;
+      case Stage::Spine: leave_spine(static_cast<FunctionCall*>(frame.node), frame.index); break;
+      case Stage::LetBody: enter_let_body(static_cast<Let*>(frame.node)); break;
+      case Stage::Let: leave_let(static_cast<Let*>(frame.node)); break;
+      case Stage::LetRecBound: leave_letrec_bound(static_cast<LetRec*>(frame.node), frame.assumed, frame.round); break;
+      case Stage::LetRec: leave_letrec(static_cast<LetRec*>(frame.node)); break;
+      case Stage::CaseBind: bind_alternative(static_cast<Case*>(frame.node), frame.index); break;
+      case Stage::CaseUnbind: unbind_alternative(static_cast<Case*>(frame.node), frame.index); break;
+      case Stage::Case: leave_case(static_cast<Case*>(frame.node)); break;
+      }
+    }
+    return results.back().value;
+  }
+private:
+  enum class Stage : std::uint_fast8_t
+  {
+    Enter,
+    Lambda,
+    Spine,
+    LetBody,
+    Let,
+    LetRecBound,
+    LetRec,
+    CaseBind,
+    CaseUnbind,
+    Case
+  };
+
+  struct Frame
+  {
+    Expression* node;
+    Stage stage;
+    std::size_t index;
+    // letrec: the strictness of the bound name while iterating
+    Strictness assumed;
+    std::uint32_t round;
+  };
+
+  // each parameter is iterated away at most once, so a fixpoint is reached well before this
+  static constexpr std::uint32_t max_rounds = 66;
+
+  static std::uint64_t all_params(std::uint32_t arity)
+  { return arity >= 64 ? ~std::uint64_t(0) : (std::uint64_t(1) << arity) - 1; }
+
+  static std::uint32_t chain_length(const Expression* node)
+  {
+    std::uint32_t count = 0;
+    for(; node->kind() == ExpressionKind::Lambda; node = static_cast<const Lambda*>(node)->fn_body().get())
+      ++count;
+    return count;
+  }
+
+  static void intersect(SymbolSet& into, const SymbolSet& with)
+  {
+    for(auto it = into.begin(); it != into.end();)
+    {
+      if(with.count(*it))
+        ++it;
+      else
+        it = into.erase(it);
+    }
+  }
+
+  void bind(Symbol name, Strictness value)
+  { env[name].push_back(value); }
+
+  void unbind(Symbol name)
+  { env[name].pop_back(); }
+
+  Strictness lookup(Symbol name) const
+  {
+    auto it = env.find(name);
+    if(it == env.end() || it->second.empty())
+      return {};
+    return it->second.back();
+  }
+
+  void enter(Expression* node)
+  {
+    switch(node->kind())
+    {
+    default:
+      results.push_back({});
+      break;
+
+    case ExpressionKind::Identifier:
+      {
+        const Symbol name = static_cast<Identifier*>(node)->id();
+        Result result;
+        result.demanded.insert(name);
+        result.value = lookup(name);
+        results.push_back(std::move(result));
+      } break;
+
+    case ExpressionKind::Primitive:
+      {
+        auto prim = static_cast<Primitive*>(node);
+        Result result;
+        result.value.arity = prim->arity();
+        result.value.params = all_params(prim->strict_arity());
+        results.push_back(std::move(result));
+      } break;
+
+    case ExpressionKind::Lambda:
+      {
+        work.push_back({ node, Stage::Lambda, 0, {}, 0 });
+        Expression* body = node;
+        for(; body->kind() == ExpressionKind::Lambda; body = static_cast<Lambda*>(body)->fn_body().get())
+          bind(static_cast<Lambda*>(body)->fn_binding()->id(), {});
+        work.push_back({ body, Stage::Enter, 0, {}, 0 });
+      } break;
+
+    case ExpressionKind::FunctionCall:
+      {
+        std::vector<Expression*> args;
+        Expression* head = node;
+        for(; head->kind() == ExpressionKind::FunctionCall; head = static_cast<FunctionCall*>(head)->fn_expr().get())
+          args.push_back(static_cast<FunctionCall*>(head)->arg_expr().get());
+        // the head's result ends up below those of the arguments, the first argument's next to it
+        work.push_back({ node, Stage::Spine, args.size(), {}, 0 });
+        for(Expression* arg : args)
+          work.push_back({ arg, Stage::Enter, 0, {}, 0 });
+        work.push_back({ head, Stage::Enter, 0, {}, 0 });
+      } break;
+
+    case ExpressionKind::Let:
+      work.push_back({ node, Stage::LetBody, 0, {}, 0 });
+      work.push_back({ static_cast<Let*>(node)->let_bound().get(), Stage::Enter, 0, {}, 0 });
+      break;
+
+    case ExpressionKind::LetRec:
+      {
+        auto rec = static_cast<LetRec*>(node);
+        // optimistically strict in everything, the rounds only ever drop parameters
+        Strictness assumed;
+        assumed.arity = chain_length(rec->rec_bound().get());
+        assumed.params = all_params(assumed.arity);
+        enter_letrec_bound(rec, assumed, 0);
+      } break;
+
+    case ExpressionKind::Case:
+      {
+        auto match = static_cast<Case*>(node);
+        work.push_back({ node, Stage::Case, 0, {}, 0 });
+        for(std::size_t i = match->alternatives().size(); i-- > 0;)
+        {
+          work.push_back({ node, Stage::CaseUnbind, i, {}, 0 });
+          work.push_back({ match->alternatives()[i].body.get(), Stage::Enter, 0, {}, 0 });
+          work.push_back({ node, Stage::CaseBind, i, {}, 0 });
+        }
+        work.push_back({ match->case_scrutinee().get(), Stage::Enter, 0, {}, 0 });
+      } break;
+    }
+  }
+
+  void leave_lambda(Lambda* fn)
+  {
+    Result body = std::move(results.back());
+    results.pop_back();
+
+    std::vector<Lambda*> chain;
+    for(Expression* node = fn; node->kind() == ExpressionKind::Lambda; node = static_cast<Lambda*>(node)->fn_body().get())
+      chain.push_back(static_cast<Lambda*>(node));
+
+    std::uint64_t params = 0;
+    for(std::size_t i = 0; i < chain.size() && i < 64; ++i)
+    {
+      const Symbol name = chain[i]->fn_binding()->id();
+      // a later parameter of the same name hides this one
+      const bool hidden = std::any_of(chain.begin() + i + 1, chain.end(),
+                                      [name](Lambda* other) { return other->fn_binding()->id() == name; });
+      if(!hidden && body.demanded.count(name))
+        params |= std::uint64_t(1) << i;
+    }
+    for(std::size_t i = chain.size(); i-- > 0;)
+    {
+      unbind(chain[i]->fn_binding()->id());
+      body.demanded.erase(chain[i]->fn_binding()->id());
+      chain[i]->mark_strict(chain.size() - i, i < 64 ? params >> i : 0);
+    }
+
+    Result result;
+    result.value = { static_cast<std::uint32_t>(chain.size()), params, fn };
+    result.applied = std::move(body.demanded);
+    results.push_back(std::move(result));
+  }
+
+  void leave_spine(FunctionCall* call, std::size_t count)
+  {
+    // the results of the arguments, the first one last
+    std::vector<Result> args(count);
+    for(std::size_t i = 0; i < count; ++i)
+    {
+      args[i] = std::move(results.back());
+      results.pop_back();
+    }
+    std::reverse(args.begin(), args.end());
+    Result head = std::move(results.back());
+    results.pop_back();
+
+    const Expression* head_node = call;
+    while(head_node->kind() == ExpressionKind::FunctionCall)
+      head_node = static_cast<const FunctionCall*>(head_node)->fn_expr().get();
+
+    Result result;
+    result.demanded = std::move(head.demanded);
+    const Strictness& fn = head.value;
+    if(head_node->kind() == ExpressionKind::Primitive
+       && static_cast<const Primitive*>(head_node)->op() == PrimitiveOp::IfZero && count >= 3)
+    {
+      // only what both branches evaluate
+      SymbolSet branches = std::move(args[1].demanded);
+      intersect(branches, args[2].demanded);
+      result.demanded.insert(args[0].demanded.begin(), args[0].demanded.end());
+      result.demanded.insert(branches.begin(), branches.end());
+    }
+    else if(fn.arity > 0 && fn.arity <= count)
+    {
+      for(std::size_t i = 0; i < fn.arity && i < 64; ++i)
+        if(fn.params & (std::uint64_t(1) << i))
+          result.demanded.insert(args[i].demanded.begin(), args[i].demanded.end());
+      // the free variables of a λ written right here mean the same in its body
+      if(head_node->kind() == ExpressionKind::Lambda)
+        result.demanded.insert(head.applied.begin(), head.applied.end());
+    }
+    else if(fn.arity > count)
+    {
+      // a partial application is a value, its strictness moves on to the remaining arguments
+      result.value.arity = fn.arity - count;
+      result.value.params = count < 64 ? fn.params >> count : 0;
+    }
+    results.push_back(std::move(result));
+  }
+
+  void enter_let_body(Let* let)
+  {
+    bind(let->let_binding()->id(), results.back().value);
+    work.push_back({ let, Stage::Let, 0, {}, 0 });
+    work.push_back({ let->let_body().get(), Stage::Enter, 0, {}, 0 });
+  }
+
+  void leave_let(Let* let)
+  {
+    Result body = std::move(results.back());
+    results.pop_back();
+    Result bound = std::move(results.back());
+    results.pop_back();
+
+    const Symbol name = let->let_binding()->id();
+    unbind(name);
+    if(body.demanded.erase(name))
+      body.demanded.insert(bound.demanded.begin(), bound.demanded.end());
+    results.push_back(std::move(body));
+  }
+
+  void enter_letrec_bound(LetRec* rec, Strictness assumed, std::uint32_t round)
+  {
+    bind(rec->rec_binding()->id(), assumed);
+    work.push_back({ rec, Stage::LetRecBound, 0, assumed, round });
+    work.push_back({ rec->rec_bound().get(), Stage::Enter, 0, {}, 0 });
+  }
+
+  void leave_letrec_bound(LetRec* rec, Strictness assumed, std::uint32_t round)
+  {
+    const Symbol name = rec->rec_binding()->id();
+    unbind(name);
+
+    Strictness found = results.back().value;
+    // nothing was assumed, or the assumption held and the λs are marked accordingly
+    if(assumed.arity == 0 || (found.arity == assumed.arity && found.params == assumed.params))
+    {
+      bind(name, found);
+      work.push_back({ rec, Stage::LetRec, 0, {}, 0 });
+      work.push_back({ rec->rec_body().get(), Stage::Enter, 0, {}, 0 });
+      return;
+    }
+
+    results.pop_back();
+    Strictness next;
+    if(found.arity == assumed.arity && round + 1 < max_rounds)
+    {
+      next = found;
+      next.params &= assumed.params;
+    }
+    // assuming nothing always holds
+    enter_letrec_bound(rec, next, round + 1);
+  }
+
+  void leave_letrec(LetRec* rec)
+  {
+    Result body = std::move(results.back());
+    results.pop_back();
+    Result bound = std::move(results.back());
+    results.pop_back();
+
+    const Symbol name = rec->rec_binding()->id();
+    unbind(name);
+    if(body.demanded.erase(name))
+    {
+      bound.demanded.erase(name);
+      body.demanded.insert(bound.demanded.begin(), bound.demanded.end());
+    }
+    results.push_back(std::move(body));
+  }
+
+  void bind_alternative(Case* match, std::size_t index)
+  {
+    for(auto& binder : match->alternatives()[index].binders)
+      bind(binder->id(), {});
+  }
+
+  void unbind_alternative(Case* match, std::size_t index)
+  {
+    for(auto& binder : match->alternatives()[index].binders)
+    {
+      unbind(binder->id());
+      results.back().demanded.erase(binder->id());
+    }
+  }
+
+  void leave_case(Case* match)
+  {
+    const std::size_t count = match->alternatives().size();
+    std::vector<Result> alts(count);
+    for(std::size_t i = 0; i < count; ++i)
+    {
+      alts[i] = std::move(results.back());
+      results.pop_back();
+    }
+    Result result;
+    result.demanded = std::move(results.back().demanded);
+    results.pop_back();
+
+    if(count > 0)
+    {
+      SymbolSet shared = std::move(alts[0].demanded);
+      for(std::size_t i = 1; i < count; ++i)
+        intersect(shared, alts[i].demanded);
+      result.demanded.insert(shared.begin(), shared.end());
+    }
+    results.push_back(std::move(result));
+  }
+private:
+  std::vector<Frame> work;
+  std::vector<Result> results;
+  // the strictness of the names in scope, innermost binding last
+  SymbolMap<std::vector<Strictness>> env;
+};
+}
+
+static bool is_marked = false;
+
+Strictness analyze_strictness(const Expression::Ptr& term)
+{
+  if(!term)
+    return {};
+  is_marked = true;
+  return Analysis().run(term.get());
+}
+
+bool strictness_marked()
+{ return is_marked; }
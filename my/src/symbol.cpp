@@ -1,7 +1,11 @@
 #include <symbol.hpp>
 #include <util.hpp>
 
-thread_local tsl::hopscotch_map<std::uint_fast32_t, std::string> Symbol::symbols = {};
+#include <mutex>
+
+std::shared_mutex Symbol::symbols_mutex;
+std::deque<std::string> Symbol::symbol_storage = {};
+tsl::hopscotch_map<std::uint_fast32_t, Symbol::Entry> Symbol::symbols = {};
 
 Symbol::Symbol(const std::string& str)
   : hash(hash_string(str))
@@ -54,18 +58,27 @@ Symbol& Symbol::operator=(Symbol&& s)
 
 std::ostream& operator<<(std::ostream& os, const Symbol& symb)
 {
-  os << Symbol::symbols[symb.hash];
+  os << symb.get_string();
   return os;
 }
 
-std::string& Symbol::lookup_or_emplace(std::uint_fast32_t hash, const char* str)
+const std::string& Symbol::lookup_or_emplace(std::uint_fast32_t hash, const char* str)
 {
-  auto it = symbols.find(hash);
-  if(it != symbols.end())
-    return symbols[hash];
-
-  symbols[hash] = str;
-  return symbols[hash];
+  {
+    std::shared_lock<std::shared_mutex> lock(symbols_mutex);
+    auto it = symbols.find(hash);
+    if(it != symbols.end())
+      return *it->second.text;
+  }
+  std::unique_lock<std::shared_mutex> lock(symbols_mutex);
+  auto& slot = symbols[hash];
+  if(!slot.text)
+  {
+    slot.ordinal = static_cast<std::uint32_t>(symbol_storage.size());
+    symbol_storage.emplace_back(str);
+    slot.text = &symbol_storage.back();
+  }
+  return *slot.text;
 }
 
 std::ostream& operator<<(std::ostream& os, const std::vector<Symbol>& symbs)
@@ -79,7 +92,16 @@ std::uint_fast32_t Symbol::get_hash() const
 { return hash; }
 
 const std::string& Symbol::get_string() const
-{ return symbols[hash]; }
+{
+  std::shared_lock<std::shared_mutex> lock(symbols_mutex);
+  return *symbols.find(hash)->second.text;
+}
+
+std::uint32_t Symbol::ordinal() const
+{
+  std::shared_lock<std::shared_mutex> lock(symbols_mutex);
+  return symbols.find(hash)->second.ordinal;
+}
 
 bool operator==(const Symbol& a, const Symbol& b)
 {
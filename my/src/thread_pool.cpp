@@ -0,0 +1,64 @@
+#include <thread_pool.hpp>
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(std::size_t count)
+  : workers(), tasks(), mutex(), has_task(), is_idle(), running(0), stopping(false)
+{
+  if(count == 0)
+    count = std::max(1U, std::thread::hardware_concurrency());
+  for(std::size_t i = 0; i < count; ++i)
+    workers.emplace_back([this]() { work(); });
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  has_task.notify_all();
+  for(auto& worker : workers)
+    worker.join();
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    tasks.emplace_back(std::move(task));
+  }
+  has_task.notify_one();
+}
+
+void ThreadPool::wait()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  is_idle.wait(lock, [this]() { return tasks.empty() && running == 0; });
+}
+
+std::size_t ThreadPool::size() const
+{ return workers.size(); }
+
+void ThreadPool::work()
+{
+  for(;;)
+  {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      has_task.wait(lock, [this]() { return stopping || !tasks.empty(); });
+      if(tasks.empty())
+        return;
+      task = std::move(tasks.front());
+      tasks.pop_front();
+      ++running;
+    }
+    task();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      --running;
+    }
+    is_idle.notify_all();
+  }
+}
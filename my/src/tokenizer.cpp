@@ -1,137 +1,225 @@
 #include <tokenizer.hpp>
 
-constexpr static const char lambda_blob[] = "λ";
+#include <array>
+#include <string_view>
+
+namespace
+{
+enum class ByteClass : std::uint8_t
+{
+  // starts or continues an identifier
+  Ident,
+  Digit,
+  Space,
+  // ends an identifier, but starts one where a token is expected
+  Control,
+  // a token of its own
+  Single,
+  // may start a compound token
+  Compound
+};
+
+constexpr std::string_view compound_texts[] = {
+#define TOK_COMPOUND(x, v) v,
+#include <tokens.def>
+};
+constexpr TokenKind compound_kinds[] = {
+#define TOK_COMPOUND(x, v) TokenKind::x,
+#include <tokens.def>
+};
+
+// Generated from tokens.def at compile time. Compound tokens are told apart by their first byte.
+struct LexTables
+{
+  std::array<ByteClass, 256> classes;
+  std::array<TokenKind, 256> singles;
+  std::array<std::uint8_t, 256> compounds;
+};
+
+constexpr LexTables make_tables()
+{
+  LexTables tables {};
+  for(std::size_t c = 0; c < 256; ++c)
+  {
+    tables.classes[c] = c < 32 || c == 127 ? ByteClass::Control : ByteClass::Ident;
+    tables.singles[c] = TokenKind::Undef;
+  }
+  for(char c : { ' ', '\t', '\n', '\v', '\f', '\r' })
+    tables.classes[static_cast<unsigned char>(c)] = ByteClass::Space;
+  for(char c = '0'; c <= '9'; ++c)
+    tables.classes[static_cast<unsigned char>(c)] = ByteClass::Digit;
+
+#define TOK_CONTROL(x, v) tables.classes[static_cast<unsigned char>(v)] = ByteClass::Single; \
+                          tables.singles[static_cast<unsigned char>(v)] = TokenKind::x;
+#define TOK_EXPR_OP(x, v) TOK_CONTROL(x, v)
+#include <tokens.def>
+
+  for(std::size_t i = 0; i < std::size(compound_texts); ++i)
+  {
+    const auto first = static_cast<unsigned char>(compound_texts[i][0]);
+    if(tables.classes[first] == ByteClass::Compound)
+      throw "two compound tokens start with the same byte";
+    tables.classes[first] = ByteClass::Compound;
+    tables.compounds[first] = static_cast<std::uint8_t>(i);
+  }
+  return tables;
+}
+
+constexpr LexTables tables = make_tables();
+
+TokenKind keyword_or_id(const std::string& name)
+{
+  // keyword kinds are the hashes of their text
+  switch(static_cast<TokenKind>(hash_string<const char*, std::int_fast16_t>(name.c_str())))
+  {
+  default: return TokenKind::Id;
+
+#define TOK_KEYWORD(x, v) case TokenKind::x: return name == v ? TokenKind::x : TokenKind::Id;
+#include <tokens.def>
+  }
+}
+}
 
 Tokenizer::Tokenizer(const char* module, std::istream& handle)
-  : module(module), handle(handle), linebuf(), row(1), col(0), token_data_table()
+  : Tokenizer(SourceModules::add(module), handle)
 {  }
 
-const std::string& Tokenizer::module_name() const
-{ return module; }
+Tokenizer::Tokenizer(std::uint32_t module, std::istream& handle)
+  : module(module), handle(handle), linebuf(), line_offset(0), next_line_offset(0), col(0),
+    buffer(), cursor(0)
+{ buffer.module = this->module; }
+
+std::string Tokenizer::module_name() const
+{ return SourceModules::name(module); }
+
+void Tokenizer::fill(std::size_t count)
+{
+  for(; count > 0; --count)
+  {
+    if(buffer.size() > 0 && buffer.kinds.back() == TokenKind::EndOfFile)
+      return;
+    lex();
+  }
+}
+
+const TokenBuffer& Tokenizer::tokens() const
+{ return buffer; }
 
 Token Tokenizer::get()
 {
-  void* data = nullptr;
+  if(cursor == buffer.size())
+    fill(batch_size);
+
+  Token tok = buffer.token(cursor);
+  if(tok.tok_kind() != TokenKind::EndOfFile)
+    ++cursor;
+  return tok;
+}
+
+std::size_t Tokenizer::position() const
+{ return cursor; }
+
+void Tokenizer::seek(std::size_t index)
+{ cursor = index; }
+
+void Tokenizer::lex()
+{
+  std::uint32_t symbol = 0;
   TokenKind kind = TokenKind::Undef;
 
-  char ch = read();
-  std::size_t beg_row = row;
-  std::size_t beg_col = col - 1;
+  const int ch = read();
+  const std::size_t beg_col = col - 1;
 
-  switch(ch)
-  {
-  default:
+  if(ch == EOF)
+    kind = TokenKind::EndOfFile;
+  else
+    switch(tables.classes[ch])
     {
-      // Optimistically allow any kind of identifier to allow for unicode
-      std::uint_fast32_t hash = ch;
-      std::string name;
-      name.push_back(ch);
-      while(col < linebuf.size())
-      {
-        ch = linebuf[col++];
+    case ByteClass::Single:
+      kind = tables.singles[ch];
+      break;
 
-        // break if we hit whitespace (or other control chars) or any other token char
-        if(std::iscntrl(ch) || std::isspace(ch)
-#define TOK_CONTROL(x, v) || ch == v
-#define TOK_COMPOUND(x, v) || ch == v[0]
-#define TOK_EXPR_OP(x, v) || ch == v
-#include <tokens.def>
-            )
-        {
-          col--;
-          break;
-        }
-        name.push_back(ch);
-        hash ^= (hash * 31) + ch;
-      }
-      kind = TokenKind::Id;
-      auto& v = token_data_table[hash];
-      v.resize(name.size() + 1, 0);
-      std::copy(name.begin(), name.end(), v.begin());
-      data = &v[0];
-    } break;
-
-  case lambda_blob[0]:
-    if(accept(std::string(std::begin(lambda_blob) + 1, std::end(lambda_blob) - 1)))
-    {
-      kind = TokenKind::Lambda;
+    case ByteClass::Digit:
+      while(col < linebuf.size() && tables.classes[byte_at(col)] == ByteClass::Digit)
+        col++;
+      kind = TokenKind::Number;
+      symbol = buffer.add_literal(std::string_view(linebuf).substr(beg_col, col - beg_col));
       break;
+
+    case ByteClass::Compound:
+      if(std::size_t length = compound_at(beg_col))
+      {
+        kind = compound_kinds[tables.compounds[ch]];
+        col = beg_col + length;
+        break;
+      }
+      [[fallthrough]];
+    default:
+      {
+        // Optimistically allow any kind of identifier to allow for unicode
+        while(col < linebuf.size() && continues_identifier(col))
+          col++;
+        const std::string name = linebuf.substr(beg_col, col - beg_col);
+        kind = keyword_or_id(name);
+        if(kind == TokenKind::Id)
+          symbol = buffer.add_name(name);
+      } break;
     }
-  case '(':
-  case ')':
-  case '=':
-  case ';':
-  case '.':
-      kind = static_cast<TokenKind>(ch);
-    break;
-  case EOF:
-      kind = TokenKind::EndOfFile;
-    break;
-  }
-  return Token(SourceRange(module.c_str(), beg_col + 1, beg_row, col + 1, row), kind, data);
+  buffer.push(kind, symbol, static_cast<std::uint32_t>(line_offset + beg_col), static_cast<std::uint32_t>(line_offset + col));
 }
 
-char Tokenizer::read()
+int Tokenizer::read()
 {
-  char ch = 0;
-  bool skipped_line = false;
-  do
+  for(;;)
   {
-    if(col >= linebuf.size())
+    while(col < linebuf.size() && tables.classes[byte_at(col)] == ByteClass::Space)
+      col++;
+    if(col < linebuf.size())
+      return byte_at(col++);
+
+    do
     {
-      if(!linebuf.empty())
-        row++;
-      if(!(std::getline(handle, linebuf)))
+      if(!next_line())
       {
         col = 1;
         linebuf = "";
         return EOF;
       }
-      else
-      {
-        while(linebuf.empty())
-        {
-          row++;
-          if(!(std::getline(handle, linebuf)))
-          {
-            col = 1;
-            linebuf = "";
-            return EOF;
-          }
-        }
-      }
-      col = 0;
-    }
-    ch = linebuf[col++];
-    if(std::isspace(ch))
-    {
-      skipped_line = true;
-      while(col < linebuf.size())
-      {
-        ch = linebuf[col++];
-        if(!(std::isspace(ch)))
-        {
-          skipped_line = false;
-          break;
-        }
-      }
-    }
-  } while(skipped_line);
+    } while(linebuf.empty());
+    col = 0;
+  }
+}
 
-  return ch;
+bool Tokenizer::next_line()
+{
+  // the end of the stream is located at the start of the line after the last one
+  line_offset = next_line_offset;
+  SourceModules::add_line(module, line_offset);
+  if(!(std::getline(handle, linebuf)))
+    return false;
+  next_line_offset += static_cast<std::uint32_t>(linebuf.size()) + 1;
+  return true;
 }
 
-bool Tokenizer::accept(std::string substr)
+unsigned char Tokenizer::byte_at(std::size_t pos) const
+{ return static_cast<unsigned char>(linebuf[pos]); }
+
+std::size_t Tokenizer::compound_at(std::size_t pos) const
 {
-  if(col + substr.size() < linebuf.size())
+  const std::string_view text = compound_texts[tables.compounds[byte_at(pos)]];
+  return linebuf.compare(pos, text.size(), text) == 0 ? text.size() : 0;
+}
+
+bool Tokenizer::continues_identifier(std::size_t pos) const
+{
+  switch(tables.classes[byte_at(pos)])
   {
-    for(std::size_t c = col; c < col + substr.size(); ++c)
-      if(linebuf[c] != substr[c - col])
-        return false;
-    col += substr.size();
-    return true;
+  default: return false;
+
+  case ByteClass::Ident:
+  case ByteClass::Digit: return true;
+  case ByteClass::Compound: return compound_at(pos) == 0;
   }
-  return false;
 }
 
 std::string to_string(TokenKind kind)
@@ -148,10 +236,26 @@ std::string to_string(TokenKind kind)
   case TokenKind::Dot: return "Dot";
 
   case TokenKind::Id: return "Id";
+  case TokenKind::Number: return "Number";
   case TokenKind::Equal: return "Equal";
 
+  case TokenKind::Plus: return "Plus";
+  case TokenKind::Minus: return "Minus";
+  case TokenKind::Star: return "Star";
+  case TokenKind::Slash: return "Slash";
+  case TokenKind::Less: return "Less";
+
+  case TokenKind::IfZero: return "ifz";
+  case TokenKind::Let: return "let";
+  case TokenKind::LetRec: return "letrec";
+  case TokenKind::In: return "in";
+  case TokenKind::Pack: return "pack";
+  case TokenKind::Case: return "case";
+  case TokenKind::Of: return "of";
+
   case TokenKind::LParen: return "LParen";
   case TokenKind::RParen: return "RParen";
+  case TokenKind::Bar: return "Bar";
 
   case TokenKind::Lambda: return "λ";
   }
@@ -161,6 +265,65 @@ void Tokenizer::reset()
 {
   handle.clear();
   handle.seekg(0, std::ios::beg);
+  linebuf.clear();
+  line_offset = next_line_offset = 0;
+  col = 0;
+  buffer.clear();
+  cursor = 0;
+}
+
+const char* TokenBuffer::text(std::size_t index) const
+{
+  switch(kinds[index])
+  {
+  default: return nullptr;
+
+  case TokenKind::Id: return names[symbols[index]].get_string().c_str();
+  case TokenKind::Number: return literals.c_str() + symbols[index];
+  }
+}
+
+Token TokenBuffer::token(std::size_t index) const
+{ return Token(loc(index), kinds[index], text(index)); }
+
+void TokenBuffer::push(TokenKind kind, std::uint32_t symbol, std::uint32_t begin, std::uint32_t end)
+{
+  kinds.push_back(kind);
+  symbols.push_back(symbol);
+  begins.push_back(begin);
+  ends.push_back(end);
+}
+
+std::uint32_t TokenBuffer::add_name(const std::string& name)
+{
+  Symbol sym(name);
+  auto it = name_ids.find(sym);
+  if(it != name_ids.end())
+    return it->second;
+
+  const auto id = static_cast<std::uint32_t>(names.size());
+  names.push_back(sym);
+  name_ids.emplace(sym, id);
+  return id;
+}
+
+std::uint32_t TokenBuffer::add_literal(std::string_view digits)
+{
+  const auto offset = static_cast<std::uint32_t>(literals.size());
+  literals.append(digits);
+  literals.push_back('\0');
+  return offset;
+}
+
+void TokenBuffer::clear()
+{
+  kinds.clear();
+  symbols.clear();
+  begins.clear();
+  ends.clear();
+  names.clear();
+  name_ids.clear();
+  literals.clear();
 }
 
 Token::operator std::string() const
@@ -169,7 +332,8 @@ Token::operator std::string() const
   {
   default: return to_string(kind);
 
-  case TokenKind::Id: return to_string(kind) + "(" + this->data_as_text() + ")";
+  case TokenKind::Id:
+  case TokenKind::Number: return to_string(kind) + "(" + this->data_as_text() + ")";
   }
 }
 
@@ -0,0 +1,3 @@
+#!/bin/bash
+
+$* --eval --church --strategy normal
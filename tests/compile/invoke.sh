@@ -0,0 +1,7 @@
+#!/bin/bash
+
+DIR=$(mktemp -d /tmp/mf-compile-XXXXXX)
+$1 --emit-c "$DIR/program.c" "$2" && cc -O1 -o "$DIR/program" "$DIR/program.c" && "$DIR/program" | tee "$DIR/compiled.txt"
+# the compiled program agrees with the tree engine, any difference shows up as a failure
+$1 --eval --strategy normal "$2" | diff "$DIR/compiled.txt" -
+rm -rf "$DIR"
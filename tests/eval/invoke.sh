@@ -0,0 +1,3 @@
+#!/bin/bash
+
+$* --eval --strategy normal --jobs 2
@@ -0,0 +1,7 @@
+#!/bin/bash
+
+# under cbn an argument reduced once is shown reduced wherever it is shared, unlike on trees
+for strategy in normal cbn
+do
+  $* --eval --engine heap --strategy $strategy
+done
@@ -0,0 +1,3 @@
+#!/bin/bash
+
+$* --eval --strategy cbv --optimize --optimize-report
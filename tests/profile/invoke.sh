@@ -0,0 +1,5 @@
+#!/bin/bash
+
+# timings differ from run to run, the module path with the directory the tests are run from
+$* --eval --strategy normal --jobs 1 --profile | sed -E -e 's/ +([0-9]+\.[0-9]{3}|time \[us\])  /  /' -e 's/\([^ ]*\/([^/]*:)/(\1/'
+$* --eval --engine heap --profile
@@ -0,0 +1,18 @@
+#!/bin/bash
+
+SOCKET=$(mktemp -u /tmp/mf-serve-XXXXXX)
+$1 --serve "$SOCKET" --jobs 2 --max-connections 1 "$2" > /dev/null &
+SERVER=$!
+for i in $(seq 50); do
+  [ -S "$SOCKET" ] && break
+  sleep 0.1
+done
+
+# timings differ from run to run
+$1 --connect "$SOCKET" < "${2%.*}.req" | sed -e 's/,"time_us":[0-9]*//'
+# only answered once the first client has given its connection back
+echo '{"id": "next client", "term": "id"}' | $1 --connect "$SOCKET" | sed -e 's/,"time_us":[0-9]*//'
+
+kill $SERVER
+wait $SERVER 2> /dev/null
+rm -f "$SOCKET"
@@ -0,0 +1,3 @@
+#!/bin/bash
+
+$* --eval --engine heap --strategy normal --print-sharing
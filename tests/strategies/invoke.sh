@@ -0,0 +1,12 @@
+#!/bin/bash
+
+for strategy in applicative hnf whnf
+do
+  $* --eval --strategy $strategy
+done
+
+# whnf is call-by-name under another name, on every engine
+for engine in tree heap combinator
+do
+  diff <($* --eval --strategy cbn --engine $engine) <($* --eval --strategy whnf --engine $engine)
+done